@@ -77,6 +77,7 @@ public:
     bool gotoBreakpoint(BreakPoint *breakpoint);
 
     QList<BreakPoint *> getBreakPoints(QString fileName);
+    QList<BreakPoint *> getAllBreakPoints() const { return m_breakpointsList; }
 signals:
     void updateActions(bool enableToggle, int state);
     void currentIndexChanged(const QModelIndex &);
@@ -27,6 +27,7 @@
 class SmaliHighlight;
 class SmaliBlockData;
 class SmaliSideBar;
+class SmaliTokenCache;
 
 class SmaliEditor : public TextEditor
 {
@@ -36,6 +37,8 @@ public:
     virtual ~SmaliEditor();
 
     bool openFile(const QString &fileName, int iLine = 1);
+    // saved content is parsed from cached tokens and given to SmaliAnalysis
+    bool saveFile() Q_DECL_OVERRIDE;
 
     void setTheme(const KSyntaxHighlighting::Theme &theme);
 public:
@@ -48,10 +51,16 @@ public:
     void toggleBreakpoint();
 
     void setSmaliData(QSharedPointer<SmaliFile> smalidata) { m_smalidata = smalidata; }
+    SmaliTokenCache* tokenCache() { return m_tokenCache; }
+protected:
+    void fileLoaded() Q_DECL_OVERRIDE;
 private:
     void readBreakMark();
+    int visibleBlockCount() const;
 
 private:
+    // created before the highlighter, see SmaliTokenCache
+    SmaliTokenCache *m_tokenCache;
     SmaliHighlight *m_highlighter;
     QSharedPointer<SmaliFile> m_smalidata;
 
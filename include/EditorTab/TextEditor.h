@@ -9,6 +9,16 @@
 //
 // TextEditor defines the base editor action for text file.
 //
+// A large file is memory mapped and added to the document a chunk of lines
+// at a time, by a line offset index built when it is opened. The lines
+// around the requested line come first, the rest is appended when the event
+// loop is idle. The editor is read only until the whole file is loaded.
+//
+// Text marks are anchored by a QTextCursor at the start of their line. The
+// document moves the cursors with the text, and the line of a cursor is
+// looked up in the block tree, so an edit updates the marks in O(m log n)
+// without walking the blocks.
+//
 //===----------------------------------------------------------------------===//
 
 #ifndef ANDROIDREVERSETOOLKIT_TEXTEDITOR_H
@@ -19,7 +29,9 @@
 #include <Repository>
 #include <Theme>
 
+#include <QFile>
 #include <QPlainTextEdit>
+#include <QTextCursor>
 #include <syntaxhighlighter.h>
 #include <QShortcut>
 #include <QTimer>
@@ -27,7 +39,6 @@
 
 class TextEditorSidebar;
 class TextMark;
-class UserBlockExtraData;
 
 typedef QList<TextMark *> TextMarks;
 
@@ -41,6 +52,8 @@ public:
     virtual bool openFile(const QString &fileName, int iLine = 1);
     virtual bool saveFile();
     virtual bool reload();
+    // a large file is still being added to the document
+    bool isLoading() const { return m_loadData != nullptr; }
 
     void gotoLine (int line,int column = 0,bool centerLine = true);
     int currentLine();
@@ -67,16 +80,38 @@ protected:
     virtual QTextBlock findFoldingRegionEnd(const QTextBlock &startBlock) const;
 
     void readBookMark();
+    // the whole file is in the document, marks can be placed now
+    virtual void fileLoaded();
 
 protected:
     QTimer m_sideBarUpdateTimer;
 private:
     void updateMarksLineNumber();
-    void updateMarksBlock(QTextBlock &block);
+    void updateMarksBlock(const QTextBlock &block);
+    int indexOfMark(TextMark* textMark) const;
+
+    bool openLargeFile(int iLine);
+    void appendLines(int count);
+    void loadNextChunk();
+    void finishLoading();
+
+    // large file being loaded, m_lineOffsets has the start of every line
+    QFile m_loadFile;
+    const uchar* m_loadData = nullptr;
+    qint64 m_loadSize = 0;
+    QVector<qint64> m_lineOffsets;
+    int m_loadedLines = 0;
+    QTimer m_loadTimer;
+
+    struct MarkAnchor {
+        TextMark* m_mark;
+        // at the start of the line of the mark
+        QTextCursor m_cursor;
+    };
+    QList<MarkAnchor> m_marks;
 public:
     QTextBlock blockAtPosition(int y) const;
     QTextBlock blockAtLine(int l) const;
-    UserBlockExtraData* blockData(QTextBlock& block);
     virtual bool isFoldable(const QTextBlock &block) const;
     virtual bool isFolded(const QTextBlock &block) const;
     void toggleFold(const QTextBlock &block);
@@ -104,11 +139,6 @@ protected:
     friend class TextEditor;
 };
 
-class UserBlockExtraData: public QTextBlockUserData {
-public:
-    TextMarks m_marks;
-};
-
 // TextMark is used for marking special block, such for bookmark, breakpoint
 
 
@@ -37,10 +37,13 @@ public slots:
     void onProjectOpened(QStringList args);
     void onProjectClosed ();
     void onFindAdvance(const QString& dir);
+    // search symbols of the whole project
+    void onFindSymbol(const QString& query);
 
     void onNewFind(const QString &subString, const QString &directory,
                    QTextDocument::FindFlags options,
                    bool useRegexp, bool needReplace);
+    void onNewSymbolFind(const QString &query, const QString &directory);
 
 private:
     Ui::FindDialog *ui;
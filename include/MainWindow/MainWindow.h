@@ -108,6 +108,7 @@ protected slots:
     void onProjectOpened(QStringList args);
     void onProjectClosed ();
     void onFindAdvance(QStringList args);
+    void onFindSymbol(QStringList args);
 
     void onOpenWindow(QStringList args);
 
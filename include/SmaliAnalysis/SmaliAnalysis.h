@@ -18,8 +18,11 @@
 
 
 #include "SmaliFile.h"
+#include "SmaliSymbolIndex.h"
+#include "SmaliXrefIndex.h"
 
 #include <QMap>
+#include <QList>
 #include <QObject>
 #include <QDir>
 #include <QSharedPointer>
@@ -28,8 +31,26 @@
 #include <QAbstractItemModel>
 #include <QStandardItemModel>
 #include <QFileSystemWatcher>
+#include <QAtomicInt>
+#include <QSet>
+#include <QThreadPool>
+#include <QTimer>
+#include <QVector>
 
 class SmaliTreeItem;
+class SmaliIndexCache;
+
+// code location resolved to source by SmaliAnalysis::getSourceLocations
+struct SmaliLocation {
+    QString m_classSig;
+    QString m_methodName;
+    QString m_methodSig;
+    int m_codeIdx = -1;
+
+    bool m_hasSource = false;
+    QString m_sourceFile;
+    int m_line = -1;
+};
 
 class SmaliAnalysis : public QStandardItemModel
 {
@@ -44,7 +65,17 @@ public:
     QStringList sources() { return m_sourceDir; }
 
     void addSourcePath(QString source);
+    // read class declarations from apk or dex, for browsing before the
+    // smali files under sourceDir are written. Parsed smali files replace
+    // them.
+    void addDexSource(QString path, QString sourceDir);
     void startFileParseThread(QString path);
+    // queue a changed file to be parsed again. Changes arriving close
+    // together are coalesced and merged into the model at once.
+    void reindexFile(QString path);
+    // replace the data of a file with data an editor parsed when saving it,
+    // the file is not parsed again for the change. Takes ownership.
+    void updateSmaliFile(SmaliFile* filedata);
     void clear();
     // interface for ItemModel
 
@@ -55,9 +86,14 @@ private:
 
 signals:
     void fileAnalysisFinished(const QString &filePath);
+    void analysisProgress(int finished, int total);
 
 private slots:
-    void onFileAnalysisFinished(SmaliFile* file);
+    void onFilesAnalysisFinished(QList<SmaliFile*> files, int generation);
+    void onAnalysisProgress(int finished, int total, int generation);
+    void onSourceAnalysisFinished(int generation);
+    void onReindexTimeout();
+    void onFilesReindexed(QList<SmaliFile*> files, QStringList paths, int generation);
 
 public:
     // get SmaliFile data with full path
@@ -65,6 +101,17 @@ public:
     // get SmaliFile data with signature like Ljava/lang/Object;
     // or java.lang.Object
     QSharedPointer<SmaliFile> getSmaliFileBySig(QString sig);
+    // resolve source file and line of many code locations at once, like the
+    // frames of a thread. Classes and methods are looked up once for all
+    // locations in them.
+    void getSourceLocations(QVector<SmaliLocation> &locations);
+    // find classes, methods and fields by descriptor or name, best match
+    // first. See SmaliSymbolIndex::find for the query syntax.
+    QList<SmaliSymbol> findSymbols(QString query, int limit);
+    // get instructions using a class, method or field descriptor, like
+    // Lcom/foo/Bar;->run()V. Methods called by a method are listed in
+    // SmaliMethod::m_references.
+    QList<SmaliXref> findReferences(QString descriptor);
 
     QStandardItem * findChildByFullPath(QString filepath, bool gen = false);
     QStandardItem * findChild(QStandardItem *parent, QString name, bool gen = false);
@@ -75,14 +122,35 @@ private:
     void addSmaliFileinToMap(SmaliFile* smaliFile);
     bool removeSmaliFileFromMap(QString fileName);
     void removeAllSmaliFile();
+    void saveIndexCache();
 
     typedef QMap<QString, QSharedPointer<SmaliFile>> FileNameDatasMap;
     typedef QMap<QString, FileNameDatasMap *> DirectoryFileDatasMap;
 
     DirectoryFileDatasMap m_filenamesMap;
     QMap<QString, QSharedPointer<SmaliFile>> m_classnamesMap;
+    // rebuilt by the first search after a project or dex load, files
+    // reindexed or saved by an editor update their own symbols only
+    SmaliSymbolIndex m_symbolIndex;
+    bool m_symbolIndexDirty = true;
+    // updated with the maps, so it always matches the loaded files
+    SmaliXrefIndex m_xrefIndex;
 
     QStringList m_sourceDir;
+    // bumped by clear(), results from older analysis threads are dropped
+    int m_generation = 0;
+
+    // class data of the last session, only used while indexing sources
+    QSharedPointer<SmaliIndexCache> m_indexCache;
+    QString m_indexCachePath;
+    bool m_indexCacheDirty = false;
+    int m_pendingSources = 0;
+
+    // changed files waiting for re-parse, only one reindex batch runs at once
+    QSet<QString> m_dirtyFiles;
+    QTimer m_reindexTimer;
+    QThreadPool m_reindexPool;
+    bool m_reindexRunning = false;
 
     QIcon m_dirIcon;
     QIcon m_classIcon;
@@ -96,16 +164,47 @@ class SmaliAnalysisThread: public QThread
 {
 Q_OBJECT
 public:
-    SmaliAnalysisThread(QString path, QObject *parent = Q_NULLPTR);
+    SmaliAnalysisThread(QString path, int generation, QObject *parent = Q_NULLPTR);
+
+    // stop parsing as soon as possible, files already parsed are dropped.
+    void cancel() { m_canceled.store(1); }
+    bool isCanceled() const { return m_canceled.load() != 0; }
+    int generation() const { return m_generation; }
+    void setIndexCache(QSharedPointer<SmaliIndexCache> cache) { m_cache = cache; }
+    // read m_src as apk or dex, smali paths are made under dir
+    void setDexSourceDir(QString dir) { m_dexSourceDir = dir; }
 
 signals:
-    void fileAnalysisFinished(SmaliFile* file);
+    // parsed files are delivered in batches to keep the queued signal count
+    // low while indexing a large project.
+    void filesAnalysisFinished(QList<SmaliFile*> files, int generation);
+    void analysisProgress(int finished, int total, int generation);
 protected:
     void run();
-    void parseFile(QString path);
+    SmaliFile* parseFile(QString path);
     void parseDirectory(QString path);
+    void parseDex();
+
+private:
+    friend class SmaliAnalysisTask;
+    struct WorkRange;
+
+    void runWorker(int self);
+    bool stealWork(int self);
+    void flushBatch(QList<SmaliFile*> &batch);
 private:
     QString m_src;
+    int m_generation;
+    QAtomicInt m_canceled;
+    QSharedPointer<SmaliIndexCache> m_cache;
+    QString m_dexSourceDir;
+
+    // parallel indexer state, valid while parseDirectory is running
+    QStringList m_files;
+    QList<WorkRange*> m_ranges;
+    QAtomicInt m_finished;
 };
 
+Q_DECLARE_METATYPE(SmaliFile*)
+
 #endif //PROJECT_SMALIANALYSIS_H
@@ -0,0 +1,99 @@
+//===- SmaliArena.h - ART-GUI Analysis engine -------------------*- cpp -*-===//
+//
+//                     ANDROID REVERSE TOOLKIT
+//
+// This file is distributed under the GNU GENERAL PUBLIC LICENSE
+// V3 License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// SmaliArena owns the fields and methods of one SmaliFile. They are stored
+// in a few contiguous chunks instead of a heap block each, and are freed
+// together with the file. Members keep their address while the arena lives,
+// so SmaliField and SmaliMethod pointers stay valid like before.
+//
+//===----------------------------------------------------------------------===//
+
+
+#ifndef ANDROIDREVERSETOOLKIT_SMALIARENA_H
+#define ANDROIDREVERSETOOLKIT_SMALIARENA_H
+
+#include "SmaliField.h"
+#include "SmaliMethod.h"
+
+#include <QVector>
+
+#include <utility>
+
+class SmaliArena {
+public:
+    SmaliArena() = default;
+    SmaliArena(const SmaliArena&) = delete;
+    SmaliArena& operator=(const SmaliArena&) = delete;
+
+    SmaliField* newField() { return m_fields.create(); }
+    SmaliMethod* newMethod() { return m_methods.create(); }
+
+    void swap(SmaliArena &other) {
+        m_fields.swap(other.m_fields);
+        m_methods.swap(other.m_methods);
+    }
+
+    // members per chunk at most, for chunks allocated later. 1 allocates
+    // every member on its own, SmaliAnalysis_Bench compares with it.
+    static void setChunkLimit(int members) { chunkLimit() = members; }
+
+private:
+    static int& chunkLimit() {
+        static int limit = 256;
+        return limit;
+    }
+
+    template<typename T>
+    class Pool {
+    public:
+        Pool() = default;
+        Pool(const Pool&) = delete;
+        Pool& operator=(const Pool&) = delete;
+        ~Pool() {
+            for(auto chunk: m_chunks) {
+                delete[] chunk;
+            }
+        }
+
+        T* create() {
+            if(m_used == m_capacity) {
+                // most classes fit the first chunk, big ones take a few
+                if(m_chunks.isEmpty()) {
+                    m_capacity = kFirstChunk;
+                } else {
+                    m_capacity *= 2;
+                }
+                m_capacity = qMin(m_capacity, chunkLimit());
+                m_chunks.push_back(new T[m_capacity]);
+                m_used = 0;
+            }
+            return &m_chunks.last()[m_used++];
+        }
+
+        void swap(Pool &other) {
+            m_chunks.swap(other.m_chunks);
+            std::swap(m_used, other.m_used);
+            std::swap(m_capacity, other.m_capacity);
+        }
+
+    private:
+        static const int kFirstChunk = 8;
+
+        QVector<T*> m_chunks;
+        // slots taken in the last chunk
+        int m_used = 0;
+        int m_capacity = 0;
+    };
+
+    Pool<SmaliField> m_fields;
+    Pool<SmaliMethod> m_methods;
+};
+
+
+#endif //ANDROIDREVERSETOOLKIT_SMALIARENA_H
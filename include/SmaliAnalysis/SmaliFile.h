@@ -7,7 +7,8 @@
 //
 //===----------------------------------------------------------------------===//
 //
-// SmaliFile use SmaliParser to parse .smali file to AST tree.
+// SmaliFile use SmaliScanner to collect .smali file information, and falls
+// back to SmaliParser AST tree for the files it does not handle.
 //
 //===----------------------------------------------------------------------===//
 
@@ -18,17 +19,25 @@
 #include "SmaliLexer.h"
 #include "SmaliParser.h"
 
+#include "SmaliArena.h"
 #include "SmaliField.h"
 #include "SmaliMethod.h"
 
 #include <QVector>
 
+class DexFile;
 class SmaliFileListener;
+class SmaliBench;
+class SmaliIndexCache;
+class SmaliScanner;
 
 class SmaliFile {
 public:
     SmaliFile(const QString& file);
     SmaliFile(const QString& file, const QString &input);
+    // parse tokens of the content just saved to file, for an editor that
+    // has the tokens already. File state is recorded as read from disk.
+    SmaliFile(const QString& file, antlr4::TokenSource &tokens);
     ~SmaliFile();
 
 //    void print();
@@ -40,6 +49,12 @@ public:
     static u4 getAccessFlag(QString flags);
 
     bool isValid() { return m_isValid; }
+    // data restored from SmaliIndexCache instead of parsing source file
+    bool isCached() { return m_cached; }
+    // declarations read from dex, the smali source may not exist yet
+    bool isFromDex() { return m_fromDex; }
+    // source file is not changed since it was parsed
+    bool isUpToDate();
     QString name() { return m_name; }
     int fieldCount() { return m_fields.size(); }
     SmaliField* field(int i) { return i < fieldCount() ? m_fields[i]: nullptr; }
@@ -47,19 +62,41 @@ public:
     int methodCount() { return m_methods.size(); }
     SmaliMethod* method(int i) { return i < methodCount()? m_methods[i]: nullptr; }
     SmaliMethod* method(QString name, QString sig);
+    // method whose .method..end method lines contain line, nullptr if line
+    // is out of any method. Found by binary search of start lines.
+    SmaliMethod* methodAtLine(int line);
 private:
+    // used by SmaliIndexCache to restore cached data
+    SmaliFile() = default;
+    void parse(antlr4::ANTLRInputStream &input);
+    void parse(antlr4::TokenSource &source);
+
     QString m_filepath;
+    // source file state when parsed, -1 if parsed from memory
+    qint64 m_fileSize = -1;
+    qint64 m_fileModified = -1;
+    bool m_cached = false;
+    bool m_fromDex = false;
     bool m_isValid = false;
 
     QString m_name;
-    u4 m_accessflag;
+    u4 m_accessflag = 0;
 
 
+    // members are allocated from m_arena, which also frees them
+    SmaliArena m_arena;
     QVector<SmaliField*> m_fields;
     QVector<SmaliMethod*> m_methods;
+    // methods with source lines sorted by start line, built on first use
+    QVector<SmaliMethod*> m_methodsByLine;
+    bool m_methodsByLineBuilt = false;
 
 
+    friend class DexFile;
+    friend class SmaliBench;
     friend class SmaliFileListener;
+    friend class SmaliIndexCache;
+    friend class SmaliScanner;
 };
 
 
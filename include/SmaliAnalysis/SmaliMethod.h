@@ -27,6 +27,21 @@ struct SmaliInstruction {
     int m_line;
 };
 
+// class, method or field used by an instruction
+struct SmaliReference {
+    enum Kind {
+        Invoke,         // invoke-*
+        FieldRead,      // iget*, sget*
+        FieldWrite,     // iput*, sput*
+        TypeUse,        // const-class, new-instance, check-cast
+    };
+
+    Kind m_kind;
+    // Lcom/foo/Bar;->run()V  Lcom/foo/Bar;->key:I  Lcom/foo/Bar;
+    QString m_target;
+    int m_line;
+};
+
 struct SmaliMethod {
     QString m_name;
     u4 m_accessflag = 0;
@@ -39,8 +54,17 @@ struct SmaliMethod {
     int m_startline = -1;         // defination in source file
     int m_endline = -1;
 
-    QList<SmaliInstruction> m_instructions;
+    // sorted by both code index and line, instructions are added in
+    // source order
+    QVector<SmaliInstruction> m_instructions;
+    // references in method body, in source order
+    QList<SmaliReference> m_references;
+
+    // interned prototype built by buildProto()
+    QString m_proto;
 
+    // (params)ret, built on first use. Params and return type must not
+    // change after it is built.
     QString buildProto();
     QString buildAccessFlag();
     static QString buildAccessFlag(u4 flags);
@@ -55,7 +79,8 @@ struct SmaliMethod {
     int getCodeIdxForSourceLocation(int line);
 
     /**
-     * get the source file location from codeIdx. If failed, -1 is retured
+     * get the source file location from codeIdx, the line of the instruction
+     * codeIdx is in. If failed, -1 is retured
      * @param codeIdx
      * @return
      */
@@ -0,0 +1,90 @@
+//===- SmaliSymbolIndex.h - ART-GUI Analysis engine -------------*- cpp -*-===//
+//
+//                     ANDROID REVERSE TOOLKIT
+//
+// This file is distributed under the GNU GENERAL PUBLIC LICENSE
+// V3 License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// SmaliSymbolIndex keeps every class, method and field of the project in
+// sorted arrays, so a symbol can be found by descriptor or name without
+// reading any source file.
+//
+//===----------------------------------------------------------------------===//
+
+
+#ifndef ANDROIDREVERSETOOLKIT_SMALISYMBOLINDEX_H
+#define ANDROIDREVERSETOOLKIT_SMALISYMBOLINDEX_H
+
+#include "SmaliFile.h"
+
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QSharedPointer>
+#include <QString>
+#include <QVector>
+
+struct SmaliSymbol {
+    enum Kind {
+        Class,
+        Method,
+        Field,
+    };
+
+    Kind m_kind;
+    // Lcom/foo/Bar;  Lcom/foo/Bar;->decrypt(Ljava/lang/String;)V
+    // Lcom/foo/Bar;->key:Ljava/lang/String;
+    QString m_descriptor;
+    // simple name, Bar or decrypt or key
+    QString m_name;
+    QString m_filepath;
+    int m_line;
+};
+
+class SmaliSymbolIndex {
+public:
+    void build(const QList<QSharedPointer<SmaliFile>> &files);
+    // drop the symbols of the removed paths, then add the symbols of files.
+    // A changed file is in both. Symbols of other files are not rebuilt.
+    void update(const QStringList &removed, const QList<SmaliFile*> &files);
+    void clear();
+    int size() const { return m_symbols.size() - m_freeSymbols.size(); }
+
+    /**
+     * find symbols for query, best match first. Query is matched in order
+     * as exact name, name prefix, descriptor prefix, camel case humps of
+     * name (gSK for getSecretKey) and fuzzy subsequence of name. Java style
+     * class name like com.foo.Bar is matched as descriptor.
+     * @param query
+     * @param limit max symbols returned
+     * @return
+     */
+    QList<SmaliSymbol> find(const QString &query, int limit) const;
+
+private:
+    typedef QVector<QPair<QString, int>> SortedKeys;
+
+    void addFile(SmaliFile* file);
+    void addSymbol(SmaliSymbol::Kind kind, const QString &descriptor,
+                   const QString &name, const QString &filepath, int line);
+    // sort the keys from first on into the sorted keys before them
+    static void mergeKeys(SortedKeys &keys, int first);
+    static void findPrefix(const SortedKeys &keys, const QString &prefix,
+                           int rank, QHash<int, qint64> &scores);
+
+    // symbols of a removed file are freed, the free slots have a null
+    // descriptor and are reused by the next symbols added
+    QVector<SmaliSymbol> m_symbols;
+    QVector<int> m_freeSymbols;
+    QHash<QString, QVector<int>> m_fileSymbols;
+    // lower case name of each symbol, for camel case and fuzzy match
+    QVector<QString> m_foldedNames;
+    // lower case descriptors and names with symbol index, sorted
+    SortedKeys m_descriptors;
+    SortedKeys m_names;
+};
+
+
+#endif //ANDROIDREVERSETOOLKIT_SMALISYMBOLINDEX_H
@@ -0,0 +1,69 @@
+//===- SmaliXrefIndex.h - ART-GUI Analysis engine ---------------*- cpp -*-===//
+//
+//                     ANDROID REVERSE TOOLKIT
+//
+// This file is distributed under the GNU GENERAL PUBLIC LICENSE
+// V3 License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// SmaliXrefIndex maps every referenced class, method and field descriptor to
+// the instructions using it, so callers of a method or readers of a field
+// are found without searching source files. The references a method makes
+// are kept in SmaliMethod::m_references.
+//
+//===----------------------------------------------------------------------===//
+
+
+#ifndef ANDROIDREVERSETOOLKIT_SMALIXREFINDEX_H
+#define ANDROIDREVERSETOOLKIT_SMALIXREFINDEX_H
+
+#include "SmaliFile.h"
+
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QVector>
+
+struct SmaliXref {
+    SmaliReference::Kind m_kind;
+    QString m_filepath;
+    // method containing the instruction, Lcom/foo/Bar;->run()V
+    QString m_method;
+    int m_line;
+};
+
+class SmaliXrefIndex {
+public:
+    // add references of file, the file must be removed before deleted.
+    void addFile(SmaliFile* file);
+    void removeFile(SmaliFile* file);
+    void clear();
+
+    /**
+     * get every instruction using descriptor. A class descriptor only
+     * matches const-class, new-instance and check-cast, not its members.
+     * @param descriptor Lcom/foo/Bar;->run()V or Lcom/foo/Bar;->key:I
+     * @return
+     */
+    QList<SmaliXref> references(const QString &descriptor) const;
+
+private:
+    // reference m_reference of method m_method in file
+    struct Site {
+        SmaliFile* m_file;
+        int m_method;
+        int m_reference;
+    };
+
+    int intern(const QString &descriptor);
+
+    // descriptors are stored once, sites refer to them by id
+    QHash<QString, int> m_ids;
+    QVector<QVector<Site>> m_sites;
+    // ids used by each file, so removing a file only visits its targets
+    QHash<SmaliFile*, QVector<int>> m_fileTargets;
+};
+
+
+#endif //ANDROIDREVERSETOOLKIT_SMALIXREFINDEX_H
@@ -51,6 +51,7 @@ public:
     QString getSourcePath();
     QString getBuildPath();
     QString getConfigPath();
+    QString getIndexCachePath();
 
 private:
     ProjectInfo(QString name);
@@ -84,6 +84,10 @@ signals:
     void gotoLine(QStringList);
     // FindAdvance()
     void findAdvance(QStringList);
+    // FindSymbol(query)   class, method or field by descriptor or name
+    void findSymbol(QStringList);
+    // LoadDex(apk, sourceDir)   read classes before apktool finished
+    void loadDex(QStringList);
 
     // project build, install, run, debug, stop
     // Build()      build and signed apk
@@ -0,0 +1,61 @@
+//===- StringPool.h - ART-GUI utilpart --------------------------*- C++ -*-===//
+//
+//                     ANDROID REVERSE TOOLKIT
+//
+// This file is distributed under the GNU GENERAL PUBLIC LICENSE
+// V3 License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// StringPool interns strings repeated all over the analysis model, like type
+// descriptors and member names. Equal strings interned share one buffer, so
+// Ljava/lang/String; is stored once however many fields and methods use it,
+// and pooled strings compare by pointer first.
+//
+// The pool is split into shards with a lock each, so analysis threads
+// interning at once rarely wait for each other.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef ANDROIDREVERSETOOLKIT_STRINGPOOL_H
+#define ANDROIDREVERSETOOLKIT_STRINGPOOL_H
+
+#include <QMutex>
+#include <QSet>
+#include <QString>
+
+class StringPool {
+public:
+    static StringPool* instance();
+
+    // pooled string equal to str, sharing its data with every other string
+    // interned with the same content
+    QString intern(const QString &str);
+    QString intern(const char* utf8, int size);
+
+    // compare strings, pooled strings are equal when they share data
+    static bool equal(const QString &a, const QString &b) {
+        return a.isSharedWith(b) || a == b;
+    }
+
+    // drop strings no one but the pool holds any more
+    void squeeze();
+    int size();
+
+private:
+    StringPool() = default;
+    StringPool(const StringPool&) = delete;
+    StringPool& operator=(const StringPool&) = delete;
+
+    static const int kShardCount = 16;
+
+    struct Shard {
+        QMutex m_lock;
+        QSet<QString> m_strings;
+    };
+
+    Shard m_shards[kShardCount];
+};
+
+
+#endif //ANDROIDREVERSETOOLKIT_STRINGPOOL_H
@@ -12,6 +12,7 @@
 #include "FrameListView.h"
 #include "VariableTreeView.h"
 
+#include <BreakPoint/BreakPointManager.h>
 #include <SmaliAnalysis/SmaliAnalysis.h>
 
 #include <utils/ProjectInfo.h>
@@ -23,9 +24,12 @@
 #include <QDebug>
 #include <QTimer>
 
+// requests waiting for reply at once. The VM handles them in order, the
+// window only bounds a burst like the frames of a deep stack.
+static const int kDefaultRequestsInFlight = 32;
 
 DebugHandler::DebugHandler(QObject *parent, DebugSocket* socket)
-        : QObject(parent), mDebugStatus(NotActive)
+        : QObject(parent), mMaxRequestsInFlight(kDefaultRequestsInFlight), mDebugStatus(NotActive)
 {
     mSocket = socket;
 
@@ -43,8 +47,6 @@ DebugHandler::DebugHandler(QObject *parent, DebugSocket* socket)
 
     connect(FrameListView::instance(), &FrameListView::frameItemClicked, this, &DebugHandler::dumpFrameInfo);
 
-
-    mCommandVector.resize(CommandPackage::EventGroup::Unknown + 1);
 }
 
 DebugHandler::~DebugHandler()
@@ -55,7 +57,11 @@ DebugHandler::~DebugHandler()
 
 void DebugHandler::onJDWPRequest (QByteArray data)
 {
-    JDWP::Request request((uint8_t*)data.data(), data.length());
+    if(mCapture.isOpen()) {
+        capturePackets('<', data);
+    }
+    // the request and its reply payload are views of data
+    JDWP::Request request((const uint8_t*)data.constData(), data.length());
     if(request.isReply ()) {
         handleReply (request);
     } else {
@@ -71,10 +77,27 @@ void DebugHandler::handleReply (JDWP::Request &reply)
     if(it == mRequestMap.end ()) {
         return;
     }
-    auto request = it->data ();
+    // callbacks may send new requests, the map is changed before them
+    auto request = it.value();
+    mRequestMap.erase (it);
+    mRequestsInFlight--;
+    if(request->mShared) {
+        mTypeQueries.remove(qMakePair((int)request->mRequest.GetCommand(), request->mQueryTypeId));
+    }
+
     auto array = reply.GetExtraArray();
+    // requests sent by the reply callbacks belong to the groups of this one
+    auto depth = mRequestGroups.size();
+    mRequestGroups += request->mGroups;
     request->handleReply(array);
-    mRequestMap.erase (it);
+    mRequestGroups.resize(depth);
+
+    for(auto &group: request->mGroups) {
+        if(--group->mPending == 0 && group->mClosed) {
+            group->mCallback();
+        }
+    }
+    sendWaitingRequests();
 }
 
 void DebugHandler::handleCommand (JDWP::Request &request)
@@ -121,15 +144,15 @@ void DebugHandler::handleCommand (JDWP::Request &request)
                 info.mStatus = event->mStatus;
                 info.mTypeId = event->mTypeId;
                 info.mRefTypeTag = event->mTag;
-                if(!mLoadedClassInfo.contains(info.mTypeId)) {
-                    mLoadedClassRef.insert(info.mDescriptor, info.mTypeId);
-                }
-                mLoadedClassInfo[info.mTypeId] = info;
+                recordClassInfo(info);
+            }
+                break;
+            case JDWP::JdwpEventKind::EK_CLASS_UNLOAD: {
+                auto event = (JDWP::Composite::ReflectedType::EventClassUnload*)pevent;
+                qDebug() << "EventClassUnload" << event->mSignature;
+                removeClassInfo(event->mSignature);
             }
                 break;
-//            case JdwpEventKind::EK_CLASS_UNLOAD:
-//                Q_ASSERT(false);
-//                break;
 //            case JdwpEventKind::EK_CLASS_LOAD:
 //                Q_ASSERT(false);
 //                break;
@@ -175,16 +198,23 @@ void DebugHandler::handleCommand (JDWP::Request &request)
                 break;
         }
 
-        // find group matching
-        auto group = CommandPackage::getEventGroup(eventKind);
-        auto &commands = mCommandVector[group];
-        for(auto it = commands.begin(); it != commands.end(); ) {
-            auto command = it->data();
+        // the command waiting for the request of this event
+        auto command = mCommandPackages.value(pevent->mRequestId);
+        if(!command.isNull()) {
             command->match(pevent, composite.mSuspendPolicy);
             if(command->clear) {
-                it = commands.erase(it);
-            } else {
-                it ++;
+                mCommandPackages.remove(pevent->mRequestId);
+            }
+        } else if(eventKind == JDWP::JdwpEventKind::EK_CLASS_PREPARE) {
+            // the event may be written before the reply of its request,
+            // the commands waiting for that reply are matched by class
+            for(auto i = 0; i < mPendingCommands.size(); i++) {
+                if(mPendingCommands.at(i)->match(pevent, composite.mSuspendPolicy)) {
+                    if(mPendingCommands.at(i)->clear) {
+                        mPendingCommands.remove(i);
+                    }
+                    break;
+                }
             }
         }
     }
@@ -193,10 +223,123 @@ void DebugHandler::handleCommand (JDWP::Request &request)
 bool DebugHandler::sendNewRequest (QSharedPointer<ReqestPackage>& req)
 {
     mRequestMap[req->mRequest.GetId ()] = req;
-    sendBuffer (req->mData);
+    joinRequestGroup(req);
+    mWaitingRequests.enqueue(req);
+    sendWaitingRequests();
     return true;
 }
 
+void DebugHandler::joinRequestGroup(QSharedPointer<ReqestPackage> &req)
+{
+    for(auto &group: mRequestGroups) {
+        if(req->mGroups.contains(group)) {
+            continue;
+        }
+        req->mGroups.push_back(group);
+        group->mPending++;
+    }
+}
+
+void DebugHandler::sendWaitingRequests()
+{
+    while(mRequestsInFlight < mMaxRequestsInFlight && !mWaitingRequests.isEmpty()) {
+        auto req = mWaitingRequests.dequeue();
+        mSendBuffer.append(req->mData);
+        mRequestsInFlight++;
+    }
+    if(!mSendBuffer.isEmpty() && !mSendScheduled) {
+        mSendScheduled = true;
+        QTimer::singleShot(0, this, [this]() {
+            flushSendBuffer();
+        });
+    }
+}
+
+void DebugHandler::flushSendBuffer()
+{
+    mSendScheduled = false;
+    if(mSendBuffer.isEmpty()) {
+        return;
+    }
+    if(mCapture.isOpen()) {
+        capturePackets('>', mSendBuffer);
+    }
+    sendBuffer(mSendBuffer);
+    mSendBuffer.clear();
+}
+
+void DebugHandler::capturePackets(char direction, const QByteArray &data)
+{
+    auto* bytes = (const uint8_t*)data.constData();
+    uint32_t pos = 0;
+    while(auto length = JDWP::Request::GetPackageLength(bytes + pos, data.size() - pos)) {
+        mCapture.putChar(direction);
+        mCapture.write(data.constData() + pos, length);
+        pos += length;
+    }
+}
+
+void DebugHandler::resetRequests()
+{
+    mRequestMap.clear ();
+    mRequestsInFlight = 0;
+    mWaitingRequests.clear();
+    mSendBuffer.clear();
+    mRequestGroups.clear();
+    mTypeQueries.clear();
+    mClassesLoaded = false;
+    mClassLookups.clear();
+}
+
+void DebugHandler::setMaxRequestsInFlight(int count)
+{
+    mMaxRequestsInFlight = qMax(count, 1);
+    sendWaitingRequests();
+}
+
+void DebugHandler::beginRequestGroup()
+{
+    mRequestGroups.push_back(QSharedPointer<RequestGroup>::create());
+}
+
+template <typename Func>
+void DebugHandler::endRequestGroup(Func callback)
+{
+    if(mRequestGroups.isEmpty()) {
+        callback();
+        return;
+    }
+    auto group = mRequestGroups.takeLast();
+    if(mRequestGroups.isEmpty()) {
+        // the group boundary batches the writes already
+        flushSendBuffer();
+    }
+    if(group->mPending == 0) {
+        callback();
+        return;
+    }
+    group->mClosed = true;
+    group->mCallback = callback;
+}
+
+QSharedPointer<ReqestPackage> DebugHandler::typeQuery(int command, JDWP::RefTypeId refTypeId)
+{
+    auto req = mTypeQueries.value(qMakePair(command, refTypeId));
+    if(!req.isNull()) {
+        // the open group waits for the query too
+        joinRequestGroup(req);
+    }
+    return req;
+}
+
+void DebugHandler::sendTypeQuery(QSharedPointer<ReqestPackage> &req, JDWP::RefTypeId refTypeId)
+{
+    req->mShared = true;
+    req->mQueryTypeId = refTypeId;
+    mTypeQueries.insert(qMakePair((int)req->mRequest.GetCommand(), refTypeId), req);
+    sendNewRequest(req);
+}
+
 void DebugHandler::onSocketError(int error, const QString &message)
 {
     qDebug() << "Socket error code : " << error << " msg: " << message;
@@ -207,16 +350,25 @@ void DebugHandler::onSocketConnected()
     cmdmsg()->addCmdMsg("DebugHandler connect to " + mSocket->hostName () + ":" +
                         QString::number(mSocket->port ()));
     mSockId = 1;
-    mRequestMap.clear ();
+    resetRequests();
     mDebugStatus = Active;
 
+    auto capture = qgetenv("ART_JDWP_CAPTURE");
+    if(!capture.isEmpty()) {
+        mCapture.close();
+        mCapture.setFileName(QString::fromLocal8Bit(capture));
+        mCapture.open(QFile::WriteOnly | QFile::Truncate);
+    }
+
     // Init
-    // get all loaded class information
-    dbgVirtualMachineAllClassesWithGeneric();
+    // watch class prepare and unload before the class list is taken, a class
+    // loaded in between is then reported by an event instead of missed.
     dbgEventRequestSet(JDWP::JdwpEventKind::EK_CLASS_PREPARE, JDWP::JdwpSuspendPolicy::SP_NONE, std::vector<JDWP::JdwpEventMod>(),
                        [this](JDWP::JdwpEventKind eventkind, uint32_t requestId) {});
     dbgEventRequestSet(JDWP::JdwpEventKind::EK_CLASS_UNLOAD, JDWP::JdwpSuspendPolicy::SP_NONE, std::vector<JDWP::JdwpEventMod>(),
                        [this](JDWP::JdwpEventKind eventkind, uint32_t requestId) {});
+    // get all loaded class information
+    dbgVirtualMachineAllClassesWithGeneric();
     // suspend and set breakpoiont to catch exception
 //    {
 //        std::vector<JDWP::JdwpEventMod> mod;
@@ -235,23 +387,53 @@ void DebugHandler::onSocketConnected()
 //        dbgEventRequestSet(JDWP::JdwpEventKind::EK_CLASS_PREPARE, JDWP::JdwpSuspendPolicy::SP_ALL, mod,
 //                           [this](JDWP::JdwpEventKind eventkind, uint32_t requestId) {});
 //    }
-    // suspend and set breakpoint to process entry point
-    stopOnProcessEntryPoint();
-    setAllBreakpoint();
+    // suspend and set breakpoint to process entry point, the VM is resumed
+    // once it and the project breakpoints are set
+    auto pending = QSharedPointer<int>::create(2);
+    auto resume = [this, pending]() {
+        if(--*pending == 0) {
+            dbgVirtualMachineResume();
+        }
+    };
+    stopOnProcessEntryPoint(resume);
+    setAllBreakpoint(resume);
 }
 
 void DebugHandler::onSocketDisconnected()
 {
     cmdmsg()->addCmdMsg("DebugHandler disconnected");
+    mCapture.close();
     mSockId = 1;
-    mRequestMap.clear ();
-    for(auto & command: mCommandVector) {
-        command.clear();
-    }
+    resetRequests();
+    mCommandPackages.clear();
+    mPendingCommands.clear();
     mLoadedClassRef.clear();
     mLoadedClassInfo.clear();
     mLoadedMethodsInfo.clear();
     mLoadedFieldsInfo.clear();
+    mUnloadedClassRef.clear();
+}
+
+void DebugHandler::recordClassInfo(const JDWP::ClassInfo &info)
+{
+    if(!mLoadedClassInfo.contains(info.mTypeId)) {
+        mLoadedClassRef.insert(info.mDescriptor, info.mTypeId);
+    }
+    mLoadedClassInfo[info.mTypeId] = info;
+    mUnloadedClassRef.remove(info.mDescriptor);
+}
+
+void DebugHandler::removeClassInfo(const QString &classSignature)
+{
+    // the event has no type id, forget every class of the signature. Those
+    // still loaded by other class loaders are asked for again when needed.
+    for(auto id: mLoadedClassRef.values(classSignature)) {
+        mLoadedClassInfo.remove(id);
+        mLoadedMethodsInfo.remove(id);
+        mLoadedFieldsInfo.remove(id);
+    }
+    mLoadedClassRef.remove(classSignature);
+    mUnloadedClassRef.insert(classSignature);
 }
 
 // -------------------for debug interface----------------------
@@ -260,11 +442,63 @@ void DebugHandler::dbgSetBreakPoint(const QString &classSignature,
                                     const QString &methodName,
                                     const QString &methodSign, uint64_t codeIdx)
 {
-    QSharedPointer<RequestExtraBreakPoint> extra(new RequestExtraBreakPoint(
-            classSignature, methodName, methodSign, codeIdx));
-    dbgGetClassBySignature(classSignature, [this, extra](JDWP::ClassInfo classinfo) {
-        dbgReferenctTypeMethodsWithGeneric(classinfo.mTypeId, [this, extra, classinfo]
-                (QVector<JDWP::MethodInfo> methods) {
+    BreakPointList breakpoints;
+    breakpoints.push_back(QSharedPointer<RequestExtraBreakPoint>(new RequestExtraBreakPoint(
+            classSignature, methodName, methodSign, codeIdx)));
+    setClassBreakpoints(classSignature, breakpoints);
+}
+
+void DebugHandler::setClassBreakpoints(const QString &classSignature,
+                                       const BreakPointList &breakpoints)
+{
+    if(!mClassesLoaded) {
+        // set once the class list tells whether the class is loaded
+        mClassLookups.push_back([this, classSignature, breakpoints]() {
+            setClassBreakpoints(classSignature, breakpoints);
+        });
+        return;
+    }
+    if(mLoadedClassRef.contains(classSignature)) {
+        // every class loader defining the class has its own copy
+        for(auto id: mLoadedClassRef.values(classSignature)) {
+            installBreakpoints(id, breakpoints, nullptr);
+        }
+        return;
+    }
+    if(mUnloadedClassRef.contains(classSignature)) {
+        // unloaded once, other class loaders may still have it. The reply
+        // caches those, or tells that no class loader has it.
+        dbgVirtualMachineClassesBySignature(classSignature, [this, classSignature, breakpoints]
+                (std::vector<JDWP::ClassInfo> &infos) {
+            setClassBreakpoints(classSignature, breakpoints);
+        });
+        return;
+    }
+    // one class prepare request for all breakpoints of the class
+    waitForClassPrepared(classSignature, [this, breakpoints]
+            (JDWP::Composite::ReflectedType::EventClassPrepare* prepare) {
+        if(prepare->mThreadId == 0) {
+            // answered from the class cache, nothing holds the VM
+            installBreakpoints(prepare->mTypeId, breakpoints, nullptr);
+            return;
+        }
+        // the prepare event holds the VM until the breakpoints are set
+        installBreakpoints(prepare->mTypeId, breakpoints, [this]() {
+            dbgVirtualMachineResume();
+        });
+    });
+}
+
+void DebugHandler::installBreakpoints(JDWP::RefTypeId refTypeId,
+                                      const BreakPointList &breakpoints,
+                                      std::function<void()> done)
+{
+    // the method query and the breakpoint requests sent on its reply are
+    // one group, it completes even if the class has no method.
+    beginRequestGroup();
+    dbgReferenctTypeMethodsWithGeneric(refTypeId, [this, refTypeId, breakpoints]
+            (QVector<JDWP::MethodInfo> methods) {
+        for(auto &extra: breakpoints) {
             for (auto &method: methods) {
                 if (method.mName != extra->mMethodName ||
                     method.mSignature != extra->mMethodSign) {
@@ -277,7 +511,7 @@ void DebugHandler::dbgSetBreakPoint(const QString &classSignature,
                 bpMod.modKind = JDWP::MK_LOCATION_ONLY;
                 bpMod.locationOnly.loc = JDWP::JdwpLocation{
                         JDWP::TT_CLASS,
-                        classinfo.mTypeId,
+                        refTypeId,
                         method.mMethodId,
                         extra->mCodeIdx};
                 mod.push_back(bpMod);
@@ -288,7 +522,12 @@ void DebugHandler::dbgSetBreakPoint(const QString &classSignature,
                 });
                 break;
             }
-        });
+        }
+    });
+    endRequestGroup([done]() {
+        if(done) {
+            done();
+        }
     });
 }
 
@@ -310,17 +549,51 @@ void DebugHandler::waitForClassPrepared(QString javaSignature, Func callback) {
 
     JDWP::JdwpEventModPad modPad(mMatch);
 
+    auto package = QSharedPointer<CommandPackage>(new CommandPackage(modPad, JDWP::JdwpSuspendPolicy::SP_ALL));
+    auto command = package.data();
+    connect(command, &CommandPackage::onClassPrepare,
+            [this, command, callback](JDWP::Composite::ReflectedType::EventClassPrepare* prepare, JDWP::JdwpSuspendPolicy  policy, bool *clear) {
+                // classInfo has been recorded in DebugHandler::handleCommand
+                if(command->mRequestId != 0) {
+                    dbgEventRequestClear(JDWP::JdwpEventKind::EK_CLASS_PREPARE, command->mRequestId);
+                }
+                callback(prepare);
+                *clear = true;
+            });
+    // the VM may write the event before the reply, the command is matched by
+    // class until the request id is known
+    mPendingCommands.push_back(package);
+
     dbgEventRequestSet(JDWP::JdwpEventKind::EK_CLASS_PREPARE, JDWP::JdwpSuspendPolicy::SP_ALL, mod,
-                       [this, modPad, callback](JDWP::JdwpEventKind eventkind, uint32_t requestId) {
-                           auto package = QSharedPointer<CommandPackage>(new CommandPackage(modPad, JDWP::JdwpSuspendPolicy::SP_ALL));
-                           connect(package.data(), &CommandPackage::onClassPrepare,
-                                   [this, requestId, callback](JDWP::Composite::ReflectedType::EventClassPrepare* prepare, JDWP::JdwpSuspendPolicy  policy, bool *clear) {
-                                       // classInfo has been recorded in DebugHandler::handleCommand
-                                       dbgEventRequestClear(JDWP::JdwpEventKind::EK_CLASS_PREPARE, requestId);
-                                       callback(prepare);
-                                       *clear = true;
-                                   });
-                           setCommandPackage(eventkind, package);
+                       [this, javaSignature, package, callback](JDWP::JdwpEventKind eventkind, uint32_t requestId) {
+                           auto pending = package;
+                           mPendingCommands.removeOne(pending);
+                           pending->mRequestId = requestId;
+                           if(pending->clear) {
+                               // matched before this reply
+                               dbgEventRequestClear(JDWP::JdwpEventKind::EK_CLASS_PREPARE, requestId);
+                               return;
+                           }
+                           setCommandPackage(requestId, pending);
+
+                           // a class known by now but not matched was prepared
+                           // before the request was set, and never matches it.
+                           // Nothing holds the VM for it.
+                           if(mLoadedClassRef.contains(javaSignature)) {
+                               auto id = mLoadedClassRef.value(javaSignature);
+                               auto &info = mLoadedClassInfo[id];
+                               JDWP::Composite::ReflectedType::EventClassPrepare prepare;
+                               prepare.mEventKind = JDWP::JdwpEventKind::EK_CLASS_PREPARE;
+                               prepare.mRequestId = requestId;
+                               prepare.mThreadId = 0;
+                               prepare.mTag = (JDWP::JdwpTag)info.mRefTypeTag;
+                               prepare.mTypeId = id;
+                               prepare.mSignature = info.mDescriptor;
+                               prepare.mStatus = info.mStatus;
+                               mCommandPackages.remove(requestId);
+                               dbgEventRequestClear(JDWP::JdwpEventKind::EK_CLASS_PREPARE, requestId);
+                               callback(&prepare);
+                           }
                        });
 }
 
@@ -339,38 +612,66 @@ void DebugHandler::dbgVirtualMachineVersion() {
 template <typename Func>
 void DebugHandler::dbgGetClassBySignature(const QString &classSignature,
                                           Func callback) {
+    if(!mClassesLoaded) {
+        // answered from the class list once it is loaded
+        mClassLookups.push_back([this, classSignature, callback]() {
+            dbgGetClassBySignature(classSignature, callback);
+        });
+        return;
+    }
     if(mLoadedClassRef.contains(classSignature)) {
         auto id = mLoadedClassRef.value(classSignature);
         callback(mLoadedClassInfo[id]);
         return;
     }
+    if(!mUnloadedClassRef.contains(classSignature)) {
+        // the class list and the prepare events know every loaded class, it
+        // has not been loaded yet.
+        waitForClassPrepared(classSignature,
+                             [this, callback](JDWP::Composite::ReflectedType::EventClassPrepare* prepare) {
+                                 callback(mLoadedClassInfo[prepare->mTypeId]);
+                             });
+        return;
+    }
 
+    // unloaded once, other class loaders may still have it
+    dbgVirtualMachineClassesBySignature(classSignature, [this, classSignature, callback]
+            (std::vector<JDWP::ClassInfo> &infos) {
+        if(infos.empty()) {
+            // class has not been loaded, need to wait for loading.
+            waitForClassPrepared(classSignature,
+                                 [this, callback](JDWP::Composite::ReflectedType::EventClassPrepare* prepare) {
+                                     callback(mLoadedClassInfo[prepare->mTypeId]);
+                                 });
+            return;
+        }
+        auto info = infos.front();
+        if(info.mTypeId == 0) {
+            return;
+        }
+        callback(info);
+    });
+}
+
+template <typename Func>
+void DebugHandler::dbgVirtualMachineClassesBySignature(const QString &classSignature,
+                                                       Func callback) {
     auto request = JDWP::VirtualMachine::ClassesBySignature::buildReq(classSignature.toLocal8Bit(), mSockId++);
     auto package = QSharedPointer<ReqestPackage>(new ReqestPackage(request));
     connect(package.data(), &ReqestPackage::onReply,
             [this, classSignature, callback](JDWP::Request *request,QByteArray& reply) {
                 JDWP::VirtualMachine::ClassesBySignature signature((uint8_t*)reply.data(), reply.length());
                 if(signature.mSize == 0) {
-                    // class has not been loaded, need to wait for loading.
-                    waitForClassPrepared(classSignature,
-                                         [this, callback](JDWP::Composite::ReflectedType::EventClassPrepare* prepare) {
-                                             callback(mLoadedClassInfo[prepare->mTypeId]);
-                                         });
-                    return;
+                    // no class loader has it, the prepare events report it again
+                    mUnloadedClassRef.remove(classSignature);
+                    signature.mInfos.clear();
                 }
                 for(auto& info: signature.mInfos) {
                     // Record classinfo
-                    if(!mLoadedClassInfo.contains(info.mTypeId)) {
-                        mLoadedClassRef.insert(info.mDescriptor, info.mTypeId);
-                    }
                     info.mDescriptor = classSignature.toLatin1();
-                    mLoadedClassInfo[info.mTypeId] = info;
-                }
-                auto info = signature.mInfos.front();
-                if(info.mTypeId == 0) {
-                    return;
+                    recordClassInfo(info);
                 }
-                callback(info);
+                callback(signature.mInfos);
             });
     sendNewRequest (package);
 }
@@ -390,19 +691,18 @@ void DebugHandler::dbgVirtualMachineAllClassesWithGeneric() {
     auto request = JDWP::VirtualMachine::AllClassesWithGeneric::buildReq (mSockId++);
     auto package = QSharedPointer<ReqestPackage>(new ReqestPackage(request));
     connect(package.data(), &ReqestPackage::onReply, [this](JDWP::Request *request,QByteArray& reply) {
-        qDebug() << "VirtualMachine::AllClassesWithGeneric: ";
         JDWP::VirtualMachine::AllClassesWithGeneric signature((uint8_t*)reply.data(), reply.length());
+        qDebug() << "VirtualMachine::AllClassesWithGeneric: " << signature.mInfos.size() << "classes";
+        mLoadedClassInfo.reserve(mLoadedClassInfo.size() + (int)signature.mInfos.size());
         for(auto& info: signature.mInfos) {
-            qDebug() << "RefTypeTag" << info.mRefTypeTag
-                     << "RefTypeId" << info.mTypeId
-                     << "Descriptor" << info.mDescriptor
-                     << "GenericSignature" << info.mGenericSignature
-                     << "Status" << info.mStatus;
             // Record classinfo
-            if(!mLoadedClassInfo.contains(info.mTypeId)) {
-                mLoadedClassRef.insert(info.mDescriptor, info.mTypeId);
-            }
-            mLoadedClassInfo[info.mTypeId] = info;
+            recordClassInfo(info);
+        }
+        mClassesLoaded = true;
+        QVector<std::function<void()>> lookups;
+        lookups.swap(mClassLookups);
+        for(auto &lookup: lookups) {
+            lookup();
         }
     });
     sendNewRequest (package);
@@ -435,13 +735,24 @@ void DebugHandler::dbgReferenceTypeClassObject(JDWP::RefTypeId refTypeId, Func c
 
 template <typename Func>
 void DebugHandler::dbgReferenceTypeSignatureWithGeneric(JDWP::RefTypeId refTypeId, Func callback) {
-    auto request = JDWP::ReferenceType::SignatureWithGeneric::buildReq(refTypeId, mSockId++);
-    auto package = QSharedPointer<ReqestPackage>(new ReqestPackage(request));
+    auto it = mLoadedClassInfo.constFind(refTypeId);
+    if(it != mLoadedClassInfo.constEnd() && !it->mDescriptor.isEmpty()) {
+        callback(it->mDescriptor, it->mGenericSignature);
+        return;
+    }
+    auto package = typeQuery((int)JDWP::ReferenceType::SignatureWithGeneric::cmd, refTypeId);
+    auto inFlight = !package.isNull();
+    if(!inFlight) {
+        auto request = JDWP::ReferenceType::SignatureWithGeneric::buildReq(refTypeId, mSockId++);
+        package = QSharedPointer<ReqestPackage>(new ReqestPackage(request));
+    }
     connect(package.data(), &ReqestPackage::onReply, [this, refTypeId, callback](JDWP::Request *request,QByteArray& reply) {
         JDWP::ReferenceType::SignatureWithGeneric signature((uint8_t*)reply.data(), reply.length());
         callback(signature.mSignature, signature.mSignatureGeneric);
     });
-    sendNewRequest (package);
+    if(!inFlight) {
+        sendTypeQuery(package, refTypeId);
+    }
 }
 
 template<typename Func>
@@ -452,8 +763,20 @@ void DebugHandler::dbgReferenceTypeFieldsWithGeneric(JDWP::RefTypeId refTypeId,
         return;
     }
 
+    auto package = typeQuery((int)JDWP::ReferenceType::FieldsWithGeneric::cmd, refTypeId);
+    if(!package.isNull()) {
+        // the first caller caches the fields
+        connect(package.data(), &ReqestPackage::onReply, [this, refTypeId, callback]
+                (JDWP::Request *request,QByteArray& reply) {
+            if(mLoadedFieldsInfo.contains(refTypeId)) {
+                callback(mLoadedFieldsInfo[refTypeId]);
+            }
+        });
+        return;
+    }
+
     auto request = JDWP::ReferenceType::FieldsWithGeneric::buildReq(refTypeId, mSockId++);
-    auto package = QSharedPointer<ReqestPackage>(new ReqestPackage(request));
+    package = QSharedPointer<ReqestPackage>(new ReqestPackage(request));
     connect(package.data(), &ReqestPackage::onReply, [this, refTypeId, callback]
             (JDWP::Request *request,QByteArray& reply) {
         JDWP::ReferenceType::FieldsWithGeneric signature((uint8_t*)reply.data(), reply.length());;
@@ -463,7 +786,7 @@ void DebugHandler::dbgReferenceTypeFieldsWithGeneric(JDWP::RefTypeId refTypeId,
         mLoadedFieldsInfo[refTypeId] = signature.mFields;
         callback(signature.mFields);
     });
-    sendNewRequest (package);
+    sendTypeQuery(package, refTypeId);
 }
 
 template  <typename Func>
@@ -474,8 +797,20 @@ void DebugHandler::dbgReferenctTypeMethodsWithGeneric(JDWP::RefTypeId refTypeId,
         return;
     }
 
+    auto package = typeQuery((int)JDWP::ReferenceType::MethodsWithGeneric::cmd, refTypeId);
+    if(!package.isNull()) {
+        // the first caller caches the methods
+        connect(package.data(), &ReqestPackage::onReply, [this, refTypeId, callback]
+                (JDWP::Request *request,QByteArray& reply) {
+            if(mLoadedMethodsInfo.contains(refTypeId)) {
+                callback(mLoadedMethodsInfo[refTypeId]);
+            }
+        });
+        return;
+    }
+
     auto request = JDWP::ReferenceType::MethodsWithGeneric::buildReq(refTypeId, mSockId++);
-    auto package = QSharedPointer<ReqestPackage>(new ReqestPackage(request));
+    package = QSharedPointer<ReqestPackage>(new ReqestPackage(request));
     connect(package.data(), &ReqestPackage::onReply, [this, refTypeId, callback](JDWP::Request *request,QByteArray& reply) {
         JDWP::ReferenceType::MethodsWithGeneric signature((uint8_t*)reply.data(), reply.length());;
         if(signature.mSize == 0) {
@@ -484,7 +819,7 @@ void DebugHandler::dbgReferenctTypeMethodsWithGeneric(JDWP::RefTypeId refTypeId,
         mLoadedMethodsInfo[refTypeId] = signature.mMethods;
         callback(signature.mMethods);
     });
-    sendNewRequest (package);
+    sendTypeQuery(package, refTypeId);
 }
 
 template<typename Func>
@@ -601,11 +936,9 @@ void DebugHandler::dbgEventRequestClear(JDWP::JdwpEventKind kind, uint32_t reque
 }
 
 
-void DebugHandler::setCommandPackage(JDWP::JdwpEventKind eventkind, QSharedPointer<CommandPackage>& package)
+void DebugHandler::setCommandPackage(uint32_t requestId, QSharedPointer<CommandPackage>& package)
 {
-    auto group = CommandPackage::getEventGroup(eventkind);
-    auto &commands = mCommandVector[group];
-    commands.push_back(package);
+    mCommandPackages.insert(requestId, package);
 }
 
 void DebugHandler::breakPointHit(JDWP::JdwpSuspendPolicy  policy,
@@ -635,7 +968,7 @@ void DebugHandler::breakPointHit(JDWP::JdwpSuspendPolicy  policy,
 //    });
 }
 
-void DebugHandler::stopOnProcessEntryPoint() {
+void DebugHandler::stopOnProcessEntryPoint(std::function<void()> resume) {
     auto config = ProjectInfo::current();
     QString className, methodName, methodSig;
     bool found = false;
@@ -675,23 +1008,57 @@ void DebugHandler::stopOnProcessEntryPoint() {
         }
     }
     if(found) {
-        waitForClassPrepared(className, [this, className, methodName, methodSig](JDWP::Composite::ReflectedType::EventClassPrepare* prepare) {
-            dbgSetBreakPoint(className, methodName, methodSig, 0);
-            QTimer::singleShot(1000, [this]() {
-                // wait for classloading finished and breakpoint set
-                dbgVirtualMachineResume();
-            });
+        BreakPointList breakpoints;
+        breakpoints.push_back(QSharedPointer<RequestExtraBreakPoint>(new RequestExtraBreakPoint(
+                className, methodName, methodSig, 0)));
+        waitForClassPrepared(className, [this, breakpoints, resume](JDWP::Composite::ReflectedType::EventClassPrepare* prepare) {
+            installBreakpoints(prepare->mTypeId, breakpoints, resume);
         });
     } else {
-        QTimer::singleShot(1000, [this]() {
+        QTimer::singleShot(1000, [resume]() {
             // wait for classloading finished and breakpoint set
-            dbgVirtualMachineResume();
+            resume();
         });
     }
 }
 
-void DebugHandler::setAllBreakpoint() {
+void DebugHandler::setAllBreakpoint(std::function<void()> done) {
+    // breakpoints are grouped by class, a class shares one class prepare
+    // request and has its breakpoints set together
+    QHash<QString, BreakPointList> classBreakpoints;
+    for(auto breakpoint: BreakPointManager::instance()->getAllBreakPoints()) {
+        auto filedata = SmaliAnalysis::instance()->getSmaliFile(breakpoint->fileName());
+        if(filedata.isNull()) {
+            continue;
+        }
+        auto line = breakpoint->lineNumber();
+        auto method = filedata->methodAtLine(line);
+        if(method == nullptr) {
+            continue;
+        }
+        auto codeIdx = method->getCodeIdxForSourceLocation(line);
+        if(codeIdx < 0) {
+            continue;
+        }
+        classBreakpoints[filedata->name()].push_back(QSharedPointer<RequestExtraBreakPoint>(
+                new RequestExtraBreakPoint(filedata->name(), method->m_name,
+                                           method->buildProto(), (uint64_t)codeIdx)));
+    }
 
+    auto install = [this, classBreakpoints, done]() {
+        // the group waits for the breakpoints of loaded classes, the others
+        // are set when their class is prepared
+        beginRequestGroup();
+        for(auto it = classBreakpoints.constBegin(); it != classBreakpoints.constEnd(); ++it) {
+            setClassBreakpoints(it.key(), it.value());
+        }
+        endRequestGroup(done);
+    };
+    if(!mClassesLoaded) {
+        mClassLookups.push_back(install);
+        return;
+    }
+    install();
 }
 
 void DebugHandler::updateThreadFrame(JDWP::ObjectId threadId) {
@@ -699,17 +1066,19 @@ void DebugHandler::updateThreadFrame(JDWP::ObjectId threadId) {
     dbgThreadReferenceFrames(threadId, [this, model]
             (QVector<JDWP::ThreadReference::Frames::Frame>& frames) {
         model->removeAllFramedatas();
+        // class queries of all frames are pipelined, frames of one class
+        // share them. The stack is resolved to source once all are replied.
+        beginRequestGroup();
         for(auto &frame: frames) {
             auto data = new FrameListModel::FrameData;
             data->frame_id = frame.frame_id;
             data->location = frame.location;
             model->addFrameData(data);
-            dbgReferenceTypeSignatureWithGeneric(frame.location.class_id, [this, model, data]
+            dbgReferenceTypeSignatureWithGeneric(frame.location.class_id, [this, data]
                     (QByteArray sig, QByteArray sigGen) {
                 data->classSig = sig;
-                model->updateFrameData(data);
             });
-            dbgReferenctTypeMethodsWithGeneric(frame.location.class_id, [this, model, data]
+            dbgReferenctTypeMethodsWithGeneric(frame.location.class_id, [this, data]
                     (QVector<JDWP::MethodInfo> methods) {
                 for (auto method: methods) {
                     if (method.mMethodId != data->location.method_id) {
@@ -718,11 +1087,13 @@ void DebugHandler::updateThreadFrame(JDWP::ObjectId threadId) {
                     data->methodName = method.mName;
                     data->methodSig = method.mSignature;
                     data->methodFlag = method.mFlags;
-                    model->updateFrameData(data);
                     break;
                 }
             });
         }
+        endRequestGroup([model]() {
+            model->updateFrameDatas();
+        });
     });
 }
 
@@ -953,7 +1324,7 @@ void DebugHandler::setItemValue(VariableTreeItem *parent,
 ReqestPackage::ReqestPackage(QByteArray& data,  QObject *parent)
         : QObject(parent),
           mData(data),
-          mRequest((uint8_t*)data.data (), data.length())
+          mRequest((const uint8_t*)mData.constData (), mData.length())
 {
 
 }
@@ -976,79 +1347,6 @@ CommandPackage::CommandPackage(JDWP::JdwpEventModPad mod, JDWP::JdwpSuspendPolic
 
 }
 
-int CommandPackage::getEventGroup(JDWP::JdwpEventKind kind) {
-    int egroup = (int)EventGroup::Unknown;
-    switch(kind) {
-        case JDWP::JdwpEventKind::EK_SINGLE_STEP:
-        case JDWP::JdwpEventKind::EK_BREAKPOINT:
-        case JDWP::JdwpEventKind::EK_METHOD_ENTRY:
-        case JDWP::JdwpEventKind::EK_METHOD_EXIT:
-            egroup = (int)EventGroup::Location;
-            break;
-//            case JdwpEventKind::EK_FRAME_POP:
-//                Q_ASSERT(false);
-//                break;
-        case JDWP::JdwpEventKind::EK_EXCEPTION:
-            egroup = (int)EventGroup::Exception;
-            break;
-//            case JdwpEventKind::EK_USER_DEFINED:
-//                Q_ASSERT(false);
-//                break;
-        case JDWP::JdwpEventKind::EK_THREAD_START:
-        case JDWP::JdwpEventKind::EK_THREAD_DEATH:
-            egroup = (int)EventGroup::Thread;
-            break;
-        case JDWP::JdwpEventKind::EK_CLASS_PREPARE:
-            egroup = (int)EventGroup::Prepare;
-            break;
-//            case JdwpEventKind::EK_CLASS_UNLOAD:
-//                Q_ASSERT(false);
-//                break;
-//            case JdwpEventKind::EK_CLASS_LOAD:
-//                Q_ASSERT(false);
-//                break;
-//            case JdwpEventKind::EK_FIELD_ACCESS:
-//                Q_ASSERT(false);
-//                break;
-//            case JdwpEventKind::EK_FIELD_MODIFICATION:
-//                Q_ASSERT(false);
-//                break;
-//            case JdwpEventKind::EK_EXCEPTION_CATCH:
-//                Q_ASSERT(false);
-//                break;
-//            case JdwpEventKind::EK_METHOD_EXIT_WITH_RETURN_VALUE:
-//                Q_ASSERT(false);
-//                break;
-//            case JdwpEventKind::EK_MONITOR_CONTENDED_ENTER:
-//                Q_ASSERT(false);
-//                break;
-//            case JdwpEventKind::EK_MONITOR_CONTENDED_ENTERED:
-//                Q_ASSERT(false);
-//                break;
-//            case JdwpEventKind::EK_MONITOR_WAIT:
-//                Q_ASSERT(false);
-//                break;
-//            case JdwpEventKind::EK_MONITOR_WAITED:
-//                Q_ASSERT(false);
-//                break;
-        case JDWP::JdwpEventKind::EK_VM_START:
-            egroup = (int)EventGroup::VmStart;
-            break;
-        case JDWP::JdwpEventKind::EK_VM_DEATH:
-            egroup = (int)EventGroup::VmDeath;
-            break;
-//            case JdwpEventKind::EK_VM_DISCONNECTED:
-//                Q_ASSERT(false);
-//                break;
-        default:
-            egroup = (int)EventGroup::Unknown;
-            break;
-    }
-    return egroup;
-}
-
-
-
 bool CommandPackage::match(JDWP::Composite::ReflectedType::EventObject *pevent,
                            JDWP::JdwpSuspendPolicy  policy) {
     if(policy != mSuspendPolicy) {
@@ -1091,6 +1389,7 @@ bool CommandPackage::match(JDWP::Composite::ReflectedType::EventObject *pevent,
             auto sig = jniSigToJavaSig(event->mSignature);
             if(sig == mMod.mArray) {
                 onClassPrepare(event, policy, &clear);
+                matched = true;
             }
         }
             break;
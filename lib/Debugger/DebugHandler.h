@@ -22,16 +22,25 @@
 #include <Jdwp/Request.h>
 #include <Jdwp/JdwpHandler.h>
 #include <QEventLoop>
-#include <QMultiMap>
+#include <QMultiHash>
 
 #include <QObject>
+#include <QFile>
+#include <QHash>
 #include <QMap>
+#include <QPair>
+#include <QQueue>
+#include <QSet>
 #include <QSharedPointer>
 
+#include <functional>
+
 class DebugSocket;
 class RequestExtra;
 class ReqestPackage;
 class CommandPackage;
+struct RequestGroup;
+struct RequestExtraBreakPoint;
 
 class DebugHandler: public QObject {
     Q_OBJECT
@@ -49,6 +58,25 @@ public:
     };
     void updateThreadFrame(JDWP::ObjectId threadId);
 
+    // requests sent and waiting for their reply at most, later requests are
+    // queued until replies arrive
+    void setMaxRequestsInFlight(int count);
+
+    /*!
+     * requests sent between beginRequestGroup and endRequestGroup form a
+     * group, independent requests are pipelined instead of chained in reply
+     * callbacks. Groups nest, requests of an inner group belong to the outer
+     * groups too. The requests are written out when the outermost group ends.
+     */
+    void beginRequestGroup();
+    /*!
+     * @tparam Func()
+     * @param callback called after the reply callbacks of every request of
+     * the group, at once if the group sent nothing.
+     */
+    template <typename Func>
+    void endRequestGroup(Func callback);
+
 public:
     // Debugger interfaces
     /*!
@@ -90,6 +118,17 @@ public:
     template <typename Func>
     void dbgGetClassBySignature(const QString &classSignature, Func callback);
 
+    /*!
+     * VirtualMachine::ClassesBySignature (1, 2)
+     * Ask the VM without waiting for the class to load. The classes replied
+     * are cached, none is replied if no class loader has the class.
+     * @tparam Func(std::vector<JDWP::ClassInfo> &classinfos)
+     * @param classSignature
+     * @param callback
+     */
+    template <typename Func>
+    void dbgVirtualMachineClassesBySignature(const QString &classSignature, Func callback);
+
     /*!
      * VirtualMachine::Resume(1, 9)
      * Resume execution.  Decrements the "suspend count" of all threads.
@@ -295,14 +334,37 @@ private:
     void handleCommand(JDWP::Request & reply);
 
     bool sendNewRequest(QSharedPointer<ReqestPackage>& req);
-    void setCommandPackage(JDWP::JdwpEventKind eventkind, QSharedPointer<CommandPackage>& package);
+    void joinRequestGroup(QSharedPointer<ReqestPackage>& req);
+    void sendWaitingRequests();
+    void flushSendBuffer();
+    void resetRequests();
+    // ReferenceType query of refTypeId waiting for its reply. Callers asking
+    // the same connect to its reply instead of sending it again.
+    QSharedPointer<ReqestPackage> typeQuery(int command, JDWP::RefTypeId refTypeId);
+    void sendTypeQuery(QSharedPointer<ReqestPackage>& req, JDWP::RefTypeId refTypeId);
+    // package is matched with the events of requestId
+    void setCommandPackage(uint32_t requestId, QSharedPointer<CommandPackage>& package);
+    // write packets to mCapture, each after a '<' (from VM) or '>' (to VM)
+    void capturePackets(char direction, const QByteArray &data);
+    // class cache kept by the class list and the class prepare/unload events
+    void recordClassInfo(const JDWP::ClassInfo &info);
+    void removeClassInfo(const QString &classSignature);
 
 private:
+    typedef QList<QSharedPointer<RequestExtraBreakPoint>> BreakPointList;
+
     void breakPointHit(JDWP::JdwpSuspendPolicy  policy,
                        JDWP::Composite::ReflectedType::EventLocationEvent*event);
 
-    void stopOnProcessEntryPoint();
-    void setAllBreakpoint();
+    // resume is called once the entry point breakpoint is set
+    void stopOnProcessEntryPoint(std::function<void()> resume);
+    // done is called once the breakpoints of loaded classes are set
+    void setAllBreakpoint(std::function<void()> done);
+    // set breakpoints of the class now or once it is prepared
+    void setClassBreakpoints(const QString &classSignature, const BreakPointList &breakpoints);
+    // done, if set, is called after the breakpoint requests are replied
+    void installBreakpoints(JDWP::RefTypeId refTypeId, const BreakPointList &breakpoints,
+                            std::function<void()> done);
 
     void dumpObjectItemValue(VariableTreeItem* item);
     void dumpArrayItemValue(VariableTreeItem *item);
@@ -313,15 +375,39 @@ private:
                       const JDWP::JValue* value);
 private:
     DebugSocket* mSocket;
-    QMap<int, QSharedPointer<ReqestPackage>> mRequestMap;
-    QVector<QVector<QSharedPointer<CommandPackage>>> mCommandVector;    // [EventGroup][CommandPackage]
+    QHash<int, QSharedPointer<ReqestPackage>> mRequestMap;
+    // event request id - command waiting for its events
+    QHash<uint32_t, QSharedPointer<CommandPackage>> mCommandPackages;
+    // class prepare commands whose request is not replied yet
+    QVector<QSharedPointer<CommandPackage>> mPendingCommands;
     int mSockId = 0;
+
+    int mRequestsInFlight = 0;
+    int mMaxRequestsInFlight;
+    // requests over the in flight window, in id order
+    QQueue<QSharedPointer<ReqestPackage>> mWaitingRequests;
+    // requests of one event loop pass are written to the socket at once
+    QByteArray mSendBuffer;
+    bool mSendScheduled = false;
+    // open request groups, the innermost last
+    QVector<QSharedPointer<RequestGroup>> mRequestGroups;
+    QHash<QPair<int, JDWP::RefTypeId>, QSharedPointer<ReqestPackage>> mTypeQueries;
+    // class lookups wait for the reply of AllClassesWithGeneric
+    bool mClassesLoaded = false;
+    QVector<std::function<void()>> mClassLookups;
+    // signatures of unloaded classes, other class loaders may still have them
+    QSet<QString> mUnloadedClassRef;
+    // session packets, recorded when ART_JDWP_CAPTURE names a file.
+    // Debugger_Bench replays them.
+    QFile mCapture;
+
+    friend class DebugHandlerBench;
 public:
     // classsign - classinfo map
-    QMultiMap<QString, JDWP::RefTypeId> mLoadedClassRef;
-    QMap<JDWP::RefTypeId, JDWP::ClassInfo> mLoadedClassInfo;
-    QMap<JDWP::RefTypeId, QVector<JDWP::MethodInfo>> mLoadedMethodsInfo;    // map to ClassId, methodinfo
-    QMap<JDWP::RefTypeId, QVector<JDWP::FieldInfo>> mLoadedFieldsInfo;      // map to ClassId, fieldinfo
+    QMultiHash<QString, JDWP::RefTypeId> mLoadedClassRef;
+    QHash<JDWP::RefTypeId, JDWP::ClassInfo> mLoadedClassInfo;
+    QHash<JDWP::RefTypeId, QVector<JDWP::MethodInfo>> mLoadedMethodsInfo;    // map to ClassId, methodinfo
+    QHash<JDWP::RefTypeId, QVector<JDWP::FieldInfo>> mLoadedFieldsInfo;      // map to ClassId, fieldinfo
 
     DebugStatus mDebugStatus;
 };
@@ -341,6 +427,13 @@ struct RequestExtraBreakPoint{
     uint64_t mCodeIdx;
 };
 
+// requests waited for together, see DebugHandler::beginRequestGroup
+struct RequestGroup {
+    int mPending = 0;
+    bool mClosed = false;
+    std::function<void()> mCallback;
+};
+
 // for JDWP package request and reply
 class ReqestPackage: public QObject {
     Q_OBJECT
@@ -355,6 +448,12 @@ public:
 
     QByteArray mData;
     JDWP::Request mRequest;
+
+    // groups waiting for this request, a shared query may be in several
+    QVector<QSharedPointer<RequestGroup>> mGroups;
+    // set for a ReferenceType query shared by callers
+    JDWP::RefTypeId mQueryTypeId = 0;
+    bool mShared = false;
 };
 
 // for JDWP package command. set command hook and wait for match command.
@@ -373,20 +472,11 @@ signals:
     void onVmDeath(bool *clear);
 public:
     bool match(JDWP::Composite::ReflectedType::EventObject* pevent, JDWP::JdwpSuspendPolicy  policy);
-public:
-    enum EventGroup {
-        Location = 0,
-        Exception,
-        Thread,
-        Prepare,
-        VmStart,
-        VmDeath,
-        Unknown,
-    };
-    static int getEventGroup(JDWP::JdwpEventKind kind);
 public:
     JDWP::JdwpEventModPad mMod;
     JDWP::JdwpSuspendPolicy  mSuspendPolicy;
+    // id of the event request, 0 until its reply
+    uint32_t mRequestId = 0;
     bool clear = false;
 };
 
@@ -17,8 +17,12 @@
 
 #include <QHostAddress>
 #include <QMutexLocker>
+#include <QtEndian>
 #include <QtCore/QEventLoop>
 
+// larger packets are taken as a broken stream
+static const quint32 kMaxPacketLen = 256 * 1024 * 1024;
+
 DebugSocket::DebugSocket (QObject *parent)
         : QThread (parent), mQuit(false), mSocket(nullptr), mConnected(false)
 {
@@ -88,25 +92,39 @@ void DebugSocket::run ()
     }
 
     QEventLoop loop;        // used to listen readwriteclose signal
-    QByteArray mBufPool;
+    // packet being received. It is allocated with the length in its header,
+    // socket data is read into place and the packet is handed on as is.
+    QByteArray packet;
+    int received = 0;
 
     connect(mSocketEvent, &DebugSocketEvent::newStatus, &loop, &QEventLoop::quit);
 
-    connect(mSocket, &QTcpSocket::readyRead, [this, &mBufPool](){
-        while(mSocket->isReadable()) {
-            auto buffer = mSocket->readAll();
-            if(buffer.isEmpty()) {
-//                qDebug() << "empty buffer read, exit loop";
+    connect(mSocket, &QTcpSocket::readyRead, [this, &packet, &received](){
+        while(mSocket->bytesAvailable() > 0) {
+            if(packet.isEmpty()) {
+                quint32 length;
+                if(mSocket->peek((char*)&length, sizeof(length)) < (qint64)sizeof(length)) {
+                    break;
+                }
+                length = qFromBigEndian(length);
+                if(length < kJDWPHeaderLen || length > kMaxPacketLen) {
+                    error(-1, tr("Invalid jdwp packet length %1").arg(length));
+                    mSocketEvent->onStop();
+                    return;
+                }
+                packet = QByteArray((int)length, Qt::Uninitialized);
+                received = 0;
+            }
+            auto count = mSocket->read(packet.data() + received, packet.length() - received);
+            if(count <= 0) {
                 break;
             }
-//            qDebug() << "[DebugSocket] read: " << buffer.toHex();
-            mBufPool += buffer;
-        }
-        while(JDWP::Request::isValid ((const uint8_t*)mBufPool.data (), mBufPool.length ())) {
-            auto len = JDWP::Request::GetPackageLength((const uint8_t*)mBufPool.data (), mBufPool.length ());
-            auto array = mBufPool.left(len);
-            newJDWPRequest(array);
-            mBufPool.remove(0, len);
+            received += (int)count;
+            if(received == packet.length()) {
+//                qDebug() << "[DebugSocket] read: " << packet.toHex();
+                newJDWPRequest(packet);
+                packet = QByteArray();
+            }
         }
     });
     onConnected();
@@ -20,19 +20,11 @@ void FrameListModel::FrameData::update() {
     if(classSig.isEmpty()) {
         return;
     }
-    auto filedata = SmaliAnalysis::instance()->getSmaliFileBySig(classSig);
-    if(!filedata.isNull()) {
-        hasSource = true;
-        sourceFile = filedata->sourceFile();
-        auto method = filedata->method(methodName, methodSig);
-        if(method == nullptr) {
-            sourceLine = 1;
-        } else {
-            // TODO get sourceline with dex_pc
-            sourceLine = method->m_startline;
-        }
-    }
+    resolveSources({this});
+    updateDescription();
+}
 
+void FrameListModel::FrameData::updateDescription() {
     description.clear();
     if(methodName.isEmpty()) {
         description.append('@');
@@ -144,6 +136,43 @@ void FrameListModel::updateFrameData(FrameData *frameData)
     dataChanged(index(idx, 0, QModelIndex()), index(idx, 2, QModelIndex()));
 }
 
+void FrameListModel::updateFrameDatas()
+{
+    if (m_framedataList.isEmpty())
+        return;
+    resolveSources(m_framedataList);
+    for(auto frameData: m_framedataList) {
+        frameData->updateDescription();
+    }
+    dataChanged(index(0, 0, QModelIndex()), index(m_framedataList.size() - 1, 0, QModelIndex()));
+}
+
+void FrameListModel::resolveSources(const QList<FrameData *> &frameDatas)
+{
+    QVector<SmaliLocation> locations;
+    locations.reserve(frameDatas.size());
+    for(auto frameData: frameDatas) {
+        SmaliLocation location;
+        location.m_classSig = frameData->classSig;
+        location.m_methodName = frameData->methodName;
+        location.m_methodSig = frameData->methodSig;
+        location.m_codeIdx = (int)frameData->location.dex_pc;
+        locations.push_back(location);
+    }
+
+    SmaliAnalysis::instance()->getSourceLocations(locations);
+    for(auto i = 0; i < frameDatas.size(); i++) {
+        auto &location = locations.at(i);
+        if(!location.m_hasSource) {
+            continue;
+        }
+        auto frameData = frameDatas.at(i);
+        frameData->hasSource = true;
+        frameData->sourceFile = location.m_sourceFile;
+        frameData->sourceLine = location.m_line;
+    }
+}
+
 
 void FrameListModel::removeAllFramedatas()
 {
@@ -39,6 +39,7 @@ public:
 
         QString display();
         void update();
+        void updateDescription();
     };
 public:
     FrameListModel(QObject* parent = nullptr);
@@ -51,6 +52,8 @@ public:
     void deleteFramedata(FrameData *frameData);
     void removeAllFramedatas();
     void updateFrameData(FrameData *frameData);
+    // update every frame, the source of the whole stack is resolved at once
+    void updateFrameDatas();
     QList<FrameData *> getFrameDatas();
     bool gotoFrameData(FrameData *frameData);
 
@@ -66,6 +69,8 @@ public:
     Qt::ItemFlags flags(const QModelIndex &index) const;
 
 private:
+    static void resolveSources(const QList<FrameData *> &frameDatas);
+
     QItemSelectionModel *m_selectionModel;
     QList<FrameData *> m_framedataList;
 };
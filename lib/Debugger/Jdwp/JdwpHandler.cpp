@@ -1890,7 +1890,13 @@ Composite::ReflectedType::ReflectedType (
                 mEventList[i] = event;
             }
                 break;
-            case JdwpEventKind::EK_CLASS_UNLOAD:Q_ASSERT(false);
+            case JdwpEventKind::EK_CLASS_UNLOAD: {
+                auto event = new EventClassUnload();
+                event->mEventKind = eventKind;
+                event->mRequestId = requestId;
+                event->mSignature = ReadString();
+                mEventList[i] = event;
+            }
                 break;
             case JdwpEventKind::EK_CLASS_LOAD:Q_ASSERT(false);
                 break;
@@ -1229,6 +1229,14 @@ namespace JDWP {
                 uint32_t mStatus;
                 ~EventClassPrepare(){};
             };
+/*
+ * A class has been unloaded. Only the signature is sent, classes of the
+ * same name in other class loaders may still be loaded.
+ */
+            struct EventClassUnload: public EventObject {
+                QByteArray mSignature;
+                ~EventClassUnload(){};
+            };
         public:
             ReflectedType(const uint8_t* bytes, uint32_t available);
             ~ReflectedType();
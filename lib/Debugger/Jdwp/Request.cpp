@@ -35,23 +35,24 @@ JDWP::Request::Request (const uint8_t *bytes,uint32_t available)
     command_set_ = Read1();
     command_ = Read1();
 
-    extra.append ((const char*)p_, byte_count_ - kJDWPHeaderLen);
+    extra_ = p_;
+    extra_len_ = byte_count_ - kJDWPHeaderLen;
     reset (GetExtra (), GetExtraLen ());
 
 }
 
 const uint8_t *Request::GetExtra () const
 {
-    return (const uint8_t*)extra.data ();
+    return extra_;
 }
 
 size_t Request::GetExtraLen () const
 {
-    return extra.length ();
+    return extra_len_;
 }
 
 QByteArray Request::GetExtraArray() const {
-    return extra;
+    return QByteArray::fromRawData((const char*)extra_, (int)extra_len_);
 }
 
 bool Request::isValid (const uint8_t *bytes,uint32_t available)
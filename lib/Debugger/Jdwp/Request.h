@@ -7,7 +7,8 @@
 //
 //===----------------------------------------------------------------------===//
 //
-// The file defines jdwp Request for handling jdwp packet
+// The file defines jdwp Request for handling jdwp packet. The packet is
+// read in place, its bytes must live as long as the Request.
 //
 //===----------------------------------------------------------------------===//
 
@@ -34,6 +35,7 @@ namespace JDWP {
 
         const uint8_t* GetExtra() const;
         size_t GetExtraLen() const;
+        // payload sharing the packet bytes, no copy is made
         QByteArray GetExtraArray() const;
 
         bool isValid() { return valid_; }
@@ -51,7 +53,8 @@ namespace JDWP {
         bool reply;
 
         bool valid_;
-        QByteArray extra;
+        const uint8_t* extra_ = nullptr;
+        size_t extra_len_ = 0;
     };
 }
 
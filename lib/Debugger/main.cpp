@@ -0,0 +1,181 @@
+//===- main.cpp - ART-DEBUGGER ----------------------------------*- C++ -*-===//
+//
+//                     ANDROID REVERSE TOOLKIT
+//
+// This file is distributed under the GNU GENERAL PUBLIC LICENSE
+// V3 License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// The file defines a benchmark replaying a JDWP session through DebugHandler.
+// Record one by running ART with ART_JDWP_CAPTURE=<file> while debugging.
+//
+//===----------------------------------------------------------------------===//
+
+#include "DebugHandler.h"
+#include "DebugSocket.h"
+
+#include <Jdwp/JdwpHeader.h>
+
+#include <QApplication>
+#include <QElapsedTimer>
+#include <QFile>
+
+#include <climits>
+#include <cstring>
+#include <iostream>
+
+// debug output of every packet would be timed with it
+static void dropDebugOutput(QtMsgType type, const QMessageLogContext &context,
+                            const QString &message) {
+    if(type != QtDebugMsg) {
+        std::cerr << message.toStdString() << std::endl;
+    }
+}
+
+struct CapturedPacket {
+    bool fromVm;
+    QByteArray data;
+};
+
+struct PacketTiming {
+    int count = 0;
+    qint64 total = 0;
+    qint64 max = 0;
+
+    void add(qint64 nsecs) {
+        count++;
+        total += nsecs;
+        max = qMax(max, nsecs);
+    }
+
+    void print(const char* title) const {
+        std::cout << "  " << title << ": " << count << " packets, "
+                  << (count > 0 ? total / count : 0) << " ns mean, "
+                  << max << " ns max" << std::endl;
+    }
+};
+
+// reach the request tables DebugHandler hides
+class DebugHandlerBench {
+public:
+    // Replay packets with padding more requests waiting for reply and event
+    // requests in the tables, which are never answered. Ids from firstId on
+    // are not used by the session.
+    static void replay(DebugSocket* socket, const QVector<CapturedPacket> &packets,
+                       int padding, uint32_t firstId) {
+        DebugHandler handler(nullptr, socket);
+        // the session wrote these requests, it was not held by the window
+        handler.setMaxRequestsInFlight(INT_MAX);
+
+        for(auto i = 0; i < padding; i++) {
+            auto request = JDWP::VirtualMachine::Version::buildReq(firstId + i);
+            handler.mRequestMap.insert(firstId + i,
+                                       QSharedPointer<ReqestPackage>(new ReqestPackage(request)));
+            handler.mCommandPackages.insert(firstId + i, newCommand(JDWP::SP_NONE));
+        }
+        // requests sent by the handler itself, like frames on a breakpoint
+        handler.mSockId = firstId + padding;
+
+        PacketTiming replies;
+        PacketTiming events;
+        QElapsedTimer timer;
+        for(auto &packet: packets) {
+            if(!packet.fromVm) {
+                sendRequest(handler, packet.data);
+                continue;
+            }
+            bool isReply = (uint8_t)packet.data.at(8) & kJDWPFlagReply;
+            timer.start();
+            handler.onJDWPRequest(packet.data);
+            auto nsecs = timer.nsecsElapsed();
+            (isReply ? replies : events).add(nsecs);
+        }
+
+        std::cout << padding << " more requests in the tables" << std::endl;
+        replies.print("replies");
+        events.print("events");
+    }
+
+private:
+    static QSharedPointer<CommandPackage> newCommand(JDWP::JdwpSuspendPolicy policy) {
+        // location of no class, it matches no event
+        JDWP::JdwpEventMod mod;
+        memset(&mod, 0, sizeof(mod));
+        mod.modKind = JDWP::MK_LOCATION_ONLY;
+        return QSharedPointer<CommandPackage>(new CommandPackage(mod, policy));
+    }
+
+    // register a recorded request like sendNewRequest does, without callbacks.
+    // Event requests get a command waiting for their events.
+    static void sendRequest(DebugHandler &handler, QByteArray data) {
+        auto package = QSharedPointer<ReqestPackage>(new ReqestPackage(data));
+        auto &request = package->mRequest;
+        if(request.GetCommandSet() == JDWP::EventRequest::set_
+           && request.GetCommand() == JDWP::EventRequest::Set::cmd
+           && request.GetExtraLen() >= 2) {
+            auto policy = (JDWP::JdwpSuspendPolicy)request.GetExtra()[1];
+            QObject::connect(package.data(), &ReqestPackage::onReply, [&handler, policy]
+                    (JDWP::Request *request, QByteArray& reply) {
+                JDWP::EventRequest::Set set((uint8_t*)reply.data(), reply.length());
+                auto command = newCommand(policy);
+                handler.setCommandPackage(set.mRequestId, command);
+            });
+        }
+        handler.sendNewRequest(package);
+    }
+};
+
+// read packets written by DebugHandler::capturePackets
+static bool readCapture(const QString &path, QVector<CapturedPacket> &packets,
+                        uint32_t &maxId) {
+    QFile file(path);
+    if(!file.open(QFile::ReadOnly)) {
+        return false;
+    }
+    auto content = file.readAll();
+    auto* bytes = (const uint8_t*)content.constData();
+    maxId = 0;
+    for(uint32_t pos = 0; pos < (uint32_t)content.size(); ) {
+        char direction = content.at(pos++);
+        auto length = JDWP::Request::GetPackageLength(bytes + pos, content.size() - pos);
+        if((direction != '<' && direction != '>') || length == 0) {
+            return false;
+        }
+        CapturedPacket packet;
+        packet.fromVm = direction == '<';
+        packet.data = content.mid(pos, length);
+        packets << packet;
+        maxId = qMax(maxId, JDWP::Request(bytes + pos, length).GetId());
+        pos += length;
+    }
+    return true;
+}
+
+// Debugger_Bench <capture file>
+int main(int argc, char* argv[]) {
+    if(argc != 2) {
+        std::cout << "usage: " << argv[0] << " <capture file>" << std::endl;
+        return 1;
+    }
+    // the frame view is a widget, no screen is needed for it
+    if(qgetenv("QT_QPA_PLATFORM").isEmpty()) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QApplication app(argc, argv);
+    qInstallMessageHandler(dropDebugOutput);
+
+    QVector<CapturedPacket> packets;
+    uint32_t maxId;
+    if(!readCapture(QString::fromLocal8Bit(argv[1]), packets, maxId)) {
+        std::cout << "can not read capture " << argv[1] << std::endl;
+        return 1;
+    }
+
+    // per packet time should not grow with the tables
+    auto socket = new DebugSocket();
+    for(auto padding: {0, 10000, 100000}) {
+        DebugHandlerBench::replay(socket, packets, padding, maxId + 1);
+    }
+    return 0;
+}
@@ -350,7 +350,7 @@ void EditorTab::updateSmaliEditorMsg(QString file) {
     auto smalianalysis = SmaliAnalysis::instance();
     auto filedata = smalianalysis->getSmaliFile(file);
     if(filedata.isNull()) {
-        smalianalysis->startFileParseThread(file);
+        smalianalysis->reindexFile(file);
         return;
     }
     // update method combo
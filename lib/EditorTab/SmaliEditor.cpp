@@ -10,6 +10,9 @@
 
 #include "EditorTab/SmaliEditor.h"
 #include "SmaliHighlight.h"
+#include "SmaliTokenCache.h"
+
+#include <SmaliAnalysis/SmaliAnalysis.h>
 
 
 #include <QPainter>
@@ -18,10 +21,21 @@
 
 SmaliEditor::SmaliEditor(QWidget *parent)
         : TextEditor(parent),
-          m_highlighter(new SmaliHighlight(document()))
+          m_tokenCache(new SmaliTokenCache(document())),
+          m_highlighter(new SmaliHighlight(document(), m_tokenCache))
 {
     setSidebar(new SmaliSideBar(this));
     m_highlighter->setTheme(m_theme);
+
+    // large files are tokenized in background, show the viewport first
+    connect(m_tokenCache, &SmaliTokenCache::tokensReady, this, [this]() {
+        m_highlighter->formatScanned(firstVisibleBlock(), visibleBlockCount());
+    });
+    connect(this, &QPlainTextEdit::updateRequest, this, [this](const QRect &, int dy) {
+        if(dy != 0 && m_highlighter->isFormatting()) {
+            m_highlighter->formatBlocks(firstVisibleBlock(), visibleBlockCount());
+        }
+    });
 }
 
 SmaliEditor::~SmaliEditor()
@@ -31,33 +45,41 @@ SmaliEditor::~SmaliEditor()
 
 bool SmaliEditor::openFile(const QString &fileName, int iLine)
 {
-    if(!TextEditor::openFile(fileName, 1)) {
+    return TextEditor::openFile(fileName, 1);
+}
+
+bool SmaliEditor::saveFile()
+{
+    auto modified = document()->isModified();
+    if(!TextEditor::saveFile()) {
         return false;
     }
-    readBreakMark();
+    if(modified) {
+        SmaliAnalysis::instance()->updateSmaliFile(m_tokenCache->parse(m_filePath));
+    }
     return true;
 }
 
+int SmaliEditor::visibleBlockCount() const
+{
+    return viewport()->height() / fontMetrics().lineSpacing() + 1;
+}
+
+void SmaliEditor::fileLoaded()
+{
+    TextEditor::fileLoaded();
+    readBreakMark();
+}
+
 void SmaliEditor::setTheme(const KSyntaxHighlighting::Theme &theme)
 {
     m_highlighter->setTheme(theme);
-    m_highlighter->rehighlight();
     TextEditor::setTheme(theme);
 }
 
 bool SmaliEditor::isFoldable(const QTextBlock &block) const
 {
-    if(m_smalidata.isNull()) {
-        return false;
-    }
-    auto line = block.firstLineNumber() + 1;
-    for(auto i = 0, count = m_smalidata->methodCount(); i < count; i++) {
-        auto method = m_smalidata->method(i);
-        if(method->m_startline == line) {
-            return true;
-        }
-    }
-    return false;
+    return m_tokenCache->firstTokenType(block) == SmaliLexer::METHOD_DIRECTIVE;
 }
 
 bool SmaliEditor::isFolded(const QTextBlock &block) const
@@ -72,26 +94,29 @@ bool SmaliEditor::isFolded(const QTextBlock &block) const
 
 QTextBlock SmaliEditor::findFoldingRegionEnd(const QTextBlock &startBlock) const
 {
-    if(m_smalidata.isNull()) {
+    if(!isFoldable(startBlock)) {
         return QTextBlock();
     }
-
-    auto line = startBlock.firstLineNumber() + 1;
-    int endLine = -1;
-    for(auto i = 0, count = m_smalidata->methodCount(); i < count; i++) {
-        auto method = m_smalidata->method(i);
-        if(method->m_startline == line) {
-            endLine = method->m_endline;
-            break;
-        }
-    }
-    if(endLine != -1) {
-        auto block = startBlock;
-        while(block.isValid()) {
-            if(block.firstLineNumber()+1 >= endLine) {
+    auto line = startBlock.blockNumber() + 1;
+    if(!m_smalidata.isNull() && !document()->isModified()) {
+        // lines of the analysed file match the saved document
+        auto method = m_smalidata->methodAtLine(line);
+        if(method != nullptr && method->m_startline == line) {
+            auto block = document()->findBlockByNumber(method->m_endline - 1);
+            if(m_tokenCache->firstTokenType(block) == SmaliLexer::END_METHOD_DIRECTIVE) {
                 return block;
             }
-            block = block.next();
+        }
+    }
+    // the edited text may not be analysed yet, methods are found by tokens
+    for(auto block = startBlock.next(); block.isValid(); block = block.next()) {
+        auto type = m_tokenCache->firstTokenType(block);
+        if(type == SmaliLexer::END_METHOD_DIRECTIVE) {
+            return block;
+        }
+        if(type == SmaliLexer::METHOD_DIRECTIVE) {
+            // .end method is missing
+            break;
         }
     }
     return QTextBlock();
@@ -10,18 +10,36 @@
 
 
 #include "SmaliHighlight.h"
+#include "SmaliTokenCache.h"
 
 #include <sstream>
+#include <QElapsedTimer>
 #include <QTextDocument>
+#include <QTextLayout>
 #include <QDebug>
 #include <Config/Config.h>
 #include <utils/StringUtil.h>
 #include <utils/Configuration.h>
 
 
-SmaliHighlight::SmaliHighlight (QTextDocument *parent)
-        : QSyntaxHighlighter(parent)
+// text style of a format, to restyle it when theme changes
+static const int kStyleProperty = QTextFormat::UserProperty + 1;
+// time formatting blocks at once in idle time, in ms
+static const int kIdleSlice = 10;
+
+SmaliHighlight::SmaliHighlight (QTextDocument *parent, SmaliTokenCache *tokenCache)
+        : QSyntaxHighlighter(parent),
+          m_tokenCache(tokenCache)
 {
+    m_idleTimer.setSingleShot(true);
+    m_idleTimer.setInterval(0);
+    connect(&m_idleTimer, &QTimer::timeout, this, &SmaliHighlight::formatIdleSlice);
+    // blocks before an edit may be moved, check again from there
+    connect(parent, &QTextDocument::contentsChange, this, [this, parent](int position, int, int) {
+        if(m_idleTimer.isActive()) {
+            m_idleBlock = qMin(m_idleBlock, parent->findBlock(position).blockNumber());
+        }
+    });
 }
 
 SmaliHighlight::~SmaliHighlight()
@@ -32,177 +50,230 @@ SmaliHighlight::~SmaliHighlight()
 
 void SmaliHighlight::highlightBlock (const QString &text)
 {
-    antlr4::ANTLRInputStream input(text.toStdString());
-    SmaliLexer lexer(&input);
-    antlr4::CommonTokenStream tokens(&lexer);
-
-    tokens.fill();
-    for (auto token : tokens.getTokens()) {
-        KSyntaxHighlighting::Theme::TextStyle  style;
-        switch(token->getType()) {
-            case SmaliLexer::CLASS_DIRECTIVE :
-            case SmaliLexer::SUPER_DIRECTIVE :
-            case SmaliLexer::IMPLEMENTS_DIRECTIVE :
-            case SmaliLexer::SOURCE_DIRECTIVE :
-            case SmaliLexer::FIELD_DIRECTIVE :
-            case SmaliLexer::END_FIELD_DIRECTIVE :
-            case SmaliLexer::SUBANNOTATION_DIRECTIVE :
-            case SmaliLexer::END_SUBANNOTATION_DIRECTIVE :
-            case SmaliLexer::ANNOTATION_DIRECTIVE :
-            case SmaliLexer::END_ANNOTATION_DIRECTIVE :
-            case SmaliLexer::ENUM_DIRECTIVE :
-            case SmaliLexer::METHOD_DIRECTIVE :
-            case SmaliLexer::END_METHOD_DIRECTIVE :
-            case SmaliLexer::REGISTERS_DIRECTIVE :
-            case SmaliLexer::LOCALS_DIRECTIVE :
-            case SmaliLexer::ARRAY_DATA_DIRECTIVE :
-            case SmaliLexer::END_ARRAY_DATA_DIRECTIVE :
-            case SmaliLexer::PACKED_SWITCH_DIRECTIVE :
-            case SmaliLexer::END_PACKED_SWITCH_DIRECTIVE :
-            case SmaliLexer::SPARSE_SWITCH_DIRECTIVE :
-            case SmaliLexer::END_SPARSE_SWITCH_DIRECTIVE :
-            case SmaliLexer::CATCH_DIRECTIVE :
-            case SmaliLexer::CATCHALL_DIRECTIVE :
-            case SmaliLexer::LINE_DIRECTIVE :
-            case SmaliLexer::PARAMETER_DIRECTIVE :
-            case SmaliLexer::END_PARAMETER_DIRECTIVE :
-            case SmaliLexer::LOCAL_DIRECTIVE :
-            case SmaliLexer::END_LOCAL_DIRECTIVE :
-            case SmaliLexer::RESTART_LOCAL_DIRECTIVE :
-            case SmaliLexer::PROLOGUE_DIRECTIVE :
-            case SmaliLexer::EPILOGUE_DIRECTIVE :
-                style = KSyntaxHighlighting::Theme::Keyword;
-                break;
-            case SmaliLexer::POSITIVE_INTEGER_LITERAL :
-            case SmaliLexer::NEGATIVE_INTEGER_LITERAL :
-            case SmaliLexer::LONG_LITERAL :
-            case SmaliLexer::SHORT_LITERAL :
-            case SmaliLexer::BYTE_LITERAL :
-                style = KSyntaxHighlighting::Theme::BaseN;
-                break;
-            case SmaliLexer::FLOAT_LITERAL_OR_ID :
-            case SmaliLexer::DOUBLE_LITERAL_OR_ID :
-            case SmaliLexer::FLOAT_LITERAL :
-            case SmaliLexer::DOUBLE_LITERAL :
-                style = KSyntaxHighlighting::Theme::Float;
-                break;
-            case SmaliLexer::BOOL_LITERAL :
-            case SmaliLexer::NULL_LITERAL :
-                style = KSyntaxHighlighting::Theme::DecVal;
-                break;
-            case SmaliLexer::REGISTER :
-                style = KSyntaxHighlighting::Theme::Variable;
-                break;
-            case SmaliLexer::ANNOTATION_VISIBILITY :
-                style = KSyntaxHighlighting::Theme::Annotation;
-                break;
-            case SmaliLexer::ACCESS_SPEC :
-            case SmaliLexer::INLINE_INDEX :
-            case SmaliLexer::VTABLE_INDEX :
-            case SmaliLexer::FIELD_INDEX :
-                style = KSyntaxHighlighting::Theme::Variable;
-                break;
-            case SmaliLexer::LINE_COMMENT :
-                style = KSyntaxHighlighting::Theme::Comment;
-                break;
-            case SmaliLexer::INSTRUCTION_FORMAT10t :
-            case SmaliLexer::INSTRUCTION_FORMAT10x :
-            case SmaliLexer::INSTRUCTION_FORMAT10x_ODEX :
-            case SmaliLexer::INSTRUCTION_FORMAT11n :
-            case SmaliLexer::INSTRUCTION_FORMAT11x :
-            case SmaliLexer::INSTRUCTION_FORMAT12x_OR_ID :
-            case SmaliLexer::INSTRUCTION_FORMAT12x :
-            case SmaliLexer::INSTRUCTION_FORMAT20bc :
-            case SmaliLexer::INSTRUCTION_FORMAT20t :
-            case SmaliLexer::INSTRUCTION_FORMAT21c_FIELD :
-            case SmaliLexer::INSTRUCTION_FORMAT21c_FIELD_ODEX :
-            case SmaliLexer::INSTRUCTION_FORMAT21c_STRING :
-            case SmaliLexer::INSTRUCTION_FORMAT21c_TYPE :
-            case SmaliLexer::INSTRUCTION_FORMAT21ih :
-            case SmaliLexer::INSTRUCTION_FORMAT21lh :
-            case SmaliLexer::INSTRUCTION_FORMAT21s :
-            case SmaliLexer::INSTRUCTION_FORMAT21t :
-            case SmaliLexer::INSTRUCTION_FORMAT22b :
-            case SmaliLexer::INSTRUCTION_FORMAT22c_FIELD :
-            case SmaliLexer::INSTRUCTION_FORMAT22c_FIELD_ODEX :
-            case SmaliLexer::INSTRUCTION_FORMAT22c_TYPE :
-            case SmaliLexer::INSTRUCTION_FORMAT22cs_FIELD :
-            case SmaliLexer::INSTRUCTION_FORMAT22s_OR_ID :
-            case SmaliLexer::INSTRUCTION_FORMAT22s :
-            case SmaliLexer::INSTRUCTION_FORMAT22t :
-            case SmaliLexer::INSTRUCTION_FORMAT22x :
-            case SmaliLexer::INSTRUCTION_FORMAT23x :
-            case SmaliLexer::INSTRUCTION_FORMAT30t :
-            case SmaliLexer::INSTRUCTION_FORMAT31c :
-            case SmaliLexer::INSTRUCTION_FORMAT31i_OR_ID :
-            case SmaliLexer::INSTRUCTION_FORMAT31i :
-            case SmaliLexer::INSTRUCTION_FORMAT31t :
-            case SmaliLexer::INSTRUCTION_FORMAT32x :
-            case SmaliLexer::INSTRUCTION_FORMAT35c_METHOD :
-            case SmaliLexer::INSTRUCTION_FORMAT35c_METHOD_ODEX :
-            case SmaliLexer::INSTRUCTION_FORMAT35c_TYPE :
-            case SmaliLexer::INSTRUCTION_FORMAT35mi_METHOD :
-            case SmaliLexer::INSTRUCTION_FORMAT35ms_METHOD :
-            case SmaliLexer::INSTRUCTION_FORMAT3rc_METHOD :
-            case SmaliLexer::INSTRUCTION_FORMAT3rc_METHOD_ODEX :
-            case SmaliLexer::INSTRUCTION_FORMAT3rc_TYPE :
-            case SmaliLexer::INSTRUCTION_FORMAT3rmi_METHOD :
-            case SmaliLexer::INSTRUCTION_FORMAT3rms_METHOD :
-            case SmaliLexer::INSTRUCTION_FORMAT45cc_METHOD :
-            case SmaliLexer::INSTRUCTION_FORMAT4rcc_METHOD :
-            case SmaliLexer::INSTRUCTION_FORMAT51l :
-                style = KSyntaxHighlighting::Theme::BuiltIn;
-                break;
-            case SmaliLexer::SIMPLE_NAME :
-            case SmaliLexer::MEMBER_NAME :
-                style = KSyntaxHighlighting::Theme::Function;
-                break;
-            case SmaliLexer::DOTDOT :
-            case SmaliLexer::ARROW :
-            case SmaliLexer::EQUAL :
-            case SmaliLexer::COLON :
-            case SmaliLexer::COMMA :
-            case SmaliLexer::OPEN_BRACE :
-            case SmaliLexer::CLOSE_BRACE :
-            case SmaliLexer::OPEN_PAREN :
-            case SmaliLexer::CLOSE_PAREN :
-                style = KSyntaxHighlighting::Theme::Operator;
-                break;
-            case SmaliLexer::STRING_LITERAL :
-            case SmaliLexer::STRING_ESCAPE :
-            case SmaliLexer::STRING_ESCAPEERROR :
-            case SmaliLexer::STRING_UTFERROR :
-            case SmaliLexer::STRING_END :
-            case SmaliLexer::STRING_FILEEND :
-                style = KSyntaxHighlighting::Theme::String;
-                break;
-            case SmaliLexer::CHAR_LITERAL :
-            case SmaliLexer::CHAR_ESCAPE :
-            case SmaliLexer::CHAR_ESCAPEERROR :
-            case SmaliLexer::CHAR_UTFERROR :
-            case SmaliLexer::CHAR_END :
-            case SmaliLexer::CHAR_FILEEND :
-                style = KSyntaxHighlighting::Theme::Char;
-                break;
-            case SmaliLexer::PRIMITIVE_TYPE :
-            case SmaliLexer::VOID_TYPE :
-                style = KSyntaxHighlighting::Theme::Constant;
-                break;
-            case SmaliLexer::CLASS_DESCRIPTOR :
-                style = KSyntaxHighlighting::Theme::DataType;
-                break;
-            case SmaliLexer::ARRAY_TYPE_PREFIX :
-                style = KSyntaxHighlighting::Theme::SpecialString;
-                break;
-            case SmaliLexer::TYPE_LIST_EOF :
-            case SmaliLexer::INVALID_TOKEN :
-            case SmaliLexer::VERIFICATION_ERROR_TYPE :
-            default:
-                style = KSyntaxHighlighting::Theme::Error;
-                break;
+    Q_UNUSED(text);
+    if(!m_restyle || !restyleBlock()) {
+        formatTokens();
+    }
+    // strings and type lists end at a line break, so the lexer is back in
+    // the default mode here and an edit stops at its own block
+    setCurrentBlockState((int)SmaliLexer::DEFAULT_MODE);
+}
 
+void SmaliHighlight::formatTokens()
+{
+    for(auto &token: m_tokenCache->tokens(currentBlock())) {
+        setFormat (token.m_start, token.m_length, mFormatMap[tokenStyle(token.m_type)]);
+    }
+}
+
+void SmaliHighlight::formatScanned(const QTextBlock &first, int count)
+{
+    formatBlocks(first, count);
+    m_idleBlock = 0;
+    m_idleTimer.start();
+}
+
+void SmaliHighlight::formatBlocks(const QTextBlock &first, int count)
+{
+    auto block = first;
+    for(auto i = 0; i < count && block.isValid(); i++, block = block.next()) {
+        if(needsFormat(block)) {
+            rehighlightBlock(block);
         }
-        setFormat (token->getStartIndex(), token->getStopIndex() - token->getStartIndex() + 1, mFormatMap[style]);
+    }
+}
+
+void SmaliHighlight::formatIdleSlice()
+{
+    QElapsedTimer timer;
+    timer.start();
+    auto block = document()->findBlockByNumber(m_idleBlock);
+    for(; block.isValid() && !timer.hasExpired(kIdleSlice); block = block.next()) {
+        if(needsFormat(block)) {
+            rehighlightBlock(block);
+        }
+    }
+    if(block.isValid()) {
+        m_idleBlock = block.blockNumber();
+        m_idleTimer.start();
+    }
+}
+
+bool SmaliHighlight::needsFormat(const QTextBlock &block) const
+{
+    // the block state does not change when it is formatted, so
+    // rehighlightBlock() stops at the block
+    auto layout = block.layout();
+    return layout != nullptr && layout->formats().isEmpty()
+           && !m_tokenCache->tokens(block).isEmpty();
+}
+
+bool SmaliHighlight::restyleBlock()
+{
+    auto layout = currentBlock().layout();
+    if(layout == nullptr) {
+        return false;
+    }
+    auto ranges = layout->formats();
+    for(auto &range: ranges) {
+        if(!range.format.hasProperty(kStyleProperty)) {
+            // block was not highlighted by us yet
+            return false;
+        }
+    }
+    for(auto &range: ranges) {
+        auto style = (KSyntaxHighlighting::Theme::TextStyle)range.format.intProperty(kStyleProperty);
+        setFormat (range.start, range.length, mFormatMap[style]);
+    }
+    return true;
+}
+
+KSyntaxHighlighting::Theme::TextStyle SmaliHighlight::tokenStyle(size_t type)
+{
+    switch(type) {
+        case SmaliLexer::CLASS_DIRECTIVE :
+        case SmaliLexer::SUPER_DIRECTIVE :
+        case SmaliLexer::IMPLEMENTS_DIRECTIVE :
+        case SmaliLexer::SOURCE_DIRECTIVE :
+        case SmaliLexer::FIELD_DIRECTIVE :
+        case SmaliLexer::END_FIELD_DIRECTIVE :
+        case SmaliLexer::SUBANNOTATION_DIRECTIVE :
+        case SmaliLexer::END_SUBANNOTATION_DIRECTIVE :
+        case SmaliLexer::ANNOTATION_DIRECTIVE :
+        case SmaliLexer::END_ANNOTATION_DIRECTIVE :
+        case SmaliLexer::ENUM_DIRECTIVE :
+        case SmaliLexer::METHOD_DIRECTIVE :
+        case SmaliLexer::END_METHOD_DIRECTIVE :
+        case SmaliLexer::REGISTERS_DIRECTIVE :
+        case SmaliLexer::LOCALS_DIRECTIVE :
+        case SmaliLexer::ARRAY_DATA_DIRECTIVE :
+        case SmaliLexer::END_ARRAY_DATA_DIRECTIVE :
+        case SmaliLexer::PACKED_SWITCH_DIRECTIVE :
+        case SmaliLexer::END_PACKED_SWITCH_DIRECTIVE :
+        case SmaliLexer::SPARSE_SWITCH_DIRECTIVE :
+        case SmaliLexer::END_SPARSE_SWITCH_DIRECTIVE :
+        case SmaliLexer::CATCH_DIRECTIVE :
+        case SmaliLexer::CATCHALL_DIRECTIVE :
+        case SmaliLexer::LINE_DIRECTIVE :
+        case SmaliLexer::PARAMETER_DIRECTIVE :
+        case SmaliLexer::END_PARAMETER_DIRECTIVE :
+        case SmaliLexer::LOCAL_DIRECTIVE :
+        case SmaliLexer::END_LOCAL_DIRECTIVE :
+        case SmaliLexer::RESTART_LOCAL_DIRECTIVE :
+        case SmaliLexer::PROLOGUE_DIRECTIVE :
+        case SmaliLexer::EPILOGUE_DIRECTIVE :
+            return KSyntaxHighlighting::Theme::Keyword;
+        case SmaliLexer::POSITIVE_INTEGER_LITERAL :
+        case SmaliLexer::NEGATIVE_INTEGER_LITERAL :
+        case SmaliLexer::LONG_LITERAL :
+        case SmaliLexer::SHORT_LITERAL :
+        case SmaliLexer::BYTE_LITERAL :
+            return KSyntaxHighlighting::Theme::BaseN;
+        case SmaliLexer::FLOAT_LITERAL_OR_ID :
+        case SmaliLexer::DOUBLE_LITERAL_OR_ID :
+        case SmaliLexer::FLOAT_LITERAL :
+        case SmaliLexer::DOUBLE_LITERAL :
+            return KSyntaxHighlighting::Theme::Float;
+        case SmaliLexer::BOOL_LITERAL :
+        case SmaliLexer::NULL_LITERAL :
+            return KSyntaxHighlighting::Theme::DecVal;
+        case SmaliLexer::REGISTER :
+            return KSyntaxHighlighting::Theme::Variable;
+        case SmaliLexer::ANNOTATION_VISIBILITY :
+            return KSyntaxHighlighting::Theme::Annotation;
+        case SmaliLexer::ACCESS_SPEC :
+        case SmaliLexer::INLINE_INDEX :
+        case SmaliLexer::VTABLE_INDEX :
+        case SmaliLexer::FIELD_INDEX :
+            return KSyntaxHighlighting::Theme::Variable;
+        case SmaliLexer::LINE_COMMENT :
+            return KSyntaxHighlighting::Theme::Comment;
+        case SmaliLexer::INSTRUCTION_FORMAT10t :
+        case SmaliLexer::INSTRUCTION_FORMAT10x :
+        case SmaliLexer::INSTRUCTION_FORMAT10x_ODEX :
+        case SmaliLexer::INSTRUCTION_FORMAT11n :
+        case SmaliLexer::INSTRUCTION_FORMAT11x :
+        case SmaliLexer::INSTRUCTION_FORMAT12x_OR_ID :
+        case SmaliLexer::INSTRUCTION_FORMAT12x :
+        case SmaliLexer::INSTRUCTION_FORMAT20bc :
+        case SmaliLexer::INSTRUCTION_FORMAT20t :
+        case SmaliLexer::INSTRUCTION_FORMAT21c_FIELD :
+        case SmaliLexer::INSTRUCTION_FORMAT21c_FIELD_ODEX :
+        case SmaliLexer::INSTRUCTION_FORMAT21c_STRING :
+        case SmaliLexer::INSTRUCTION_FORMAT21c_TYPE :
+        case SmaliLexer::INSTRUCTION_FORMAT21ih :
+        case SmaliLexer::INSTRUCTION_FORMAT21lh :
+        case SmaliLexer::INSTRUCTION_FORMAT21s :
+        case SmaliLexer::INSTRUCTION_FORMAT21t :
+        case SmaliLexer::INSTRUCTION_FORMAT22b :
+        case SmaliLexer::INSTRUCTION_FORMAT22c_FIELD :
+        case SmaliLexer::INSTRUCTION_FORMAT22c_FIELD_ODEX :
+        case SmaliLexer::INSTRUCTION_FORMAT22c_TYPE :
+        case SmaliLexer::INSTRUCTION_FORMAT22cs_FIELD :
+        case SmaliLexer::INSTRUCTION_FORMAT22s_OR_ID :
+        case SmaliLexer::INSTRUCTION_FORMAT22s :
+        case SmaliLexer::INSTRUCTION_FORMAT22t :
+        case SmaliLexer::INSTRUCTION_FORMAT22x :
+        case SmaliLexer::INSTRUCTION_FORMAT23x :
+        case SmaliLexer::INSTRUCTION_FORMAT30t :
+        case SmaliLexer::INSTRUCTION_FORMAT31c :
+        case SmaliLexer::INSTRUCTION_FORMAT31i_OR_ID :
+        case SmaliLexer::INSTRUCTION_FORMAT31i :
+        case SmaliLexer::INSTRUCTION_FORMAT31t :
+        case SmaliLexer::INSTRUCTION_FORMAT32x :
+        case SmaliLexer::INSTRUCTION_FORMAT35c_METHOD :
+        case SmaliLexer::INSTRUCTION_FORMAT35c_METHOD_ODEX :
+        case SmaliLexer::INSTRUCTION_FORMAT35c_TYPE :
+        case SmaliLexer::INSTRUCTION_FORMAT35mi_METHOD :
+        case SmaliLexer::INSTRUCTION_FORMAT35ms_METHOD :
+        case SmaliLexer::INSTRUCTION_FORMAT3rc_METHOD :
+        case SmaliLexer::INSTRUCTION_FORMAT3rc_METHOD_ODEX :
+        case SmaliLexer::INSTRUCTION_FORMAT3rc_TYPE :
+        case SmaliLexer::INSTRUCTION_FORMAT3rmi_METHOD :
+        case SmaliLexer::INSTRUCTION_FORMAT3rms_METHOD :
+        case SmaliLexer::INSTRUCTION_FORMAT45cc_METHOD :
+        case SmaliLexer::INSTRUCTION_FORMAT4rcc_METHOD :
+        case SmaliLexer::INSTRUCTION_FORMAT51l :
+            return KSyntaxHighlighting::Theme::BuiltIn;
+        case SmaliLexer::SIMPLE_NAME :
+        case SmaliLexer::MEMBER_NAME :
+            return KSyntaxHighlighting::Theme::Function;
+        case SmaliLexer::DOTDOT :
+        case SmaliLexer::ARROW :
+        case SmaliLexer::EQUAL :
+        case SmaliLexer::COLON :
+        case SmaliLexer::COMMA :
+        case SmaliLexer::OPEN_BRACE :
+        case SmaliLexer::CLOSE_BRACE :
+        case SmaliLexer::OPEN_PAREN :
+        case SmaliLexer::CLOSE_PAREN :
+            return KSyntaxHighlighting::Theme::Operator;
+        case SmaliLexer::STRING_LITERAL :
+        case SmaliLexer::STRING_ESCAPE :
+        case SmaliLexer::STRING_ESCAPEERROR :
+        case SmaliLexer::STRING_UTFERROR :
+        case SmaliLexer::STRING_END :
+        case SmaliLexer::STRING_FILEEND :
+            return KSyntaxHighlighting::Theme::String;
+        case SmaliLexer::CHAR_LITERAL :
+        case SmaliLexer::CHAR_ESCAPE :
+        case SmaliLexer::CHAR_ESCAPEERROR :
+        case SmaliLexer::CHAR_UTFERROR :
+        case SmaliLexer::CHAR_END :
+        case SmaliLexer::CHAR_FILEEND :
+            return KSyntaxHighlighting::Theme::Char;
+        case SmaliLexer::PRIMITIVE_TYPE :
+        case SmaliLexer::VOID_TYPE :
+            return KSyntaxHighlighting::Theme::Constant;
+        case SmaliLexer::CLASS_DESCRIPTOR :
+            return KSyntaxHighlighting::Theme::DataType;
+        case SmaliLexer::ARRAY_TYPE_PREFIX :
+            return KSyntaxHighlighting::Theme::SpecialString;
+        case SmaliLexer::TYPE_LIST_EOF :
+        case SmaliLexer::INVALID_TOKEN :
+        case SmaliLexer::VERIFICATION_ERROR_TYPE :
+        default:
+            return KSyntaxHighlighting::Theme::Error;
     }
 }
 
@@ -232,9 +303,14 @@ void SmaliHighlight::setTheme(const KSyntaxHighlighting::Theme &theme)
         font.setUnderline(m_theme.isUnderline(style));
         font.setStrikeOut(m_theme.isStrikeThrough(style));
         format.setFont(font);
+        format.setProperty(kStyleProperty, (int)style);
 
         mFormatMap[style] = format;
     }
+
+    m_restyle = true;
+    rehighlight();
+    m_restyle = false;
 }
 
 
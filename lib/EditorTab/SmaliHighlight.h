@@ -9,6 +9,13 @@
 //
 // SmaliHighlight is used to highlight smali file
 //
+// Tokens of a block are read from the SmaliTokenCache of the document, the
+// cache has scanned the edited blocks when they are highlighted.
+// Blocks tokenized in background are formatted later, the visible ones at
+// once and the others in short slices when the event loop is idle.
+// Formats carry their text style, a theme change restyles the existing
+// format ranges without lexing again.
+//
 //===----------------------------------------------------------------------===//
 
 
@@ -19,22 +26,50 @@
 #include <Theme>
 
 #include <QSyntaxHighlighter>
+#include <QTimer>
 
+class SmaliTokenCache;
 
 class SmaliHighlight: public QSyntaxHighlighter {
 Q_OBJECT
 
 public:
-    SmaliHighlight(QTextDocument *parent);
+    SmaliHighlight(QTextDocument *parent, SmaliTokenCache *tokenCache);
 
     ~SmaliHighlight();
 
+    // set theme and restyle the whole document
     void setTheme(const KSyntaxHighlighting::Theme &theme);
 
+    // format blocks scanned in background, count blocks from first now and
+    // the rest of the document in idle time
+    void formatScanned(const QTextBlock &first, int count);
+    // format count blocks from first now if they are not formatted yet
+    void formatBlocks(const QTextBlock &first, int count);
+    bool isFormatting() const { return m_idleTimer.isActive(); }
+
 protected:
     void highlightBlock(const QString &text) Q_DECL_OVERRIDE;
 
+private slots:
+    void formatIdleSlice();
+
 private:
+    void formatTokens();
+    bool needsFormat(const QTextBlock &block) const;
+    bool restyleBlock();
+
+    static KSyntaxHighlighting::Theme::TextStyle tokenStyle(size_t type);
+
+    SmaliTokenCache *m_tokenCache;
+
+    // next block to check in idle time
+    QTimer m_idleTimer;
+    int m_idleBlock = 0;
+
+    // rehighlight for theme change, the text is not changed
+    bool m_restyle = false;
+
     KSyntaxHighlighting::Theme m_theme;
 
     QMap<KSyntaxHighlighting::Theme::TextStyle, QTextCharFormat> mFormatMap;
@@ -10,11 +10,14 @@
 
 #include "SmaliOpInformation.h"
 #include "SmaliLexer.h"
+#include "SmaliTokenCache.h"
+
+#include "EditorTab/SmaliEditor.h"
 
 
 #include <QTextBlock>
 
-SmaliOpInformation::SmaliOpInformation(QPlainTextEdit *parent):
+SmaliOpInformation::SmaliOpInformation(SmaliEditor *parent):
     QLineEdit(parent),
     m_edit(parent)
 {
@@ -24,15 +27,15 @@ SmaliOpInformation::SmaliOpInformation(QPlainTextEdit *parent):
 
 void SmaliOpInformation::cursorChanged() {
     QTextBlock tb = m_edit->textCursor ().block ();
-    std::string blockText = tb.text ().toStdString ();
-    antlr4::ANTLRInputStream input(blockText);
-    SmaliLexer lexer(&input);
-    auto token = lexer.nextToken();
-    if(token->getType() > SmaliLexer::TYPE_LIST_EOF)
+    auto &tokens = m_edit->tokenCache()->tokens(tb);
+    if(tokens.isEmpty())
         return;
 
 
-    setText(getOpInformation(QString::fromStdString(token->getText())));
+    auto &token = tokens.first();
+    if(token.m_type > SmaliLexer::TYPE_LIST_EOF)
+        return;
+    setText(getOpInformation(tb.text().mid(token.m_start, token.m_length)));
 }
 
 QString SmaliOpInformation::getOpInformation(QString token) {
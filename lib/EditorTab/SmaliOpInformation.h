@@ -16,19 +16,20 @@
 #define ANDROIDREVERSETOOLKIT_SMALIOPINFORMATION_H
 
 #include <QLineEdit>
-#include <QPlainTextEdit>
+
+class SmaliEditor;
 
 class SmaliOpInformation: public QLineEdit {
     Q_OBJECT
 public:
-    SmaliOpInformation(QPlainTextEdit* parent);
+    SmaliOpInformation(SmaliEditor* parent);
 
 protected slots:
     void cursorChanged();
 
     static QString getOpInformation(QString token);
 private:
-    QPlainTextEdit* m_edit;
+    SmaliEditor* m_edit;
 };
 
 
@@ -0,0 +1,280 @@
+//===- SmaliTokenCache.cpp - ART-GUI Editor Tab ----------------*- C++ -*-===//
+//
+//                     ANDROID REVERSE TOOLKIT
+//
+// This file is distributed under the GNU GENERAL PUBLIC LICENSE
+// V3 License. See LICENSE.TXT for details.
+//
+//===---------------------------------------------------------------------===//
+#include "SmaliLexer.h"
+#include "Utf16InputStream.h"
+
+#include "SmaliTokenCache.h"
+
+#include "SmaliAnalysis/SmaliFile.h"
+
+#include <QTextDocument>
+#include <QtConcurrent/QtConcurrent>
+
+#include <algorithm>
+
+// tokens scanned at a time
+static const int kTokenBatch = 64;
+// a change of more lines is tokenized on a worker thread
+static const int kBackgroundLines = 1000;
+
+// Token source of the parser built from the cached tokens of a document.
+// Token indexes are document positions, the same as the indexes of a
+// Utf16InputStream loaded with the plain text of the document.
+class SmaliCachedTokenSource: public antlr4::TokenSource {
+public:
+    SmaliCachedTokenSource(const QTextDocument *document,
+                           const QVector<SmaliTokenCache::Line> &lines)
+            : m_block(document->begin()), m_lines(lines)
+    {
+        m_input.load(document->toPlainText());
+    }
+
+    std::unique_ptr<antlr4::Token> nextToken() override {
+        while(m_line < m_lines.size() && m_block.isValid()) {
+            auto &tokens = m_lines.at(m_line).m_tokens;
+            while(m_index < tokens.size()) {
+                auto &token = tokens.at(m_index++);
+                if(token.m_type == SmaliLexer::LINE_COMMENT) {
+                    // the parser has no rule for comments
+                    continue;
+                }
+                auto start = (size_t)(m_block.position() + token.m_start);
+                return m_factory->create({this, &m_input}, token.m_type, "",
+                                         antlr4::Token::DEFAULT_CHANNEL,
+                                         start, start + token.m_length - 1,
+                                         (size_t)m_line + 1, (size_t)token.m_start);
+            }
+            m_line++;
+            m_index = 0;
+            m_block = m_block.next();
+        }
+        auto end = m_input.size();
+        return m_factory->create({this, &m_input}, antlr4::Token::EOF, "EOF",
+                                 antlr4::Token::DEFAULT_CHANNEL, end, end - 1,
+                                 (size_t)qMax(m_line, 1), 0);
+    }
+
+    size_t getLine() const override { return (size_t)m_line + 1; }
+    size_t getCharPositionInLine() override { return 0; }
+    antlr4::CharStream* getInputStream() override { return &m_input; }
+    std::string getSourceName() override { return m_input.getSourceName(); }
+    Ref<antlr4::TokenFactory<antlr4::CommonToken>> getTokenFactory() override {
+        return m_factory;
+    }
+
+private:
+    Utf16InputStream m_input;
+    QTextBlock m_block;
+    const QVector<SmaliTokenCache::Line> &m_lines;
+    int m_line = 0;
+    int m_index = 0;
+    Ref<antlr4::TokenFactory<antlr4::CommonToken>> m_factory
+            = antlr4::CommonTokenFactory::DEFAULT;
+};
+
+SmaliTokenCache::SmaliTokenCache(QTextDocument *document)
+        : QObject(document),
+          m_document(document)
+{
+    connect(&m_scanWatcher, &QFutureWatcher<TokenLines>::finished,
+            this, &SmaliTokenCache::scanFinished);
+    rebuild();
+    connect(document, &QTextDocument::contentsChange, this, &SmaliTokenCache::contentsChange);
+}
+
+SmaliTokenCache::~SmaliTokenCache()
+{
+    if(!m_scanCanceled.isNull()) {
+        m_scanCanceled->store(1);
+    }
+}
+
+const QVector<SmaliToken>& SmaliTokenCache::tokens(const QTextBlock &block) const
+{
+    static const QVector<SmaliToken> kEmpty;
+    auto number = block.blockNumber();
+    if(number < 0 || number >= m_lines.size()) {
+        return kEmpty;
+    }
+    return m_lines.at(number).m_tokens;
+}
+
+size_t SmaliTokenCache::firstTokenType(const QTextBlock &block) const
+{
+    auto &line = tokens(block);
+    return line.isEmpty() ? 0 : line.first().m_type;
+}
+
+SmaliFile *SmaliTokenCache::parse(const QString &filepath)
+{
+    // a finished scan may start the next one for lines added meanwhile
+    while(isScanning() && !m_scanCanceled.isNull()) {
+        m_scanWatcher.waitForFinished();
+        scanFinished();
+    }
+    SmaliCachedTokenSource source(m_document, m_lines);
+    return new SmaliFile(filepath, source);
+}
+
+void SmaliTokenCache::contentsChange(int position, int charsRemoved, int charsAdded)
+{
+    Q_UNUSED(charsRemoved);
+    auto first = m_document->findBlock(position);
+    // the change may be reported up to the last paragraph separator
+    auto end = qMin(position + charsAdded, m_document->characterCount() - 1);
+    auto last = m_document->findBlock(end);
+    if(!first.isValid() || !last.isValid()) {
+        rebuild();
+        return;
+    }
+
+    // blocks first..last replace the old blocks of the changed range, the
+    // difference of the block count is the number of blocks added.
+    auto firstNumber = first.blockNumber();
+    auto lastNumber = last.blockNumber();
+    auto oldLast = lastNumber - (m_document->blockCount() - m_lines.size());
+    if(oldLast < firstNumber - 1 || oldLast >= m_lines.size()) {
+        rebuild();
+        return;
+    }
+
+    replaceLines(firstNumber, oldLast - firstNumber + 1, first, lastNumber - firstNumber + 1);
+}
+
+void SmaliTokenCache::rebuild()
+{
+    m_lines.clear();
+    m_pendingCount = 0;
+    replaceLines(0, 0, m_document->begin(), m_document->blockCount());
+}
+
+void SmaliTokenCache::replaceLines(int first, int removed, QTextBlock block, int added)
+{
+    auto background = added >= kBackgroundLines;
+    QVector<Line> lines(added);
+    for(auto &line: lines) {
+        if(background) {
+            line.m_pending = true;
+        } else {
+            line.m_tokens = tokenize(block);
+        }
+        block = block.next();
+    }
+
+    for(auto i = first; i < first + removed; i++) {
+        if(m_lines.at(i).m_pending) {
+            m_pendingCount--;
+        }
+    }
+    m_lines.remove(first, removed);
+    m_lines.insert(first, added, Line());
+    std::move(lines.begin(), lines.end(), m_lines.begin() + first);
+    if(background) {
+        m_pendingCount += added;
+    }
+
+    if(!m_scanCanceled.isNull()) {
+        if(!m_scanBlocks.isEmpty() && m_scanBlocks.last() < first + removed) {
+            // block numbers of the running scan stay, lines removed from it
+            // are skipped when it finishes and the added ones scanned next
+            if(background && (m_nextScanFrom < 0 || first < m_nextScanFrom)) {
+                m_nextScanFrom = first;
+            }
+            return;
+        }
+        // block numbers of the running scan are moved
+        m_scanCanceled->store(1);
+        m_scanCanceled.clear();
+    }
+    if(m_pendingCount > 0) {
+        startScan(0);
+    }
+}
+
+void SmaliTokenCache::startScan(int from)
+{
+    QVector<QString> texts;
+    m_scanBlocks.clear();
+    m_scanId++;
+    m_nextScanFrom = -1;
+    auto block = m_document->findBlockByNumber(from);
+    for(auto i = from; i < m_lines.size() && block.isValid(); i++, block = block.next()) {
+        auto &line = m_lines[i];
+        if(line.m_pending) {
+            line.m_scan = m_scanId;
+            m_scanBlocks.push_back(i);
+            texts.push_back(block.text());
+        }
+    }
+    m_scanCanceled = QSharedPointer<QAtomicInt>::create(0);
+    m_scanWatcher.setFuture(QtConcurrent::run(tokenizeTexts, texts, m_scanCanceled));
+}
+
+void SmaliTokenCache::scanFinished()
+{
+    // finished after it is canceled, or already taken by parse()
+    if(m_scanCanceled.isNull() || m_scanCanceled->load() != 0) {
+        return;
+    }
+    m_scanCanceled.clear();
+    auto result = m_scanWatcher.result();
+    if(result.size() != m_scanBlocks.size()) {
+        return;
+    }
+    for(auto i = 0; i < result.size(); i++) {
+        auto number = m_scanBlocks.at(i);
+        // lines replaced during the scan are not handed to it any more
+        if(number >= m_lines.size() || m_lines.at(number).m_scan != m_scanId) {
+            continue;
+        }
+        auto &line = m_lines[number];
+        line.m_tokens = result.at(i);
+        line.m_pending = false;
+        line.m_scan = 0;
+        m_pendingCount--;
+    }
+    m_scanBlocks.clear();
+    if(m_pendingCount > 0) {
+        startScan(qMax(m_nextScanFrom, 0));
+    }
+    tokensReady();
+}
+
+SmaliTokenCache::TokenLines SmaliTokenCache::tokenizeTexts(QVector<QString> texts,
+                                                           QSharedPointer<QAtomicInt> canceled)
+{
+    TokenLines lines;
+    lines.reserve(texts.size());
+    for(auto i = 0; i < texts.size(); i++) {
+        if(canceled->load() != 0) {
+            return TokenLines();
+        }
+        lines.push_back(tokenize(texts.at(i)));
+    }
+    return lines;
+}
+
+QVector<SmaliToken> SmaliTokenCache::tokenize(const QTextBlock &block)
+{
+    return tokenize(block.text());
+}
+
+QVector<SmaliToken> SmaliTokenCache::tokenize(const QString &text)
+{
+    QVector<SmaliToken> result;
+    SmaliTokenizer tokenizer(text);
+    SmaliToken tokens[kTokenBatch];
+    for(auto count = tokenizer.next(tokens, kTokenBatch); count > 0;
+        count = tokenizer.next(tokens, kTokenBatch)) {
+        for(auto i = 0; i < count; i++) {
+            result.push_back(tokens[i]);
+        }
+    }
+    return result;
+}
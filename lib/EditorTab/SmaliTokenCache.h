@@ -0,0 +1,112 @@
+//===- SmaliTokenCache.h - ART-GUI Editor Tab ------------------*- C++ -*-===//
+//
+//                     ANDROID REVERSE TOOLKIT
+//
+// This file is distributed under the GNU GENERAL PUBLIC LICENSE
+// V3 License. See LICENSE.TXT for details.
+//
+//===---------------------------------------------------------------------===//
+//
+// SmaliTokenCache keeps the SmaliTokenizer tokens of every line of a smali
+// document. Lines touched by an edit are tokenized again when the document
+// reports the change, so the highlighter, the op information, folding and
+// the analysis of saved content share one lexing of each edit.
+//
+// The cache must connect to the document before the highlighter does, the
+// tokens of an edit are then ready when the edited blocks are highlighted.
+//
+// A change of many lines, like loading a file, is tokenized on a worker
+// thread. Those lines have no token until tokensReady() is signaled, and an
+// edit in the meantime cancels the scan and starts it again for the lines
+// still waiting. Lines added after those of the running scan, like the chunks
+// of a file being loaded, do not cancel it and are scanned when it finishes.
+//
+//===----------------------------------------------------------------------===//
+
+
+#ifndef ANDROIDREVERSETOOLKIT_SMALITOKENCACHE_H
+#define ANDROIDREVERSETOOLKIT_SMALITOKENCACHE_H
+
+#include "SmaliTokenizer.h"
+
+#include <QAtomicInt>
+#include <QFutureWatcher>
+#include <QObject>
+#include <QSharedPointer>
+#include <QTextBlock>
+#include <QVector>
+
+class QTextDocument;
+class SmaliFile;
+
+class SmaliTokenCache: public QObject {
+Q_OBJECT
+
+public:
+    explicit SmaliTokenCache(QTextDocument *document);
+    ~SmaliTokenCache();
+
+    // tokens of block, empty for a block the cache does not know
+    const QVector<SmaliToken>& tokens(const QTextBlock &block) const;
+    // SmaliLexer type of the first token of block, 0 for a blank line
+    size_t firstTokenType(const QTextBlock &block) const;
+
+    /**
+     * parse the document with the cached tokens instead of lexing it again.
+     * Call it right after the document is saved to filepath, the file state
+     * is recorded like a file parsed from disk.
+     * @param filepath
+     * @return new SmaliFile, owned by the caller
+     */
+    SmaliFile* parse(const QString &filepath);
+
+    // blocks are waiting for the background scan
+    bool isScanning() const { return m_pendingCount > 0; }
+
+signals:
+    // the background scan finished, pending blocks have their tokens now
+    void tokensReady();
+
+private slots:
+    void contentsChange(int position, int charsRemoved, int charsAdded);
+    void scanFinished();
+
+private:
+    typedef QVector<QVector<SmaliToken>> TokenLines;
+
+    struct Line {
+        QVector<SmaliToken> m_tokens;
+        // waiting for the background scan
+        bool m_pending = false;
+        // id of the scan the pending line is handed to
+        int m_scan = 0;
+    };
+
+    void rebuild();
+    // replace removed lines from first with added blocks from block
+    void replaceLines(int first, int removed, QTextBlock block, int added);
+    // scan pending lines from line from on
+    void startScan(int from);
+    static QVector<SmaliToken> tokenize(const QTextBlock &block);
+    static QVector<SmaliToken> tokenize(const QString &text);
+    static TokenLines tokenizeTexts(QVector<QString> texts,
+                                    QSharedPointer<QAtomicInt> canceled);
+
+    QTextDocument *m_document;
+    // tokens of each block by block number
+    QVector<Line> m_lines;
+
+    int m_pendingCount = 0;
+    // block numbers of the running scan, in the order of its result
+    QVector<int> m_scanBlocks;
+    int m_scanId = 0;
+    // first line added as pending during the running scan, -1 for none
+    int m_nextScanFrom = -1;
+    QSharedPointer<QAtomicInt> m_scanCanceled;
+    QFutureWatcher<TokenLines> m_scanWatcher;
+
+    friend class SmaliCachedTokenSource;
+};
+
+
+#endif //ANDROIDREVERSETOOLKIT_SMALITOKENCACHE_H
@@ -17,9 +17,17 @@
 #include <QTextBlock>
 #include <QPainter>
 #include <QDebug>
+#include <QMultiHash>
 #include <QShortcut>
 #include <BookMark/BookMarkManager.h>
 
+#include <cstring>
+
+// files of this size or more are mapped and loaded in chunks
+static const qint64 kLargeFileSize = 4 * 1024 * 1024;
+// lines added to the document at a time while loading a large file
+static const int kLoadChunkLines = 4000;
+
 TextEditor::TextEditor(QWidget *parent) :
         QPlainTextEdit(parent),
         m_sideBar(new TextEditorSidebar(this))
@@ -29,6 +37,9 @@ TextEditor::TextEditor(QWidget *parent) :
 
     resetTheme(QStringList());
     m_sideBarUpdateTimer.setSingleShot(true);
+    m_loadTimer.setSingleShot(true);
+    m_loadTimer.setInterval(0);
+    connect(&m_loadTimer, &QTimer::timeout, this, &TextEditor::loadNextChunk);
 
     connect(document(), &QTextDocument::contentsChange, this, &TextEditor::editorContentsChange);
 
@@ -49,7 +60,7 @@ TextEditor::TextEditor(QWidget *parent) :
 
 TextEditor::~TextEditor()
 {
-
+    finishLoading();
 }
 
 void TextEditor::setSidebar(TextEditorSidebar *sidebar)
@@ -63,6 +74,7 @@ void TextEditor::setSidebar(TextEditorSidebar *sidebar)
 
 bool TextEditor::openFile(const QString &fileName, int iLine)
 {
+    finishLoading();
     QFile f(fileName);
     if (!f.open(QFile::ReadOnly)) {
         qWarning() << "Failed to open" << fileName << ":" << f.errorString();
@@ -73,13 +85,110 @@ bool TextEditor::openFile(const QString &fileName, int iLine)
 
     setDocumentTitle(fileName);
     m_filePath = fileName;
+    // marks of the file are placed again when it is loaded
+    m_marks.clear();
+    if(f.size() >= kLargeFileSize && openLargeFile(iLine)) {
+        return true;
+    }
     setPlainText(QString::fromUtf8(f.readAll()));
     gotoLine(iLine, 0, false);
 
-    readBookMark();
+    fileLoaded();
+    return true;
+}
+
+bool TextEditor::openLargeFile(int iLine)
+{
+    m_loadFile.setFileName(m_filePath);
+    if(!m_loadFile.open(QFile::ReadOnly)) {
+        return false;
+    }
+    m_loadSize = m_loadFile.size();
+    m_loadData = m_loadFile.map(0, m_loadSize);
+    if(m_loadData == nullptr) {
+        m_loadFile.close();
+        return false;
+    }
+
+    auto data = (const char*)m_loadData;
+    auto end = data + m_loadSize;
+    m_lineOffsets.clear();
+    m_lineOffsets.push_back(0);
+    for(auto p = (const char*)memchr(data, '\n', m_loadSize); p != nullptr;
+        p = (const char*)memchr(p, '\n', end - p)) {
+        ++p;
+        m_lineOffsets.push_back(p - data);
+    }
+    m_loadedLines = 0;
+
+    // nothing to undo, and nothing to edit before the file is complete
+    document()->setUndoRedoEnabled(false);
+    setReadOnly(true);
+
+    appendLines(iLine + kLoadChunkLines);
+    gotoLine(iLine, 0, false);
+    m_loadTimer.start();
     return true;
 }
 
+void TextEditor::appendLines(int count)
+{
+    auto lines = m_lineOffsets.size();
+    auto last = qMin(m_loadedLines + count, lines);
+    if(last <= m_loadedLines) {
+        return;
+    }
+    // chunks end after a line break, a character is never split
+    auto begin = m_lineOffsets.at(m_loadedLines);
+    auto end = last < lines ? m_lineOffsets.at(last) : m_loadSize;
+    auto text = QString::fromUtf8((const char*)m_loadData + begin, (int)(end - begin));
+    if(m_loadedLines == 0) {
+        setPlainText(text);
+    } else {
+        QTextCursor cursor(document());
+        cursor.movePosition(QTextCursor::End);
+        cursor.insertText(text);
+    }
+    m_loadedLines = last;
+    document()->setModified(false);
+}
+
+void TextEditor::loadNextChunk()
+{
+    if(!isLoading()) {
+        return;
+    }
+    appendLines(kLoadChunkLines);
+    if(m_loadedLines < m_lineOffsets.size()) {
+        m_loadTimer.start();
+        return;
+    }
+    finishLoading();
+    fileLoaded();
+}
+
+void TextEditor::finishLoading()
+{
+    if(!isLoading()) {
+        return;
+    }
+    m_loadTimer.stop();
+    m_loadFile.unmap((uchar*)m_loadData);
+    m_loadFile.close();
+    m_loadData = nullptr;
+    m_lineOffsets.clear();
+    m_lineOffsets.squeeze();
+    m_loadedLines = 0;
+
+    document()->setUndoRedoEnabled(true);
+    setReadOnly(false);
+}
+
+void TextEditor::fileLoaded()
+{
+    readBookMark();
+}
+
 void TextEditor::resizeEvent(QResizeEvent *event)
 {
     QPlainTextEdit::resizeEvent(event);
@@ -146,6 +255,11 @@ void TextEditor::sidebarPaintEvent(QPaintEvent *event)
 
     const auto foldingMarkerSize = fontMetrics().lineSpacing();
 
+    QMultiHash<int, TextMark*> marks;
+    for(auto &anchor: m_marks) {
+        marks.insert(anchor.m_cursor.blockNumber(), anchor.m_mark);
+    }
+
     while (block.isValid() && top <= event->rect().bottom()) {
         if(block.isVisible()) {
             if(bottom >= event->rect().top()) {
@@ -157,8 +271,7 @@ void TextEditor::sidebarPaintEvent(QPaintEvent *event)
             }
 
             // marks
-            auto userdata = blockData(block);
-            for(auto mark: userdata->m_marks) {
+            for(auto mark: marks.values(blockNumber)) {
                 mark->paint(&painter, QRect(0, top, foldingMarkerSize, foldingMarkerSize));
             }
 
@@ -238,7 +351,8 @@ QTextBlock TextEditor::blockAtPosition(int y) const
 }
 
 QTextBlock TextEditor::blockAtLine(int l) const {
-    return document()->findBlockByLineNumber(l - 1);
+    // lines are block numbers, folded blocks have no layout line
+    return document()->findBlockByNumber(l - 1);
 }
 
 bool TextEditor::isFoldable(const QTextBlock &block) const
@@ -290,8 +404,11 @@ void TextEditor::toggleFold(const QTextBlock &startBlock)
 }
 
 void TextEditor::gotoLine(int line, int column, bool centerLine) {
+    if(isLoading() && line > m_loadedLines) {
+        appendLines(line - m_loadedLines + kLoadChunkLines);
+    }
     const int blockNumber = qMin(line, document()->blockCount()) - 1;
-    const QTextBlock &block = document()->findBlockByLineNumber(blockNumber);
+    const QTextBlock &block = document()->findBlockByNumber(blockNumber);
     if (block.isValid()) {
         QTextCursor cursor(block);
         if (column > 0) {
@@ -339,18 +456,6 @@ bool TextEditor::reload()
     return openFile(m_filePath, currentLine());
 }
 
-UserBlockExtraData *TextEditor::blockData(QTextBlock &block) {
-    auto userdata = (KSyntaxHighlighting::TextBlockUserData*)block.userData();
-    if(userdata == nullptr) {
-        userdata = new KSyntaxHighlighting::TextBlockUserData();
-        block.setUserData(userdata);
-    }
-    if(userdata->data == nullptr) {
-        userdata->data = new UserBlockExtraData();
-    }
-    return (UserBlockExtraData *)userdata->data;
-}
-
 void TextEditor::toggleBookmark() {
     BookMarkManager::instance()->toggleBookmark(m_filePath, currentLine());
     m_sideBarUpdateTimer.start(500);
@@ -378,20 +483,19 @@ void TextEditor::readBookMark() {
 }
 
 void TextEditor::updateTextMark(TextMark *textMark, bool add) {
-    auto line = textMark->lineNumber();
-    auto block = blockAtLine(line);
-    if(!block.isValid()) {
-        return;
-    }
-    auto data = blockData(block);
-    if(add == data->m_marks.contains(textMark)) {
+    auto index = indexOfMark(textMark);
+    if(add == (index >= 0)) {
         return;
     }
     if(add) {
-        data->m_marks.push_back(textMark);
+        auto block = blockAtLine(textMark->lineNumber());
+        if(!block.isValid()) {
+            return;
+        }
+        m_marks.push_back({textMark, QTextCursor(block)});
         textMark->updateBlock(block);
     } else {
-        data->m_marks.removeOne(textMark);
+        m_marks.removeAt(index);
     }
 
     m_sideBarUpdateTimer.start(500);
@@ -399,6 +503,10 @@ void TextEditor::updateTextMark(TextMark *textMark, bool add) {
 
 void TextEditor::editorContentsChange(int position, int charsRemoved,
                                       int charsAdded) {
+    if(isLoading()) {
+        // marks are placed when the file is loaded
+        return;
+    }
     QTextDocument *doc = document();
     QTextBlock posBlock = doc->findBlock(position);
 
@@ -420,23 +528,27 @@ void TextEditor::editorContentsChange(int position, int charsRemoved,
 }
 
 void TextEditor::updateMarksLineNumber() {
-    QTextBlock block = document()->begin();
-    int blockNumber = 0;
-    while (block.isValid()) {
-        auto userData = blockData(block);
-        for(auto mark: userData->m_marks) {
-            mark->updateLineNumber(blockNumber + 1);
+    // a mark on a removed line moves with its cursor to the joined line
+    for(auto &anchor: m_marks) {
+        anchor.m_mark->updateLineNumber(anchor.m_cursor.blockNumber() + 1);
+    }
+}
+
+void TextEditor::updateMarksBlock(const QTextBlock &block) {
+    for(auto &anchor: m_marks) {
+        if(anchor.m_cursor.block() == block) {
+            anchor.m_mark->updateBlock(block);
         }
-        block = block.next();
-        ++blockNumber;
     }
 }
 
-void TextEditor::updateMarksBlock(QTextBlock &block) {
-    auto userData = blockData(block);
-    for(auto mark: userData->m_marks) {
-        mark->updateBlock(block);
+int TextEditor::indexOfMark(TextMark *textMark) const {
+    for(auto i = 0; i < m_marks.size(); i++) {
+        if(m_marks.at(i).m_mark == textMark) {
+            return i;
+        }
     }
+    return -1;
 }
 
 // -------------------class TextEditorSidebar---------------------------
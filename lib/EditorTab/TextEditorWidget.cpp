@@ -99,7 +99,7 @@ bool TextEditorWidget::openFile(QString filePath, int iLine)
     vLayout->addWidget(mFileEdit);
     vLayout->addWidget(mFindWidget);
     if(filePath.endsWith(".smali")) {
-        vLayout->addWidget(new SmaliOpInformation(mFileEdit));
+        vLayout->addWidget(new SmaliOpInformation(static_cast<SmaliEditor*>(mFileEdit)));
     }
 
     setLayout(vLayout);
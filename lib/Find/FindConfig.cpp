@@ -27,6 +27,7 @@ FindConfig::FindConfig(QWidget *parent) :
     connect(ui->mSearchTerm, SIGNAL(returnPressed()), this, SLOT(onSearchStart()));
     connect(ui->mSearchButton, SIGNAL(clicked(bool)), this, SLOT(onSearchStart()));
     connect(ui->mReplaceButton, SIGNAL(clicked(bool)), this, SLOT(onReplaceStart()));
+    connect(ui->mSymbolCheckBox, SIGNAL(toggled(bool)), this, SLOT(onSymbolToggled(bool)));
 }
 
 FindConfig::~FindConfig()
@@ -56,6 +57,7 @@ void FindConfig::reset (const QString &root, const QString &selectdir)
     ui->mMatchCaseCheckBox->setChecked (false);
     ui->mWholeWordsCheckBox->setChecked (false);
     ui->mRegexpCheckBox->setChecked (false);
+    ui->mSymbolCheckBox->setChecked (false);
 }
 
 void FindConfig::onSearchStart ()
@@ -68,6 +70,15 @@ void FindConfig::onReplaceStart ()
     onSearch(true);
 }
 
+void FindConfig::onSymbolToggled (bool checked)
+{
+    // symbols are matched by their own rules and can not be replaced
+    ui->mMatchCaseCheckBox->setDisabled (checked);
+    ui->mWholeWordsCheckBox->setDisabled (checked);
+    ui->mRegexpCheckBox->setDisabled (checked);
+    ui->mReplaceButton->setDisabled (checked);
+}
+
 void FindConfig::onSearch (bool needReplace)
 {
     QString directory = ui->mFilterList->currentData ().toString ();
@@ -80,6 +91,13 @@ void FindConfig::onSearch (bool needReplace)
         return;
     }
 
+    if(ui->mSymbolCheckBox->isChecked ()) {
+        reset (ui->mFilterList->itemData (0).toString (),
+               ui->mFilterList->itemData (0).toString ());
+        startSymbolFind (findtext, directory);
+        return;
+    }
+
     QTextDocument::FindFlags options = 0;
 
     if(ui->mWholeWordsCheckBox->isChecked ()) {
@@ -33,10 +33,12 @@ public:
 signals:
     void startNewFind(const QString &subString, const QString &directory,
                       QTextDocument::FindFlags options, bool useRegexp, bool needReplace);
+    void startSymbolFind(const QString &query, const QString &directory);
 
 protected slots:
     void onSearchStart();
     void onReplaceStart();
+    void onSymbolToggled(bool checked);
 
 private:
     void onSearch(bool needReplace);
@@ -15,6 +15,7 @@
 
 
 #include "FindConfig.h"
+#include "FindIndex.h"
 #include "FindResult.h"
 
 FindDialog::FindDialog(QWidget *parent) :
@@ -32,6 +33,8 @@ FindDialog::FindDialog(QWidget *parent) :
     connect(ui->mClearButton, SIGNAL(clicked(bool)), this, SLOT(closeAll()));
     connect(mFindConfig, SIGNAL(startNewFind(QString,QString,QTextDocument::FindFlags,bool,bool)),
             this, SLOT(onNewFind(QString,QString,QTextDocument::FindFlags,bool,bool)));
+    connect(mFindConfig, SIGNAL(startSymbolFind(QString,QString)),
+            this, SLOT(onNewSymbolFind(QString,QString)));
 
 
     ScriptEngine* script = ScriptEngine::instance();
@@ -61,12 +64,14 @@ void FindDialog::onProjectOpened (QStringList args)
 {
     QString projectPath = ProjectInfo::current()->getSourcePath();
     mFindConfig->reset (projectPath, projectPath);
+    FindIndex::instance()->open(projectPath);
 }
 
 void FindDialog::onProjectClosed ()
 {
     closeAll ();
     mFindConfig->reset (QString(), QString());
+    FindIndex::instance()->close();
 }
 
 void FindDialog::onFindAdvance (const QString& dir)
@@ -85,6 +90,16 @@ void FindDialog::onFindAdvance (const QString& dir)
 
 }
 
+void FindDialog::onFindSymbol (const QString& query)
+{
+    if(query.trimmed ().isEmpty ()) {
+        return;
+    }
+    // classes read from dex are searchable before the project is opened
+    auto pinfo = ProjectInfo::current();
+    onNewSymbolFind (query, pinfo != nullptr ? pinfo->getSourcePath() : QString());
+}
+
 void FindDialog::onNewFind (const QString &subString,const QString &directory,
                             QTextDocument::FindFlags options,
                             bool useRegexp,bool needReplace)
@@ -97,4 +112,12 @@ void FindDialog::onNewFind (const QString &subString,const QString &directory,
     ui->mHistoryCombobox->setCurrentIndex (1);
 }
 
+void FindDialog::onNewSymbolFind (const QString &query, const QString &directory)
+{
+    auto findresult = new FindResult(this);
+    findresult->startSymbolFind (query, directory);
 
+    ui->mHistoryCombobox->insertItem (1, tr("Symbol: ") + query);
+    ui->mSearchStackedWidget->insertWidget (1, findresult);
+    ui->mHistoryCombobox->setCurrentIndex (1);
+}
@@ -0,0 +1,400 @@
+//===- FindEngine.cpp - ART-GUI Find ---------------------------*- C++ -*-===//
+//
+//                     ANDROID REVERSE TOOLKIT
+//
+// This file is distributed under the GNU GENERAL PUBLIC LICENSE
+// V3 License. See LICENSE.TXT for details.
+//
+//===---------------------------------------------------------------------===//
+
+#include "FindEngine.h"
+
+#include <QFile>
+
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static inline char foldAscii(char c) {
+    return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+static inline char upperAscii(char c) {
+    return c >= 'a' && c <= 'z' ? c - ('a' - 'A') : c;
+}
+
+// find the first byte equal to lower or upper
+static const char* findFirstByte(const char* p, const char* end, char lower, char upper) {
+    if(lower == upper) {
+        return (const char*)memchr(p, lower, end - p);
+    }
+#ifdef __SSE2__
+    auto vlower = _mm_set1_epi8(lower);
+    auto vupper = _mm_set1_epi8(upper);
+    for(; end - p >= 16; p += 16) {
+        auto chunk = _mm_loadu_si128((const __m128i*)p);
+        auto mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, vlower),
+                                                   _mm_cmpeq_epi8(chunk, vupper)));
+        if(mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+#endif
+    for(; p < end; p++) {
+        if(*p == lower || *p == upper) {
+            return p;
+        }
+    }
+    return nullptr;
+}
+
+static bool isAscii(const char* p, qint64 size) {
+    auto end = p + size;
+#ifdef __SSE2__
+    auto bits = _mm_setzero_si128();
+    for(; end - p >= 16; p += 16) {
+        bits = _mm_or_si128(bits, _mm_loadu_si128((const __m128i*)p));
+    }
+    if(_mm_movemask_epi8(bits) != 0) {
+        return false;
+    }
+#endif
+    for(; p < end; p++) {
+        if(*p & 0x80) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool equalAsciiCaseInsensitive(const char* a, const char* b, int size) {
+    for(auto i = 0; i < size; i++) {
+        if(foldAscii(a[i]) != foldAscii(b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// decode one UTF-8 character, invalid data gives the replacement character
+// like QString::fromUtf8.
+static uint decodeUtf8(const char* p, const char* end) {
+    auto c = (uchar)*p;
+    if(c < 0x80) {
+        return c;
+    }
+    int length;
+    uint ucs4;
+    if((c & 0xE0) == 0xC0) {
+        length = 2;
+        ucs4 = c & 0x1F;
+    } else if((c & 0xF0) == 0xE0) {
+        length = 3;
+        ucs4 = c & 0x0F;
+    } else if((c & 0xF8) == 0xF0) {
+        length = 4;
+        ucs4 = c & 0x07;
+    } else {
+        return QChar::ReplacementCharacter;
+    }
+    if(end - p < length) {
+        return QChar::ReplacementCharacter;
+    }
+    for(auto i = 1; i < length; i++) {
+        if(((uchar)p[i] & 0xC0) != 0x80) {
+            return QChar::ReplacementCharacter;
+        }
+        ucs4 = (ucs4 << 6) | ((uchar)p[i] & 0x3F);
+    }
+    return ucs4;
+}
+
+// decode the UTF-8 character ending at p
+static uint decodeUtf8Before(const char* begin, const char* p) {
+    auto q = p - 1;
+    for(auto i = 0; i < 3 && q > begin && ((uchar)*q & 0xC0) == 0x80; i++) {
+        q--;
+    }
+    return decodeUtf8(q, p);
+}
+
+// QTextDocument checks the neighbour UTF-16 unit, a surrogate is never a
+// letter.
+static bool isWordChar(uint ucs4) {
+    return ucs4 <= 0xFFFF && QChar((ushort)ucs4).isLetterOrNumber();
+}
+
+namespace {
+
+// Track the line of a position moving forward. "\n", "\r\n" and "\r" all
+// break a line, like QTextDocument::setPlainText.
+struct LineCursor {
+    LineCursor(const char* data, qint64 size)
+            : end(data + size), lineStart(data)
+    {
+        hasCR = memchr(data, '\r', size) != nullptr;
+        lineEnd = findLineEnd(lineStart);
+    }
+
+    const char* findLineEnd(const char* p) {
+        if(!hasCR) {
+            auto lf = (const char*)memchr(p, '\n', end - p);
+            return lf != nullptr ? lf : end;
+        }
+        while(p < end && *p != '\n' && *p != '\r') {
+            p++;
+        }
+        return p;
+    }
+
+    void moveTo(const char* pos) {
+        while(pos >= lineEnd && lineEnd < end) {
+            lineStart = lineEnd + 1;
+            if(*lineEnd == '\r' && lineStart < end && *lineStart == '\n') {
+                lineStart++;
+            }
+            lineEnd = findLineEnd(lineStart);
+            line++;
+        }
+    }
+
+    const char* end;
+    const char* lineStart;
+    const char* lineEnd;
+    int line = 1;
+    bool hasCR;
+};
+
+// file content, mapped when possible
+struct FileData {
+    FileData(QFile &f) : file(f) {
+        size = file.size();
+        if(size > 0) {
+            mapped = file.map(0, size);
+        }
+        if(mapped != nullptr) {
+            data = (const char*)mapped;
+        } else {
+            buffer = file.readAll();
+            data = buffer.constData();
+            size = buffer.size();
+        }
+    }
+    ~FileData() {
+        if(mapped != nullptr) {
+            file.unmap(mapped);
+        }
+    }
+
+    QFile &file;
+    uchar* mapped = nullptr;
+    QByteArray buffer;
+    const char* data;
+    qint64 size;
+};
+
+}
+
+FindEngine::FindEngine(const QString &subString, QTextDocument::FindFlags options,
+                       bool useRegexp)
+        : mSubString(subString),
+          mPattern(subString.toUtf8()),
+          // QTextDocument ignores FindCaseSensitively for regular expression
+          mRegExp(subString),
+          mUseRegexp(useRegexp)
+{
+    mCaseSensitive = options.testFlag(QTextDocument::FindCaseSensitively);
+    mWholeWords = options.testFlag(QTextDocument::FindWholeWords);
+    mAsciiPattern = isAscii(mPattern.constData(), mPattern.size());
+}
+
+bool FindEngine::useBytes(const char *data, qint64 size) {
+    if(mUseRegexp || mPattern.isEmpty() || mSubString.contains(QChar::Nbsp)) {
+        return false;
+    }
+    // QTextDocument folds case with unicode rules, and matches a space with
+    // non-breaking space. Both only matter for non ASCII text.
+    if(mCaseSensitive && !mSubString.contains(' ')) {
+        return true;
+    }
+    return (mCaseSensitive || mAsciiPattern) && isAscii(data, size);
+}
+
+bool FindEngine::searchFile(const QString &filePath, QList<Match> &matches,
+                            QStringList &lineTexts) {
+    QFile file(filePath);
+    if(!file.open(QFile::ReadOnly)) {
+        return false;
+    }
+    FileData content(file);
+    if(useBytes(content.data, content.size)) {
+        findBytes(content.data, content.size, matches, &lineTexts);
+    } else {
+        findText(QString::fromUtf8(content.data, (int)content.size),
+                 matches, &lineTexts);
+    }
+    return true;
+}
+
+bool FindEngine::replaceFile(const QString &filePath, const QString &replaceWith) {
+    QFile file(filePath);
+    if(!file.open(QFile::ReadOnly)) {
+        return false;
+    }
+
+    QByteArray result;
+    QList<Match> matches;
+    {
+        FileData content(file);
+        if(useBytes(content.data, content.size)) {
+            findBytes(content.data, content.size, matches, nullptr);
+            auto replacement = replaceWith.toUtf8();
+            qint64 last = 0;
+            for(auto &match: matches) {
+                result.append(content.data + last, (int)(match.begin - last));
+                result.append(replacement);
+                last = match.end;
+            }
+            result.append(content.data + last, (int)(content.size - last));
+        } else {
+            auto text = QString::fromUtf8(content.data, (int)content.size);
+            findText(text, matches, nullptr);
+            QString replaced;
+            int last = 0;
+            for(auto &match: matches) {
+                replaced += text.midRef(last, (int)match.begin - last);
+                replaced += replaceWith;
+                last = (int)match.end;
+            }
+            replaced += text.midRef(last);
+            result = replaced.toUtf8();
+        }
+    }
+    file.close();
+    if(matches.isEmpty()) {
+        return true;
+    }
+
+    if(!file.open(QFile::WriteOnly | QFile::Truncate)) {
+        return false;
+    }
+    return file.write(result) == result.size();
+}
+
+void FindEngine::findBytes(const char *data, qint64 size, QList<Match> &matches,
+                           QStringList* lineTexts) {
+    auto pattern = mPattern.constData();
+    auto length = mPattern.size();
+    if(size < length) {
+        return;
+    }
+
+    auto lower = mCaseSensitive ? pattern[0] : foldAscii(pattern[0]);
+    auto upper = mCaseSensitive ? pattern[0] : upperAscii(pattern[0]);
+    LineCursor lines(data, size);
+    const char* textLine = nullptr;
+    QString lineText;
+
+    auto p = data;
+    auto last = data + size - length;
+    while(p <= last) {
+        auto hit = findFirstByte(p, last + 1, lower, upper);
+        if(hit == nullptr) {
+            break;
+        }
+        // the pattern has no line break, so a match never crosses lines
+        bool equal = mCaseSensitive
+                     ? memcmp(hit + 1, pattern + 1, length - 1) == 0
+                     : equalAsciiCaseInsensitive(hit + 1, pattern + 1, length - 1);
+        if(!equal) {
+            p = hit + 1;
+            continue;
+        }
+
+        lines.moveTo(hit);
+        auto hitEnd = hit + length;
+        if(mWholeWords
+           && ((hit != lines.lineStart
+                && isWordChar(decodeUtf8Before(lines.lineStart, hit)))
+               || (hitEnd != lines.lineEnd
+                   && isWordChar(decodeUtf8(hitEnd, lines.lineEnd))))) {
+            p = hit + 1;
+            continue;
+        }
+
+        Match match;
+        match.line = lines.line;
+        match.begin = hit - data;
+        match.end = hitEnd - data;
+        matches << match;
+        if(lineTexts != nullptr) {
+            if(textLine != lines.lineStart) {
+                textLine = lines.lineStart;
+                lineText = QString::fromUtf8(lines.lineStart,
+                                             (int)(lines.lineEnd - lines.lineStart));
+            }
+            *lineTexts << lineText;
+        }
+        p = hitEnd;
+    }
+}
+
+void FindEngine::findText(const QString &text, QList<Match> &matches,
+                          QStringList* lineTexts) {
+    auto cs = mCaseSensitive ? Qt::CaseSensitive : Qt::CaseInsensitive;
+    int lineNumber = 1;
+    int lineStart = 0;
+    while(lineStart <= text.size()) {
+        auto lineEnd = lineStart;
+        while(lineEnd < text.size() && text[lineEnd] != '\n' && text[lineEnd] != '\r') {
+            lineEnd++;
+        }
+        auto line = text.mid(lineStart, lineEnd - lineStart);
+        auto searchLine = line;
+        searchLine.replace(QChar::Nbsp, ' ');
+
+        int offset = 0;
+        while(offset <= searchLine.size()) {
+            int idx, length;
+            if(mUseRegexp) {
+                idx = mRegExp.indexIn(searchLine, offset);
+                length = mRegExp.matchedLength();
+            } else {
+                idx = searchLine.indexOf(mSubString, offset, cs);
+                length = mSubString.size();
+            }
+            if(idx == -1) {
+                break;
+            }
+            auto end = idx + length;
+            if(mWholeWords
+               && ((idx != 0 && searchLine[idx - 1].isLetterOrNumber())
+                   || (end != searchLine.size() && searchLine[end].isLetterOrNumber()))) {
+                offset = idx + 1;
+                continue;
+            }
+
+            Match match;
+            match.line = lineNumber;
+            match.begin = lineStart + idx;
+            match.end = lineStart + end;
+            matches << match;
+            if(lineTexts != nullptr) {
+                *lineTexts << line;
+            }
+            // empty match must not stop the search
+            offset = length > 0 ? end : end + 1;
+        }
+
+        if(lineEnd >= text.size()) {
+            break;
+        }
+        lineStart = lineEnd + 1;
+        if(text[lineEnd] == '\r' && lineStart < text.size() && text[lineStart] == '\n') {
+            lineStart++;
+        }
+        lineNumber++;
+    }
+}
@@ -0,0 +1,67 @@
+//===- FindEngine.h - ART-GUI Find -----------------------------*- C++ -*-===//
+//
+//                     ANDROID REVERSE TOOLKIT
+//
+// This file is distributed under the GNU GENERAL PUBLIC LICENSE
+// V3 License. See LICENSE.TXT for details.
+//
+//===---------------------------------------------------------------------===//
+//
+// Search and replace text in a memory mapped file, with the same matching
+// rules as QTextDocument::find: matches never cross lines, case
+// sensitivity and whole words follow QTextDocument::FindFlags, and line
+// numbers start at 1.
+//
+// Plain text is searched on the raw UTF-8 bytes. Regular expressions, and
+// case insensitive search of non ASCII text, decode the file and search
+// line by line.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef FINDENGINE_H
+#define FINDENGINE_H
+
+#include <QByteArray>
+#include <QList>
+#include <QRegExp>
+#include <QString>
+#include <QtGui/QTextDocument>
+
+class FindEngine
+{
+public:
+    struct Match {
+        int line;
+        // match location, in bytes or in characters of the decoded file
+        qint64 begin;
+        qint64 end;
+    };
+
+    FindEngine(const QString &subString, QTextDocument::FindFlags options,
+               bool useRegexp);
+
+    // find all matches in file, text of the matched line is appended to
+    // lineTexts for every match. False is returned if file can't be read.
+    bool searchFile(const QString &filePath, QList<Match> &matches,
+                    QStringList &lineTexts);
+    // replace all matches in file. The file is only written when something
+    // was replaced.
+    bool replaceFile(const QString &filePath, const QString &replaceWith);
+
+private:
+    bool useBytes(const char* data, qint64 size);
+    void findBytes(const char* data, qint64 size, QList<Match> &matches,
+                   QStringList* lineTexts);
+    void findText(const QString &text, QList<Match> &matches,
+                  QStringList* lineTexts);
+
+    QString mSubString;
+    QByteArray mPattern;
+    QRegExp mRegExp;
+    bool mUseRegexp;
+    bool mCaseSensitive;
+    bool mWholeWords;
+    bool mAsciiPattern;
+};
+
+#endif // FINDENGINE_H
@@ -0,0 +1,480 @@
+//===- FindIndex.cpp - ART-GUI Find ----------------------------*- C++ -*-===//
+//
+//                     ANDROID REVERSE TOOLKIT
+//
+// This file is distributed under the GNU GENERAL PUBLIC LICENSE
+// V3 License. See LICENSE.TXT for details.
+//
+//===---------------------------------------------------------------------===//
+
+#include "FindIndex.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QSet>
+
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
+// larger files are not indexed and always searched
+static const qint64 kMaxIndexedFileSize = 16 * 1024 * 1024;
+// ids of changed and removed files are compacted out of the posting lists
+// once there are more of them than this part of the live files
+static const int kMaxDeadFilesPercent = 50;
+
+// trigram of three 7-bit characters
+static inline quint32 trigramKey(quint32 prev, uchar c) {
+    return ((prev << 7) | c) & 0x1FFFFF;
+}
+
+static inline bool isIndexedChar(uchar c) {
+    // searches never match across lines, other bytes may be folded
+    // differently by unicode case insensitive compare. A searched space
+    // also matches a no-break space.
+    return c < 0x80 && c != '\n' && c != '\r' && c != ' ';
+}
+
+static inline uchar foldChar(uchar c) {
+    return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+static inline bool isHexDigit(QChar c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+// index of the last character of the regexp escape whose letter or digit
+// is at i, like \x41 \u0041 \0101 \p{L} \cJ \k<name> or \Q...\E
+static int escapeEnd(const QString &text, int i) {
+    auto e = text[i];
+    auto next = i + 1;
+    auto skipTo = [&](QChar end) {
+        while(next < text.size() && text[next] != end) {
+            next++;
+        }
+        return qMin(next, text.size() - 1);
+    };
+    if(next < text.size() && text[next] == '{') {
+        return skipTo('}');
+    }
+    if((e == 'k' || e == 'g') && next < text.size() && text[next] == '<') {
+        return skipTo('>');
+    }
+    if((e == 'k' || e == 'g') && next < text.size() && text[next] == '\'') {
+        next++;
+        return skipTo('\'');
+    }
+    if(e == 'c') {
+        return qMin(next, text.size() - 1);
+    }
+    if(e == 'Q') {
+        // quoted text ends at \E, skipped as a whole
+        while(next + 1 < text.size() && !(text[next] == '\\' && text[next + 1] == 'E')) {
+            next++;
+        }
+        return qMin(next + 1, text.size() - 1);
+    }
+    int digits = 0;
+    if(e == 'x') {
+        digits = 2;
+    } else if(e == 'u') {
+        digits = 4;
+    } else if(e == 'g' || e.isDigit()) {
+        // back references and octal codes
+        if(e == 'g' && next < text.size() && (text[next] == '-' || text[next] == '+')) {
+            next++;
+        }
+        while(next < text.size() && text[next].isDigit()) {
+            next++;
+        }
+        return next - 1;
+    }
+    while(digits > 0 && next < text.size() && isHexDigit(text[next])) {
+        next++;
+        digits--;
+    }
+    return next - 1;
+}
+
+static QString cleanPath(const QString &path) {
+    return QDir::cleanPath(QFileInfo(path).absoluteFilePath());
+}
+
+FindIndex *FindIndex::instance() {
+    static FindIndex* mPtr = nullptr;
+    if(mPtr == nullptr) {
+        mPtr = new FindIndex;
+    }
+    return mPtr;
+}
+
+void FindIndex::open(const QString &root) {
+    close();
+
+    int generation;
+    {
+        QWriteLocker locker(&m_lock);
+        m_root = cleanPath(root);
+        generation = m_generation;
+    }
+    auto thread = new FindIndexThread(generation);
+    thread->start(QThread::LowPriority);
+}
+
+void FindIndex::close() {
+    QWriteLocker locker(&m_lock);
+    // a running refresh stops when it sees the generation changed
+    m_generation++;
+    m_ready = false;
+    m_root.clear();
+    m_files.clear();
+    m_fileIds.clear();
+    m_postings.clear();
+    m_unindexed.clear();
+}
+
+bool FindIndex::refresh(int generation) {
+    QMutexLocker refreshLocker(&m_refreshLock);
+
+    QString root;
+    {
+        QReadLocker locker(&m_lock);
+        if(generation != m_generation || m_root.isEmpty()) {
+            return false;
+        }
+        root = m_root;
+    }
+
+    QSet<int> seen;
+    QDirIterator it(root, QDir::Files | QDir::NoSymLinks, QDirIterator::Subdirectories);
+    while(it.hasNext()) {
+        it.next();
+        auto fi = it.fileInfo();
+        auto path = fi.absoluteFilePath();
+        auto size = fi.size();
+        auto modified = fi.lastModified().toMSecsSinceEpoch();
+
+        int oldId;
+        {
+            QReadLocker locker(&m_lock);
+            if(generation != m_generation) {
+                return false;
+            }
+            oldId = m_fileIds.value(path, -1);
+            if(oldId >= 0) {
+                const FileEntry &entry = m_files.at(oldId);
+                if(entry.size == size && entry.modified == modified) {
+                    seen.insert(oldId);
+                    continue;
+                }
+            }
+        }
+
+        // new or changed file, read it without holding the lock
+        QVector<quint32> trigrams;
+        bool indexed = size <= kMaxIndexedFileSize && readTrigrams(path, trigrams);
+
+        QWriteLocker locker(&m_lock);
+        if(generation != m_generation) {
+            return false;
+        }
+        if(oldId >= 0) {
+            m_files[oldId].alive = false;
+        }
+        auto id = m_files.size();
+        FileEntry entry;
+        entry.path = path;
+        entry.size = size;
+        entry.modified = modified;
+        entry.alive = true;
+        m_files.push_back(entry);
+        m_fileIds.insert(path, id);
+        if(indexed) {
+            for(auto trigram: trigrams) {
+                m_postings[trigram].push_back(id);
+            }
+        } else {
+            m_unindexed.push_back(id);
+        }
+        seen.insert(id);
+    }
+
+    QWriteLocker locker(&m_lock);
+    if(generation != m_generation) {
+        return false;
+    }
+    // drop removed files
+    for(auto fileIt = m_fileIds.begin(); fileIt != m_fileIds.end(); ) {
+        if(!seen.contains(fileIt.value())) {
+            m_files[fileIt.value()].alive = false;
+            fileIt = m_fileIds.erase(fileIt);
+        } else {
+            ++fileIt;
+        }
+    }
+    auto dead = m_files.size() - m_fileIds.size();
+    if(dead > 0 && dead * 100 >= m_fileIds.size() * kMaxDeadFilesPercent) {
+        compact();
+    }
+    m_ready = true;
+    return true;
+}
+
+void FindIndex::compact() {
+    // live files keep their order, so posting lists stay sorted
+    QVector<int> newIds(m_files.size(), -1);
+    QVector<FileEntry> files;
+    files.reserve(m_fileIds.size());
+    for(auto id = 0; id < m_files.size(); id++) {
+        if(m_files.at(id).alive) {
+            newIds[id] = files.size();
+            files.push_back(m_files.at(id));
+        }
+    }
+    m_files.swap(files);
+    for(auto fileIt = m_fileIds.begin(); fileIt != m_fileIds.end(); ++fileIt) {
+        fileIt.value() = newIds.at(fileIt.value());
+    }
+
+    auto remap = [&](QVector<int> &ids) {
+        auto kept = 0;
+        for(auto id: ids) {
+            if(newIds.at(id) >= 0) {
+                ids[kept++] = newIds.at(id);
+            }
+        }
+        ids.resize(kept);
+        ids.squeeze();
+    };
+    for(auto postingIt = m_postings.begin(); postingIt != m_postings.end(); ) {
+        remap(postingIt.value());
+        if(postingIt.value().isEmpty()) {
+            postingIt = m_postings.erase(postingIt);
+        } else {
+            ++postingIt;
+        }
+    }
+    remap(m_unindexed);
+}
+
+bool FindIndex::candidates(const QString &path, const QString &text, bool useRegexp,
+                           bool caseSensitive, QStringList &files) {
+    auto trigrams = queryTrigrams(text, useRegexp, caseSensitive);
+    if(trigrams.isEmpty()) {
+        return false;
+    }
+
+    auto dir = cleanPath(path);
+    int generation;
+    {
+        QReadLocker locker(&m_lock);
+        // only files under project source directory are indexed
+        if(!m_ready || (dir != m_root && !dir.startsWith(m_root + '/'))) {
+            return false;
+        }
+        generation = m_generation;
+    }
+    if(!refresh(generation)) {
+        return false;
+    }
+
+    QReadLocker locker(&m_lock);
+    if(generation != m_generation) {
+        return false;
+    }
+
+    QVector<const QVector<int>*> lists;
+    for(auto trigram: trigrams) {
+        auto it = m_postings.constFind(trigram);
+        if(it == m_postings.constEnd()) {
+            // no indexed file has it
+            lists.clear();
+            break;
+        }
+        lists << &it.value();
+    }
+
+    std::vector<int> ids;
+    if(!lists.isEmpty()) {
+        std::sort(lists.begin(), lists.end(),
+                  [](const QVector<int>* a, const QVector<int>* b) {
+                      return a->size() < b->size();
+                  });
+        ids.assign(lists[0]->begin(), lists[0]->end());
+        for(auto i = 1; i < lists.size() && !ids.empty(); i++) {
+            std::vector<int> common;
+            std::set_intersection(ids.begin(), ids.end(),
+                                  lists[i]->begin(), lists[i]->end(),
+                                  std::back_inserter(common));
+            ids.swap(common);
+        }
+    }
+    ids.insert(ids.end(), m_unindexed.constBegin(), m_unindexed.constEnd());
+
+    auto prefix = dir + '/';
+    files.clear();
+    for(auto id: ids) {
+        const FileEntry &entry = m_files.at(id);
+        if(entry.alive && (entry.path.startsWith(prefix) || entry.path == dir)) {
+            files << entry.path;
+        }
+    }
+    files.sort();
+    return true;
+}
+
+bool FindIndex::readTrigrams(const QString &path, QVector<quint32> &trigrams) {
+    QFile file(path);
+    if(!file.open(QFile::ReadOnly)) {
+        return false;
+    }
+    auto size = file.size();
+    if(size < 3) {
+        return true;
+    }
+    auto* data = file.map(0, size);
+    if(data == nullptr) {
+        return false;
+    }
+
+    // one bit for each of the 2^21 trigrams, only the set bits are cleared
+    // again so the table is reused by the next file of this thread.
+    thread_local std::vector<quint64> seen(1 << 15);
+
+    quint32 key = 0;
+    int valid = 0;
+    for(qint64 i = 0; i < size; i++) {
+        auto c = data[i];
+        if(!isIndexedChar(c)) {
+            valid = 0;
+            continue;
+        }
+        key = trigramKey(key, foldChar(c));
+        if(++valid < 3) {
+            continue;
+        }
+        auto &word = seen[key >> 6];
+        auto bit = (quint64)1 << (key & 63);
+        if(!(word & bit)) {
+            word |= bit;
+            trigrams.push_back(key);
+        }
+    }
+    file.unmap(data);
+
+    for(auto trigram: trigrams) {
+        seen[trigram >> 6] = 0;
+    }
+    // posting lists are appended in file id order, keys order is free
+    return true;
+}
+
+QVector<quint32> FindIndex::queryTrigrams(const QString &text, bool useRegexp,
+                                          bool caseSensitive) {
+    // literal runs every match must contain
+    QStringList runs;
+    if(!useRegexp) {
+        runs << text;
+    } else if(!text.contains('|')) {
+        QString run;
+        auto flush = [&]() {
+            runs << run;
+            run.clear();
+        };
+        int depth = 0;
+        for(auto i = 0; i < text.size(); i++) {
+            auto c = text[i];
+            if(c == '\\') {
+                // escaped punctuation is literal, \d \w \1 \x41 ... are not
+                if(i + 1 < text.size() && !text[i + 1].isLetterOrNumber()) {
+                    if(depth == 0) {
+                        run += text[i + 1];
+                    }
+                    i++;
+                } else {
+                    flush();
+                    i = i + 1 < text.size() ? escapeEnd(text, i + 1) : i;
+                }
+            } else if(c == '[') {
+                flush();
+                // skip character class, ']' right after '[' or '[^' is literal
+                i++;
+                if(i < text.size() && text[i] == '^') {
+                    i++;
+                }
+                if(i < text.size() && text[i] == ']') {
+                    i++;
+                }
+                while(i < text.size() && text[i] != ']') {
+                    if(text[i] == '\\') {
+                        i++;
+                    }
+                    i++;
+                }
+            } else if(c == '(') {
+                depth++;
+                flush();
+            } else if(c == ')') {
+                depth--;
+                flush();
+            } else if(c == '*' || c == '?' || c == '{') {
+                // previous character is optional
+                run.chop(1);
+                flush();
+                if(c == '{') {
+                    while(i < text.size() && text[i] != '}') {
+                        i++;
+                    }
+                }
+            } else if(c == '.' || c == '^' || c == '$' || c == '+') {
+                flush();
+            } else if(depth == 0) {
+                run += c;
+            }
+        }
+        flush();
+    }
+
+    // unicode case folding matches k and s with the kelvin sign and the long
+    // s, which the index does not fold. A regexp may turn case folding on.
+    auto foldsWide = !caseSensitive || (useRegexp && text.contains("(?"));
+
+    QVector<quint32> trigrams;
+    for(auto &run: runs) {
+        quint32 key = 0;
+        int valid = 0;
+        for(auto c: run) {
+            auto u = c.unicode();
+            if(u >= 0x80 || !isIndexedChar((uchar)u)) {
+                valid = 0;
+                continue;
+            }
+            if(foldsWide && (foldChar((uchar)u) == 'k' || foldChar((uchar)u) == 's')) {
+                valid = 0;
+                continue;
+            }
+            key = trigramKey(key, foldChar((uchar)u));
+            if(++valid >= 3) {
+                trigrams << key;
+            }
+        }
+    }
+    std::sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+    return trigrams;
+}
+
+FindIndexThread::FindIndexThread(int generation, QObject *parent)
+        : QThread(parent)
+{
+    mGeneration = generation;
+    connect(this, SIGNAL(finished()), this, SLOT(deleteLater()));
+}
+
+void FindIndexThread::run()
+{
+    FindIndex::instance()->refresh(mGeneration);
+}
@@ -0,0 +1,96 @@
+//===- FindIndex.h - ART-GUI Find ------------------------------*- C++ -*-===//
+//
+//                     ANDROID REVERSE TOOLKIT
+//
+// This file is distributed under the GNU GENERAL PUBLIC LICENSE
+// V3 License. See LICENSE.TXT for details.
+//
+//===---------------------------------------------------------------------===//
+//
+// Trigram index of project files. It maps every three ASCII characters
+// (lower case) to the files containing them, so a global search only has
+// to open the files which can match.
+//
+// The index is built in background when project opened, and refreshed
+// before each search: files whose size or modify time changed are indexed
+// again, removed files are dropped.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef FINDINDEX_H
+#define FINDINDEX_H
+
+#include <QAtomicInt>
+#include <QHash>
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QStringList>
+#include <QThread>
+#include <QVector>
+
+class FindIndex
+{
+public:
+    static FindIndex* instance();
+
+    // start building index for project source directory
+    void open(const QString &root);
+    void close();
+
+    // get the files under path which may contain text. False is returned
+    // when the index can not narrow the search, all files should be
+    // searched in this case.
+    bool candidates(const QString &path, const QString &text, bool useRegexp,
+                    bool caseSensitive, QStringList &files);
+
+    // bring index up to date with the files on disk. False is returned if
+    // the index was closed meanwhile.
+    bool refresh(int generation);
+
+private:
+    FindIndex() = default;
+
+    struct FileEntry {
+        QString path;
+        qint64 size;
+        qint64 modified;
+        bool alive;
+    };
+
+    // drop the ids of changed and removed files, write lock held
+    void compact();
+
+    static bool readTrigrams(const QString &path, QVector<quint32> &trigrams);
+    static QVector<quint32> queryTrigrams(const QString &text, bool useRegexp,
+                                          bool caseSensitive);
+
+    QReadWriteLock m_lock;
+    // only one refresh walks the directory at once
+    QMutex m_refreshLock;
+
+    QString m_root;
+    int m_generation = 0;
+    bool m_ready = false;
+
+    // file ids only grow, a changed file gets a new id so posting lists
+    // stay sorted. Dead ids are dropped and the rest renumbered in order
+    // by compact().
+    QVector<FileEntry> m_files;
+    QHash<QString, int> m_fileIds;
+    QHash<quint32, QVector<int>> m_postings;
+    // too large to index, always searched
+    QVector<int> m_unindexed;
+};
+
+class FindIndexThread : public QThread
+{
+Q_OBJECT
+public:
+    FindIndexThread(int generation, QObject *parent = Q_NULLPTR);
+protected:
+    void run();
+private:
+    int mGeneration;
+};
+
+#endif // FINDINDEX_H
@@ -8,19 +8,29 @@
 //===---------------------------------------------------------------------===//
 
 #include "FindResult.h"
+#include "FindEngine.h"
+#include "FindIndex.h"
 #include "ui_FindResult.h"
 
 #include <utils/StringUtil.h>
 #include <utils/ProjectInfo.h>
+#include <SmaliAnalysis/SmaliAnalysis.h>
 
 #include <QMessageBox>
 #include <QDir>
-#include <QTextCursor>
-#include <QTextLayout>
-#include <QTextBlock>
 #include <QDebug>
+#include <QRunnable>
+#include <QThreadPool>
 #include <utils/CmdMsgUtil.h>
 
+// line items shown at most, more results are only counted
+static const int kMaxDisplayedHits = 10000;
+// a result batch is sent when it has this many hits, or is this old (ms)
+static const int kResultBatchHits = 256;
+static const int kResultBatchInterval = 100;
+// best symbols shown for a symbol search
+static const int kMaxSymbolHits = 500;
+
 
 FindResult::FindResult(QWidget *parent) :
         QWidget(parent),
@@ -34,12 +44,17 @@ FindResult::FindResult(QWidget *parent) :
     connect(ui->mReplaceEdit, SIGNAL(returnPressed()), this, SLOT(onReplaceClick()));
     connect(ui->mReplaceBtn, SIGNAL(clicked(bool)), this, SLOT(onReplaceClick()));
 
+    connect(ui->mStopBtn, SIGNAL(clicked(bool)), this, SLOT(onStopClick()));
+
     connect(ui->mResultTree, SIGNAL(itemDoubleClicked(QTreeWidgetItem*,int)),
             this, SLOT(onTreeFileOpen(QTreeWidgetItem*,int)));
+    connect(ui->mResultTree, SIGNAL(itemExpanded(QTreeWidgetItem*)),
+            this, SLOT(onItemExpanded(QTreeWidgetItem*)));
 }
 
 FindResult::~FindResult()
 {
+    onStopClick ();
     delete ui;
 }
 
@@ -57,11 +72,80 @@ void FindResult::startNewFind (const QString &subString,const QString &directory
         ui->mReplaceWidget->show ();
     mThread = new FindThread();
     mThread->setFind (subString, directory, options, useRegexp);
-    connect(mThread, SIGNAL(newResult(QString,QStringList,QList<int>)),
-            this, SLOT(onNewResult(QString,QStringList,QList<int>)));
+    connect(mThread, SIGNAL(newResults(QList<FindFileResult>)),
+            this, SLOT(onNewResults(QList<FindFileResult>)));
+    connect(mThread, SIGNAL(finished()), this, SLOT(onFindFinished()));
+    updateStatus ();
     mThread->start ();
 }
 
+void FindResult::startSymbolFind (const QString &query, const QString &directory)
+{
+    mSubString = query;
+    mSearchPath = directory;
+    mNeedReplace = false;
+
+    // symbols are ranked, files are listed in order of their best symbol
+    QFileInfo dirInfo(directory);
+    QString prefix = dirInfo.absoluteFilePath () + "/";
+    bool isFile = dirInfo.isFile ();
+
+    QList<FindFileResult> results;
+    QHash<QString, int> fileResults;
+    auto symbols = SmaliAnalysis::instance ()->findSymbols (query, kMaxSymbolHits);
+    for(auto &symbol: symbols) {
+        if(!directory.isEmpty ()
+           && (isFile ? symbol.m_filepath != dirInfo.absoluteFilePath ()
+                      : !symbol.m_filepath.startsWith (prefix))) {
+            continue;
+        }
+        auto it = fileResults.find (symbol.m_filepath);
+        if(it == fileResults.end ()) {
+            it = fileResults.insert (symbol.m_filepath, results.size ());
+            FindFileResult result;
+            result.filePath = symbol.m_filepath;
+            results << result;
+        }
+        FindFileResult &result = results[it.value ()];
+        result.text << symbol.m_descriptor;
+        result.line << symbol.m_line;
+    }
+
+    ui->mStopBtn->setEnabled (false);
+    onNewResults (results);
+    onFindFinished ();
+    for(auto i = 0; i < ui->mResultTree->topLevelItemCount (); i++) {
+        ui->mResultTree->topLevelItem (i)->setExpanded (true);
+    }
+}
+
+void FindResult::onStopClick ()
+{
+    if(!mThread.isNull ()) {
+        mThread->cancel ();
+    }
+}
+
+void FindResult::onFindFinished ()
+{
+    mFinished = true;
+    ui->mStopBtn->setEnabled (false);
+    updateStatus ();
+}
+
+void FindResult::updateStatus ()
+{
+    QString status = tr("%1 matches in %2 files")
+            .arg (mHitCount).arg (mResultFiles.size ());
+    if(mDisplayedHits < mHitCount) {
+        status += tr(", showing first %1").arg (mDisplayedHits);
+    }
+    if(!mFinished) {
+        status += tr(", searching...");
+    }
+    ui->mStatusLabel->setText (status);
+}
+
 void FindResult::onReplaceClick ()
 {
     QMessageBox msg(QMessageBox::Warning,
@@ -72,48 +156,70 @@ void FindResult::onReplaceClick ()
         return;
     QString replace = ui->mReplaceEdit->text ();
 
-    QStringList allfiles;
-    for(QTreeWidgetItemIterator it(ui->mResultTree); *it; it++) {
-        if((*it)->type () != treeFileItemType)
-            continue;
-        QString filePath = (*it)->data (0, Qt::UserRole).toString ();
-        allfiles << filePath;
-    }
     auto thread = new ReplaceThread();
     thread->setReplace (mSubString, replace, mOptions, mUseRegexp);
-    thread->setFiles(allfiles);
+    thread->setFiles(mResultFiles);
     thread->start ();
 }
 
-void FindResult::onNewResult (QString filePath,QStringList text,QList<int> line)
+void FindResult::onNewResults (QList<FindFileResult> results)
 {
-    QString projectRoot = ProjectInfo::current()->getSourcePath();
-    QFileInfo rootInfo(projectRoot);
-    QFileInfo fileInfo(filePath);
+    auto pinfo = ProjectInfo::current();
+    QString rootPrefix;
+    if(pinfo != nullptr) {
+        rootPrefix = QFileInfo(pinfo->getSourcePath()).absoluteFilePath () + "/";
+    }
+
+    QList<QTreeWidgetItem*> fileItems;
+    for(auto &result: results) {
+        mResultFiles << result.filePath;
+        mHitCount += result.line.size ();
+        if(mDisplayedHits >= kMaxDisplayedHits) {
+            continue;
+        }
+        mDisplayedHits += result.line.size ();
 
-    QString canPath = fileInfo.absoluteFilePath ().remove (
-            rootInfo.absoluteFilePath () + "/");
+        QFileInfo fileInfo(result.filePath);
+        QString canPath = fileInfo.absoluteFilePath ();
+        if(!rootPrefix.isEmpty ()) {
+            canPath.remove (rootPrefix);
+        }
 
-    auto fileroot = new QTreeWidgetItem(
-            QStringList() << canPath + "(" + QString::number (text.size ()) + ")",
-            treeFileItemType);
-    fileroot->setData (0, Qt::UserRole, filePath);
+        auto fileroot = new QTreeWidgetItem(
+                QStringList() << canPath + "(" + QString::number (result.text.size ()) + ")",
+                treeFileItemType);
+        fileroot->setData (0, Qt::UserRole, result.filePath);
+        fileroot->setChildIndicatorPolicy (QTreeWidgetItem::ShowIndicator);
+        mUnexpanded.insert (fileroot, result);
+        fileItems.append (fileroot);
+    }
+    ui->mResultTree->addTopLevelItems (fileItems);
+    updateStatus ();
+}
 
-    ui->mResultTree->addTopLevelItem (fileroot);
+void FindResult::onItemExpanded (QTreeWidgetItem *item)
+{
+    auto it = mUnexpanded.find (item);
+    if(it == mUnexpanded.end ()) {
+        return;
+    }
+    const FindFileResult &result = it.value ();
 
     QList<QTreeWidgetItem*> items;
-    auto itLine = line.begin (), itLineEnd = line.end ();
-    auto itText = text.begin (), itTextEnd = text.end ();
+    auto itLine = result.line.begin (), itLineEnd = result.line.end ();
+    auto itText = result.text.begin (), itTextEnd = result.text.end ();
     for(;itLine != itLineEnd && itText != itTextEnd;
          itLine++, itText++) {
         QStringList itemData;
         itemData << *itText + "  --- line " + QString::number (*itLine);
-        auto item = new QTreeWidgetItem(itemData, treeLineItemType);
-        item->setData (0, Qt::UserRole, *itLine);
-        items.append (item);
+        auto child = new QTreeWidgetItem(itemData, treeLineItemType);
+        child->setData (0, Qt::UserRole, *itLine);
+        items.append (child);
     }
+    mUnexpanded.erase (it);
 
-    fileroot->addChildren (items);
+    item->setChildIndicatorPolicy (QTreeWidgetItem::DontShowIndicatorWhenChildless);
+    item->addChildren (items);
 }
 
 void FindResult::onTreeFileOpen (QTreeWidgetItem *item,int column)
@@ -132,9 +238,21 @@ void FindResult::onTreeFileOpen (QTreeWidgetItem *item,int column)
 
 
 // FindThread
+class FindTask: public QRunnable {
+public:
+    FindTask(FindThread* thread) : mThread(thread) {}
+
+    void run() override {
+        mThread->runWorker ();
+    }
+private:
+    FindThread* mThread;
+};
+
 FindThread::FindThread(QObject *parent)
         :QThread(parent)
 {
+    qRegisterMetaType<QList<FindFileResult>>("QList<FindFileResult>");
     connect(this, SIGNAL(finished()), this, SLOT(deleteLater()));
 }
 
@@ -150,73 +268,96 @@ void FindThread::setFind (const QString &subString,const QString &directory,
 void FindThread::run()
 {
     if(QFileInfo(mSearchPath).isFile ()) {
-        searchFile (mSearchPath);
-    } else {
-        QDir dir(mSearchPath);
-        searchDirectory (dir);
+        mFiles << mSearchPath;
+    } else if(!FindIndex::instance()->candidates(mSearchPath, mSubString, mUseRegexp,
+                                                  mOptions & QTextDocument::FindCaseSensitively,
+                                                  mFiles)) {
+        collectFiles (QDir(mSearchPath));
+    }
+
+    // files are handed out one by one, the search cost of a file is
+    // unknown until it is read.
+    auto workers = qBound(1, QThread::idealThreadCount (), qMax(1, mFiles.size ()));
+    mFlushTimer.start ();
+    QThreadPool pool;
+    pool.setMaxThreadCount (workers);
+    for(auto i = 0; i < workers; i++) {
+        pool.start (new FindTask(this));
+    }
+    pool.waitForDone ();
+
+    if(!isCanceled ()) {
+        QMutexLocker locker(&mResultLock);
+        flushResults ();
     }
     qDebug() << "global Search thread quit";
 }
 
-void FindThread::searchDirectory (QDir dir)
+void FindThread::collectFiles (QDir dir)
 {
-    if(!dir.exists ())
+    if(isCanceled () || !dir.exists ())
         return ;
     dir.setFilter (QDir::Dirs | QDir::NoSymLinks);
             foreach(QFileInfo mfi ,dir.entryInfoList())
         {
             if(mfi.fileName()=="." || mfi.fileName() == "..")continue;
-            searchDirectory (mfi.absoluteFilePath ());
+            collectFiles (mfi.absoluteFilePath ());
         }
     dir.setFilter (QDir::Files| QDir::NoSymLinks);
             foreach(QFileInfo mfi ,dir.entryInfoList())
         {
-            searchFile (mfi.absoluteFilePath ());
+            mFiles << mfi.absoluteFilePath ();
         }
 }
 
-void FindThread::searchFile (QString filePath)
+void FindThread::runWorker ()
 {
-    QFile file(filePath);
-    if (file.open(QFile::ReadOnly | QFile::Text)) {
-        QTextDocument document(file.readAll ());
-        if(mUseRegexp) {
-            QRegExp regExp(mSubString);
-            auto cursor = document.find(regExp, 0, mOptions);
-
-            QStringList text;
-            QList<int> lines;
-            while(!cursor.isNull ()) {
-                text.push_back (cursor.block ().text ());
-                lines.push_back (currentline (cursor));
-                cursor = document.find(regExp, cursor, mOptions);
-            }
-            if(!text.isEmpty ()) {
-                 newResult (filePath, text, lines);
-            }
-        } else {
-            auto cursor = document.find(mSubString, 0, mOptions);
-
-            QStringList text;
-            QList<int> lines;
-            while(!cursor.isNull ()) {
-                text.push_back (cursor.block ().text ());
-                lines.push_back (currentline (cursor));
-                cursor = document.find(mSubString, cursor, mOptions);
-            }
-            if(!text.isEmpty ()) {
-                 newResult (filePath, text, lines);
-            }
+    // QRegExp is not thread safe, each worker has its own engine
+    FindEngine engine(mSubString, mOptions, mUseRegexp);
+    while(!isCanceled ()) {
+        auto idx = mNextFile.fetchAndAddRelaxed (1);
+        if(idx >= mFiles.size ()) {
+            break;
+        }
+        searchFile (engine, mFiles.at (idx));
+
+        // checked after every file, so a batch is sent in time even when
+        // the files after it have no match
+        QMutexLocker locker(&mResultLock);
+        if(mFlushTimer.elapsed () >= kResultBatchInterval) {
+            flushResults ();
         }
     }
 }
 
-int FindThread::currentline (const QTextCursor &cursor)
+void FindThread::searchFile (FindEngine &engine, const QString &filePath)
+{
+    QList<FindEngine::Match> matches;
+    FindFileResult result;
+    if(!engine.searchFile (filePath, matches, result.text) || matches.isEmpty ()) {
+        return;
+    }
+    result.filePath = filePath;
+    for(auto &match: matches) {
+        result.line.push_back (match.line);
+    }
+
+    QMutexLocker locker(&mResultLock);
+    mResults << result;
+    mResultHits += result.line.size ();
+    if(mResultHits >= kResultBatchHits) {
+        flushResults ();
+    }
+}
+
+void FindThread::flushResults ()
 {
-    QTextLayout *pLayout = cursor.block().layout();
-    int nCurpos = cursor.position() - cursor.block().position();
-    return pLayout->lineForTextPosition(nCurpos).lineNumber()
-           + cursor.block().firstLineNumber() + 1;
+    if(!mResults.isEmpty ()) {
+        newResults (mResults);
+        mResults.clear ();
+    }
+    mResultHits = 0;
+    mFlushTimer.restart ();
 }
 
 ReplaceThread::ReplaceThread (QObject *parent)
@@ -244,37 +385,6 @@ void ReplaceThread::run ()
 
 bool ReplaceThread::replaceFile (const QString &filePath)
 {
-    QFile file(filePath);
-    if(!file.open (QFile::ReadOnly | QFile::Text)) {
-        return false;
-    }
-
-    QTextDocument document(file.readAll ());
-
-    if(mUseRegexp) {
-        QRegExp regExp(mSubString);
-        auto cursor = document.find(regExp, 0, mOptions);
-        while(!cursor.isNull ()) {
-            cursor.insertText (mReplaceWith);
-            cursor = document.find(regExp, cursor, mOptions);
-        }
-    } else {
-        auto cursor = document.find(mSubString, 0, mOptions);
-        while(!cursor.isNull ()) {
-            cursor.insertText (mReplaceWith);
-            cursor = document.find(mSubString, cursor, mOptions);
-        }
-    }
-    file.close ();
-
-    if(!file.open (QFile::WriteOnly | QFile::Truncate | QFile::Text)) {
-        return false;
-    }
-
-    QTextStream out(&file);
-    out<<document.toPlainText ();
-    out.flush();
-    file.close();
-
-    return true;
+    FindEngine engine(mSubString, mOptions, mUseRegexp);
+    return engine.replaceFile (filePath, mReplaceWith);
 }
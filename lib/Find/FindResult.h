@@ -18,12 +18,26 @@
 #include <QtGui/QTextDocument>
 #include <QThread>
 #include <QDir>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QPointer>
 #include <QtWidgets/QTreeWidgetItem>
 
 namespace Ui {
     class FindResult;
 }
 
+// matches found in one file
+struct FindFileResult {
+    QString filePath;
+    QStringList text;
+    QList<int> line;
+};
+Q_DECLARE_METATYPE(FindFileResult)
+
+class FindEngine;
 class FindThread;
 class FindResult : public QWidget
 {
@@ -36,17 +50,25 @@ public:
     void startNewFind(const QString &subString,const QString &directory,
                       QTextDocument::FindFlags options,
                       bool useRegexp,bool needReplace);
+    // show symbols matching query, files outside directory are skipped.
+    // Empty directory shows all.
+    void startSymbolFind(const QString &query, const QString &directory);
 
 private slots:
     void onReplaceClick();
+    void onStopClick();
+    void onFindFinished();
+    void onItemExpanded(QTreeWidgetItem *item);
 
 public slots:
-    void onNewResult(QString filePath, QStringList text, QList<int> line);
+    void onNewResults(QList<FindFileResult> results);
     void onTreeFileOpen(QTreeWidgetItem *item, int column);
 
 private:
+    void updateStatus();
+
     Ui::FindResult *ui;
-    FindThread* mThread;
+    QPointer<FindThread> mThread;
 
     QString mSearchPath;
     QString mSubString;
@@ -54,6 +76,14 @@ private:
     bool mUseRegexp;
     bool mNeedReplace;
 
+    // every file with matches, including the ones not displayed
+    QStringList mResultFiles;
+    int mHitCount = 0;
+    int mDisplayedHits = 0;
+    bool mFinished = false;
+    // line items are created when the file item is expanded
+    QHash<QTreeWidgetItem*, FindFileResult> mUnexpanded;
+
     const static int treeFileItemType = QTreeWidgetItem::UserType + 1;
     const static int treeLineItemType = QTreeWidgetItem::UserType + 2;
 
@@ -68,21 +98,38 @@ public:
     void setFind(const QString &subString,const QString &directory,
                  QTextDocument::FindFlags options,
                  bool useRegexp);
+
+    // stop searching as soon as possible
+    void cancel() { mCanceled.store(1); }
+    bool isCanceled() const { return mCanceled.load() != 0; }
 signals:
-    void newResult(QString filePath, QStringList text, QList<int> line);
+    // results are delivered in batches bounded by hit count and time
+    void newResults(QList<FindFileResult> results);
 protected:
     void run();
 
-    void searchDirectory (QDir dir);
-    void searchFile (QString filePath);
+    void collectFiles (QDir dir);
+    void searchFile (FindEngine &engine, const QString &filePath);
 
 private:
-    int currentline(const QTextCursor& cursor);
+    friend class FindTask;
+    void runWorker();
+    void flushResults();
 private:
     QString mSearchPath;
     QString mSubString;
     QTextDocument::FindFlags mOptions;
     bool mUseRegexp;
+    QAtomicInt mCanceled;
+
+    // files to search, workers take the next one from mNextFile
+    QStringList mFiles;
+    QAtomicInt mNextFile;
+
+    QMutex mResultLock;
+    QList<FindFileResult> mResults;
+    int mResultHits = 0;
+    QElapsedTimer mFlushTimer;
 };
 
 class ReplaceThread : public QThread
@@ -107,6 +107,7 @@ MainWindow::MainWindow(QWidget *parent) :
     connect(script, SIGNAL(projectClosed(QStringList)),
             this, SLOT(onProjectClosed()));
     connect(script, SIGNAL(findAdvance(QStringList)), this, SLOT(onFindAdvance (QStringList)));
+    connect(script, SIGNAL(findSymbol(QStringList)), this, SLOT(onFindSymbol (QStringList)));
     connect(script, SIGNAL(openWindow(QStringList)), this, SLOT(onOpenWindow (QStringList)));
 
     cmdmsg()->addCmdMsg("Android Reverse Toolkit v"
@@ -408,6 +409,10 @@ void MainWindow::openFile(QString fileName)
 
     OpenApk* openWidget = new OpenApk(fileName, this);
     if (openWidget->exec() == QDialog::Accepted) {
+        // classes can be browsed while apktool is running
+        QStringList dexArgs;
+        dexArgs << fileName << GetProjectsProjectPath (openWidget->getFileName ());
+        cmdexec("LoadDex", dexArgs);
         // decompile
         QString cmd = openWidget->getDecompileCmd();
         qDebug() << "decompile: " << cmd;
@@ -601,6 +606,12 @@ void MainWindow::onFindAdvance(QStringList args)
     mFindDialog->setFocus();
 }
 
+void MainWindow::onFindSymbol(QStringList args)
+{
+    mFindDialog->onFindSymbol (args.join (' '));
+    mDockFind->raise();
+}
+
 void MainWindow::onOpenWindow (QStringList args)
 {
     if(args.isEmpty ())
@@ -0,0 +1,452 @@
+//===- DexFile.cpp - ART-GUI Analysis engine --------------------*- cpp -*-===//
+//
+//                     ANDROID REVERSE TOOLKIT
+//
+// This file is distributed under the GNU GENERAL PUBLIC LICENSE
+// V3 License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "DexFile.h"
+
+#include "SmaliAnalysis/SmaliFile.h"
+
+#include <utils/StringPool.h>
+
+#include <QPair>
+#include <QRegExp>
+
+#include <algorithm>
+#include <cstring>
+#include <zlib.h>
+
+#define DEX_HEADER_SIZE         0x70
+#define DEX_ENDIAN_CONSTANT     0x12345678
+
+#define ZIP_EOCD_SIGNATURE      0x06054b50
+#define ZIP_CENTRAL_SIGNATURE   0x02014b50
+#define ZIP_LOCAL_SIGNATURE     0x04034b50
+#define ZIP_EOCD_SIZE           22
+#define ZIP_CENTRAL_SIZE        46
+#define ZIP_LOCAL_SIZE          30
+#define ZIP_STORED              0
+#define ZIP_DEFLATED            8
+
+namespace {
+
+inline u2 getU2(const uchar* p) {
+    return (u2)(p[0] | (p[1] << 8));
+}
+
+inline u4 getU4(const uchar* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((u4)p[3] << 24);
+}
+
+struct ZipEntry {
+    QString name;
+    u2 method;
+    u4 compressedSize;
+    u4 size;
+    u4 localOffset;
+};
+
+// classes.dex is 1, classesN.dex is N, 0 for other files
+int dexNumber(const QString &name) {
+    if(name == "classes.dex") {
+        return 1;
+    }
+    QRegExp exp("classes([2-9]|[1-9][0-9]+)\\.dex");
+    return exp.exactMatch(name) ? exp.cap(1).toInt() : 0;
+}
+
+QString smaliDirName(int number) {
+    return number == 1 ? QString("smali") : "smali_classes" + QString::number(number);
+}
+
+// read the central directory, zip64 is not supported.
+bool readZipEntries(const uchar* data, qint64 size, QList<ZipEntry> &entries) {
+    // end of central directory is followed by a comment of at most 64K
+    qint64 eocd = -1;
+    for(auto pos = size - ZIP_EOCD_SIZE; pos >= 0 && pos >= size - ZIP_EOCD_SIZE - 0xFFFF; pos--) {
+        if(getU4(data + pos) == ZIP_EOCD_SIGNATURE) {
+            eocd = pos;
+            break;
+        }
+    }
+    if(eocd < 0) {
+        return false;
+    }
+
+    auto count = getU2(data + eocd + 10);
+    qint64 pos = getU4(data + eocd + 16);
+    for(auto i = 0; i < count; i++) {
+        if(pos + ZIP_CENTRAL_SIZE > size || getU4(data + pos) != ZIP_CENTRAL_SIGNATURE) {
+            return false;
+        }
+        ZipEntry entry;
+        entry.method = getU2(data + pos + 10);
+        entry.compressedSize = getU4(data + pos + 20);
+        entry.size = getU4(data + pos + 24);
+        auto nameLength = getU2(data + pos + 28);
+        auto extraLength = getU2(data + pos + 30);
+        auto commentLength = getU2(data + pos + 32);
+        entry.localOffset = getU4(data + pos + 42);
+        if(pos + ZIP_CENTRAL_SIZE + nameLength > size) {
+            return false;
+        }
+        entry.name = QString::fromUtf8((const char*)data + pos + ZIP_CENTRAL_SIZE, nameLength);
+        entries << entry;
+        pos += ZIP_CENTRAL_SIZE + nameLength + extraLength + commentLength;
+    }
+    return true;
+}
+
+// entry data follows the local header, nullptr if it is broken
+const uchar* entryData(const uchar* data, qint64 size, const ZipEntry &entry) {
+    qint64 pos = entry.localOffset;
+    if(pos + ZIP_LOCAL_SIZE > size || getU4(data + pos) != ZIP_LOCAL_SIGNATURE) {
+        return nullptr;
+    }
+    pos += ZIP_LOCAL_SIZE + getU2(data + pos + 26) + getU2(data + pos + 28);
+    if(pos + entry.compressedSize > size) {
+        return nullptr;
+    }
+    return data + pos;
+}
+
+bool inflateEntry(const uchar* data, const ZipEntry &entry, QByteArray &out) {
+    out.resize((int)entry.size);
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    // zip entries are raw deflate streams without zlib header
+    if(inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+        return false;
+    }
+    stream.next_in = const_cast<Bytef*>(data);
+    stream.avail_in = entry.compressedSize;
+    stream.next_out = (Bytef*)out.data();
+    stream.avail_out = entry.size;
+    auto ret = inflate(&stream, Z_FINISH);
+    inflateEnd(&stream);
+    return ret == Z_STREAM_END && stream.total_out == entry.size;
+}
+
+}
+
+DexFile::DexFile(QSharedPointer<QFile> file, const uchar *data, u4 size,
+                 const QByteArray &inflated, const QString &smaliDirName)
+        : m_file(file),
+          m_inflated(inflated),
+          m_data(inflated.isNull() ? data : (const uchar*)m_inflated.constData()),
+          m_size(size),
+          m_smaliDirName(smaliDirName)
+{
+}
+
+QList<QSharedPointer<DexFile>> DexFile::load(const QString &path) {
+    QList<QSharedPointer<DexFile>> result;
+    auto file = QSharedPointer<QFile>::create(path);
+    if(!file->open(QFile::ReadOnly)) {
+        return result;
+    }
+    auto size = file->size();
+    auto data = size > ZIP_EOCD_SIZE ? file->map(0, size) : nullptr;
+    if(data == nullptr || size > 0xFFFFFFFFLL) {
+        return result;
+    }
+
+    if(memcmp(data, "dex\n", 4) == 0) {
+        QSharedPointer<DexFile> dex(new DexFile(file, data, (u4)size, QByteArray(),
+                                                smaliDirName(1)));
+        if(dex->parseHeader()) {
+            result << dex;
+        }
+        return result;
+    }
+
+    QList<ZipEntry> entries;
+    if(!readZipEntries(data, size, entries)) {
+        return result;
+    }
+    QList<QPair<int, ZipEntry>> dexEntries;
+    for(auto &entry: entries) {
+        auto number = dexNumber(entry.name);
+        if(number > 0) {
+            dexEntries << qMakePair(number, entry);
+        }
+    }
+    std::sort(dexEntries.begin(), dexEntries.end(),
+              [](const QPair<int, ZipEntry> &a, const QPair<int, ZipEntry> &b) {
+                  return a.first < b.first;
+              });
+
+    for(auto &dexEntry: dexEntries) {
+        const ZipEntry &entry = dexEntry.second;
+        auto begin = entryData(data, size, entry);
+        if(begin == nullptr) {
+            continue;
+        }
+        QSharedPointer<DexFile> dex;
+        if(entry.method == ZIP_STORED) {
+            // read in place, the mapping lives as long as the dex
+            dex.reset(new DexFile(file, begin, entry.size, QByteArray(),
+                                  smaliDirName(dexEntry.first)));
+        } else if(entry.method == ZIP_DEFLATED) {
+            QByteArray inflated;
+            if(!inflateEntry(begin, entry, inflated)) {
+                continue;
+            }
+            dex.reset(new DexFile(QSharedPointer<QFile>(), nullptr, entry.size, inflated,
+                                  smaliDirName(dexEntry.first)));
+        } else {
+            continue;
+        }
+        if(dex->parseHeader()) {
+            result << dex;
+        }
+    }
+    return result;
+}
+
+bool DexFile::parseHeader() {
+    u4 endian;
+    if(m_size < DEX_HEADER_SIZE || memcmp(m_data, "dex\n", 4) != 0
+       || !readU4(40, endian) || endian != DEX_ENDIAN_CONSTANT) {
+        return false;
+    }
+    readU4(56, m_stringIdsSize);
+    readU4(60, m_stringIdsOff);
+    readU4(64, m_typeIdsSize);
+    readU4(68, m_typeIdsOff);
+    readU4(72, m_protoIdsSize);
+    readU4(76, m_protoIdsOff);
+    readU4(80, m_fieldIdsSize);
+    readU4(84, m_fieldIdsOff);
+    readU4(88, m_methodIdsSize);
+    readU4(92, m_methodIdsOff);
+    readU4(96, m_classDefsSize);
+    readU4(100, m_classDefsOff);
+
+    // id items are read without further bound check
+    auto inside = [this](u4 offset, u4 count, u4 itemSize) {
+        return (quint64)offset + (quint64)count * itemSize <= m_size;
+    };
+    if(!inside(m_stringIdsOff, m_stringIdsSize, 4)
+       || !inside(m_typeIdsOff, m_typeIdsSize, 4)
+       || !inside(m_protoIdsOff, m_protoIdsSize, 12)
+       || !inside(m_fieldIdsOff, m_fieldIdsSize, 8)
+       || !inside(m_methodIdsOff, m_methodIdsSize, 8)
+       || !inside(m_classDefsOff, m_classDefsSize, 32)) {
+        return false;
+    }
+    m_types.resize(m_typeIdsSize);
+    m_typeLoaded.fill(false, m_typeIdsSize);
+    return true;
+}
+
+bool DexFile::readU4(u4 offset, u4 &value) {
+    if((quint64)offset + 4 > m_size) {
+        return false;
+    }
+    value = getU4(m_data + offset);
+    return true;
+}
+
+bool DexFile::readU2(u4 offset, u2 &value) {
+    if((quint64)offset + 2 > m_size) {
+        return false;
+    }
+    value = getU2(m_data + offset);
+    return true;
+}
+
+bool DexFile::readUleb128(u4 &offset, u4 &value) {
+    value = 0;
+    for(auto shift = 0; shift < 35; shift += 7) {
+        if(offset >= m_size) {
+            return false;
+        }
+        auto byte = m_data[offset++];
+        value |= (u4)(byte & 0x7f) << shift;
+        if(!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+QString DexFile::string(u4 idx) {
+    u4 offset;
+    u4 length;
+    if(idx >= m_stringIdsSize || !readU4(m_stringIdsOff + idx * 4, offset)
+       || !readUleb128(offset, length)) {
+        return QString();
+    }
+
+    // MUTF-8, every character is one UTF-16 unit in 1 to 3 bytes
+    QString result;
+    result.reserve((int)qMin(length, m_size));
+    auto p = m_data + offset;
+    auto end = m_data + m_size;
+    for(u4 i = 0; i < length && p < end; i++) {
+        u2 c = *p++;
+        if(c >= 0x80) {
+            if((c & 0xE0) == 0xC0 && p < end) {
+                c = (u2)(((c & 0x1F) << 6) | (p[0] & 0x3F));
+                p++;
+            } else if((c & 0xF0) == 0xE0 && end - p >= 2) {
+                c = (u2)(((c & 0x0F) << 12) | ((p[0] & 0x3F) << 6) | (p[1] & 0x3F));
+                p += 2;
+            } else {
+                return QString();
+            }
+        }
+        result.push_back(QChar(c));
+    }
+    return StringPool::instance()->intern(result);
+}
+
+QString DexFile::type(u4 idx) {
+    if(idx >= m_typeIdsSize) {
+        return QString();
+    }
+    if(!m_typeLoaded[idx]) {
+        u4 descriptorIdx;
+        readU4(m_typeIdsOff + idx * 4, descriptorIdx);
+        m_types[idx] = string(descriptorIdx);
+        m_typeLoaded[idx] = true;
+    }
+    return m_types[idx];
+}
+
+SmaliFile *DexFile::loadClass(int idx, const QString &sourceDir) {
+    if(idx < 0 || (u4)idx >= m_classDefsSize) {
+        return nullptr;
+    }
+    auto def = m_classDefsOff + (u4)idx * 32;
+    u4 classIdx, accessFlags, classDataOff;
+    readU4(def, classIdx);
+    readU4(def + 4, accessFlags);
+    readU4(def + 24, classDataOff);
+
+    auto name = type(classIdx);
+    if(name.size() < 3 || !name.startsWith('L') || !name.endsWith(';')
+       || name == "Ljava/lang/Object;") {
+        return nullptr;
+    }
+
+    auto* filedata = new SmaliFile;
+    filedata->m_filepath = sourceDir + '/' + m_smaliDirName + '/'
+                           + name.mid(1, name.size() - 2) + ".smali";
+    filedata->m_name = name;
+    filedata->m_accessflag = accessFlags;
+    filedata->m_fromDex = true;
+    filedata->m_isValid = true;
+    // class without field and method
+    if(classDataOff == 0) {
+        return filedata;
+    }
+
+    auto offset = classDataOff;
+    u4 staticFields, instanceFields, directMethods, virtualMethods;
+    if(!readUleb128(offset, staticFields) || !readUleb128(offset, instanceFields)
+       || !readUleb128(offset, directMethods) || !readUleb128(offset, virtualMethods)
+       || !readFields(offset, staticFields, filedata)
+       || !readFields(offset, instanceFields, filedata)
+       || !readMethods(offset, directMethods, filedata)
+       || !readMethods(offset, virtualMethods, filedata)) {
+        delete filedata;
+        return nullptr;
+    }
+    return filedata;
+}
+
+bool DexFile::readFields(u4 &offset, u4 count, SmaliFile *filedata) {
+    // field index is stored as difference to the previous one
+    u4 fieldIdx = 0;
+    for(u4 i = 0; i < count; i++) {
+        u4 diff, accessFlags;
+        if(!readUleb128(offset, diff) || !readUleb128(offset, accessFlags)) {
+            return false;
+        }
+        fieldIdx += diff;
+        if(fieldIdx >= m_fieldIdsSize) {
+            return false;
+        }
+        auto item = m_fieldIdsOff + fieldIdx * 8;
+        u2 typeIdx;
+        u4 nameIdx;
+        readU2(item + 2, typeIdx);
+        readU4(item + 4, nameIdx);
+
+        auto field = filedata->m_arena.newField();
+        filedata->m_fields.push_back(field);
+        field->m_name = string(nameIdx);
+        field->m_accessflag = accessFlags;
+        field->m_class = type(typeIdx);
+        field->m_line = -1;
+    }
+    return true;
+}
+
+bool DexFile::readMethods(u4 &offset, u4 count, SmaliFile *filedata) {
+    u4 methodIdx = 0;
+    for(u4 i = 0; i < count; i++) {
+        u4 diff, accessFlags, codeOff;
+        if(!readUleb128(offset, diff) || !readUleb128(offset, accessFlags)
+           || !readUleb128(offset, codeOff)) {
+            return false;
+        }
+        methodIdx += diff;
+        if(methodIdx >= m_methodIdsSize) {
+            return false;
+        }
+        auto item = m_methodIdsOff + methodIdx * 8;
+        u2 protoIdx;
+        u4 nameIdx;
+        readU2(item + 2, protoIdx);
+        readU4(item + 4, nameIdx);
+        if(protoIdx >= m_protoIdsSize) {
+            return false;
+        }
+
+        auto method = filedata->m_arena.newMethod();
+        filedata->m_methods.push_back(method);
+        method->m_name = string(nameIdx);
+        method->m_accessflag = accessFlags;
+
+        auto proto = m_protoIdsOff + (u4)protoIdx * 12;
+        u4 returnIdx, paramsOff;
+        readU4(proto + 4, returnIdx);
+        readU4(proto + 8, paramsOff);
+        method->m_ret = type(returnIdx);
+        if(paramsOff != 0) {
+            u4 paramCount;
+            if(!readU4(paramsOff, paramCount)
+               || (quint64)paramsOff + 4 + (quint64)paramCount * 2 > m_size) {
+                return false;
+            }
+            for(u4 j = 0; j < paramCount; j++) {
+                u2 typeIdx;
+                readU2(paramsOff + 4 + j * 2, typeIdx);
+                method->m_params.push_back(type(typeIdx));
+            }
+        }
+
+        if(codeOff == 0 || (accessFlags & ACC_NATIVE)) {
+            continue;
+        }
+        u2 registers, ins;
+        if(!readU2(codeOff, registers) || !readU2(codeOff + 2, ins)) {
+            return false;
+        }
+        // same register counting as SmaliFileListener
+        if(accessFlags & ACC_STATIC) {
+            method->m_paramRegisterCount = method->m_params.size();
+        } else {
+            method->m_paramRegisterCount = method->m_params.size() + 1;
+        }
+        method->m_localRegisterCount = registers - ins;
+    }
+    return true;
+}
@@ -0,0 +1,86 @@
+//===- DexFile.h - ART-GUI Analysis engine ----------------------*- cpp -*-===//
+//
+//                     ANDROID REVERSE TOOLKIT
+//
+// This file is distributed under the GNU GENERAL PUBLIC LICENSE
+// V3 License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// DexFile reads class, field and method declarations straight from a .dex
+// file, or from the classes*.dex entries of an apk, so the project can be
+// browsed before apktool has written the smali files.
+//
+// The file is memory mapped. Entries stored in the apk without compression
+// are read in place, deflated entries are inflated into memory. Strings and
+// types are decoded when a class needs them.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef ANDROIDREVERSETOOLKIT_DEXFILE_H
+#define ANDROIDREVERSETOOLKIT_DEXFILE_H
+
+#include "utils/Defs.h"
+
+#include <QByteArray>
+#include <QFile>
+#include <QList>
+#include <QSharedPointer>
+#include <QString>
+#include <QVector>
+
+class SmaliFile;
+
+class DexFile {
+public:
+    // open a .dex file, or every classes*.dex in an apk in the order
+    // apktool numbers them. Invalid dex files are skipped.
+    static QList<QSharedPointer<DexFile>> load(const QString &path);
+
+    // smali directory apktool writes this dex to, smali or smali_classes2...
+    QString smaliDirName() { return m_smaliDirName; }
+    int classCount() { return (int)m_classDefsSize; }
+
+    /**
+     * build declaration data of class_def idx. Source path is where apktool
+     * writes the class under sourceDir. Methods have register counts but
+     * no instruction, a dex has no smali line to map them to.
+     * @return nullptr if the class data is invalid
+     */
+    SmaliFile* loadClass(int idx, const QString &sourceDir);
+
+private:
+    DexFile(QSharedPointer<QFile> file, const uchar* data, u4 size,
+            const QByteArray &inflated, const QString &smaliDirName);
+
+    bool parseHeader();
+    bool readU4(u4 offset, u4 &value);
+    bool readU2(u4 offset, u2 &value);
+    bool readUleb128(u4 &offset, u4 &value);
+
+    QString string(u4 idx);
+    QString type(u4 idx);
+    bool readFields(u4 &offset, u4 count, SmaliFile* filedata);
+    bool readMethods(u4 &offset, u4 count, SmaliFile* filedata);
+
+    // keeps the apk mapping alive, null for inflated data
+    QSharedPointer<QFile> m_file;
+    QByteArray m_inflated;
+    const uchar* m_data;
+    u4 m_size;
+    QString m_smaliDirName;
+
+    u4 m_stringIdsSize = 0, m_stringIdsOff = 0;
+    u4 m_typeIdsSize = 0, m_typeIdsOff = 0;
+    u4 m_protoIdsSize = 0, m_protoIdsOff = 0;
+    u4 m_fieldIdsSize = 0, m_fieldIdsOff = 0;
+    u4 m_methodIdsSize = 0, m_methodIdsOff = 0;
+    u4 m_classDefsSize = 0, m_classDefsOff = 0;
+
+    // decoded type descriptors, types are shared by many classes
+    QVector<QString> m_types;
+    QVector<bool> m_typeLoaded;
+};
+
+
+#endif //ANDROIDREVERSETOOLKIT_DEXFILE_H
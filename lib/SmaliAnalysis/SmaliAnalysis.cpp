@@ -13,18 +13,30 @@
 //===----------------------------------------------------------------------===//
 
 #include "SmaliAnalysis/SmaliAnalysis.h"
+#include "SmaliIndexCache.h"
+#include "DexFile.h"
 
 #include <utils/ProjectInfo.h>
+#include <utils/CmdMsgUtil.h>
+#include <utils/ScriptEngine.h>
+#include <utils/StringPool.h>
 
 #include <fstream>
 #include <QtCore/QObject>
 #include <QDebug>
 #include <QDirIterator>
+#include <QHash>
 #include <QDir>
+#include <QMutex>
+#include <QRunnable>
+#include <QThreadPool>
 #include <utils/StringUtil.h>
 
 using namespace std;
 
+// time to wait for more change notifications before re-parsing, in ms
+static const int kReindexDelay = 300;
+
 SmaliAnalysis *SmaliAnalysis::instance ()
 {
     static SmaliAnalysis* mPtr = nullptr;
@@ -40,10 +52,23 @@ SmaliAnalysis::SmaliAnalysis()
       m_fieldIcon(":/images/field.png"),
       m_methodIcon(":/images/method.png")
 {
+    qRegisterMetaType<QList<SmaliFile*>>("QList<SmaliFile*>");
     invisibleRootItem()->setColumnCount(2);
 
-    connect(&m_fileWatcher, &QFileSystemWatcher::fileChanged, [this](QString path) {
-        startFileParseThread(path);
+    m_reindexTimer.setSingleShot(true);
+    m_reindexTimer.setInterval(kReindexDelay);
+    connect(&m_reindexTimer, &QTimer::timeout, this, &SmaliAnalysis::onReindexTimeout);
+    // leave cores to the editor and the project indexer
+    m_reindexPool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() / 2));
+
+    connect(&m_fileWatcher, &QFileSystemWatcher::fileChanged,
+            this, &SmaliAnalysis::reindexFile);
+
+    // LoadDex(apk, sourceDir) is queued before apktool disassembles the apk
+    connect(ScriptEngine::instance(), &ScriptEngine::loadDex, this, [this](QStringList args) {
+        if(args.size() >= 2) {
+            addDexSource(args[0], args[1]);
+        }
     });
 }
 
@@ -53,27 +78,304 @@ SmaliAnalysis::~SmaliAnalysis() {
 void SmaliAnalysis::addSourcePath(QString source) {
     m_sourceDir << source;
 
+    if(m_indexCachePath.isEmpty() && ProjectInfo::isProjectOpened()) {
+        m_indexCachePath = ProjectInfo::current()->getIndexCachePath();
+        auto cache = QSharedPointer<SmaliIndexCache>::create(m_indexCachePath);
+        if(cache->open()) {
+            m_indexCache = cache;
+        }
+    }
+
     startFileParseThread(source);
 }
 
+void SmaliAnalysis::addDexSource(QString path, QString sourceDir) {
+    SmaliAnalysisThread* thread = new SmaliAnalysisThread(path, m_generation, this);
+    // same form as the paths of parsed smali files
+    thread->setDexSourceDir(QDir(sourceDir).absolutePath());
+    connect(thread, &SmaliAnalysisThread::filesAnalysisFinished,
+            this, &SmaliAnalysis::onFilesAnalysisFinished);
+    thread->start();
+}
+
 void SmaliAnalysis::startFileParseThread(QString path) {
-    SmaliAnalysisThread* thread = new SmaliAnalysisThread(path, this);
-    connect(thread, &SmaliAnalysisThread::fileAnalysisFinished, this, &SmaliAnalysis::onFileAnalysisFinished);
+    SmaliAnalysisThread* thread = new SmaliAnalysisThread(path, m_generation, this);
+    thread->setIndexCache(m_indexCache);
+    connect(thread, &SmaliAnalysisThread::filesAnalysisFinished,
+            this, &SmaliAnalysis::onFilesAnalysisFinished);
+    connect(thread, &SmaliAnalysisThread::analysisProgress,
+            this, &SmaliAnalysis::onAnalysisProgress);
+    if(QFileInfo(path).isDir()) {
+        auto generation = m_generation;
+        m_pendingSources++;
+        connect(thread, &QThread::finished, this, [this, generation]() {
+            onSourceAnalysisFinished(generation);
+        });
+    }
     thread->start();
 }
 
 void SmaliAnalysis::clear() {
+    // stop running analysis, results still queued for us are dropped
+    // because their generation no longer matches.
+    m_generation++;
+    for(auto thread: findChildren<SmaliAnalysisThread*>()) {
+        thread->cancel();
+    }
+    m_reindexTimer.stop();
+    m_dirtyFiles.clear();
+    m_reindexRunning = false;
+    // a partial index would drop entries of files not parsed yet
+    if(m_pendingSources == 0) {
+        saveIndexCache();
+    }
+    m_pendingSources = 0;
+    m_indexCache.clear();
+    m_indexCachePath.clear();
+    m_indexCacheDirty = false;
+
     removeAllSmaliFile();
     removeAllSmaliTree();
     m_sourceDir.clear();
+    // descriptors of the closed project
+    StringPool::instance()->squeeze();
+}
+
+void SmaliAnalysis::onFilesAnalysisFinished (QList<SmaliFile*> files, int generation)
+{
+    if(generation != m_generation) {
+        qDeleteAll(files);
+        return;
+    }
+
+    QStringList paths;
+    for(auto file: files) {
+        if(file->isFromDex()) {
+            // nothing to watch or show in tree until the smali is written,
+            // and data parsed from smali is kept.
+            if(getSmaliFile(file->sourceFile()).isNull()) {
+                addSmaliFileinToMap(file);
+            } else {
+                delete file;
+            }
+            continue;
+        }
+        if(!file->isCached()) {
+            m_indexCacheDirty = true;
+        }
+        addSmaliFileinToMap(file);
+        addSmaliFileinToTree(file->sourceFile());
+        paths << file->sourceFile();
+    }
+    m_fileWatcher.addPaths(paths);
+    // many files at once, the next search builds the index again
+    m_symbolIndexDirty = true;
+
+    for(auto &path: paths) {
+        fileAnalysisFinished(path);
+    }
 }
 
-void SmaliAnalysis::onFileAnalysisFinished (SmaliFile* file)
+void SmaliAnalysis::onAnalysisProgress (int finished, int total, int generation)
 {
-    qDebug() << "file analysis finished: " << file->sourceFile();
-    addSmaliFileinToMap(file);
-    addSmaliFileinToTree(file->sourceFile());
-    fileAnalysisFinished(file->sourceFile());
+    if(generation != m_generation) {
+        return;
+    }
+    analysisProgress(finished, total);
+    if(finished < total) {
+        cmdmsg()->setStatusMsg(tr("indexing %1/%2").arg(finished).arg(total));
+    } else {
+        cmdmsg()->setStatusMsg(tr("ready"));
+    }
+}
+
+void SmaliAnalysis::onSourceAnalysisFinished (int generation)
+{
+    if(generation != m_generation || --m_pendingSources > 0) {
+        return;
+    }
+    // every source is indexed now, drop the old cache and save a new one
+    m_indexCache.clear();
+    saveIndexCache();
+}
+
+void SmaliAnalysis::reindexFile(QString path) {
+    // the change was saved by an editor and is in the model already
+    auto filedata = getSmaliFile(path);
+    if(!filedata.isNull() && filedata->isUpToDate()) {
+        return;
+    }
+    m_dirtyFiles.insert(path);
+    // restart the timer, a burst of changes is handled after it settles
+    if(!m_reindexRunning) {
+        m_reindexTimer.start();
+    }
+}
+
+void SmaliAnalysis::updateSmaliFile(SmaliFile *filedata) {
+    auto path = filedata->sourceFile();
+    if(!filedata->isValid()) {
+        // let the file parser decide what to keep
+        delete filedata;
+        reindexFile(path);
+        return;
+    }
+    m_dirtyFiles.remove(path);
+    m_indexCacheDirty = true;
+
+    QStringList removed;
+    if(auto old = getSmaliFile(path)) {
+        removed << old->sourceFile();
+        removeSmaliFileFromMap(path);
+        removeSmaliFromTree(path);
+    }
+    addSmaliFileinToMap(filedata);
+    if(!m_symbolIndexDirty) {
+        m_symbolIndex.update(removed, QList<SmaliFile*>() << filedata);
+    }
+    addSmaliFileinToTree(path);
+    m_fileWatcher.addPath(path);
+    fileAnalysisFinished(path);
+}
+
+// Files changed in one burst are parsed by a few tasks on the bounded
+// reindex pool. The last finished task hands the whole result back, so the
+// model is updated once per burst.
+struct SmaliReindexBatch {
+    QMutex lock;
+    QList<SmaliFile*> files;
+    QStringList paths;
+    int generation;
+    QAtomicInt remaining;
+};
+
+class SmaliReindexTask: public QRunnable {
+public:
+    SmaliReindexTask(QSharedPointer<SmaliReindexBatch> batch, QStringList paths)
+            : m_batch(batch), m_paths(paths) {}
+
+    void run() override {
+        QList<SmaliFile*> files;
+        for(auto &path: m_paths) {
+            // removed or broken files are dropped from model
+            auto* filedata = new SmaliFile(path);
+            if(!filedata->isValid()) {
+                delete filedata;
+                continue;
+            }
+            files << filedata;
+        }
+
+        {
+            QMutexLocker locker(&m_batch->lock);
+            m_batch->files << files;
+        }
+        if(!m_batch->remaining.deref()) {
+            QMetaObject::invokeMethod(SmaliAnalysis::instance(), "onFilesReindexed",
+                                      Qt::QueuedConnection,
+                                      Q_ARG(QList<SmaliFile*>, m_batch->files),
+                                      Q_ARG(QStringList, m_batch->paths),
+                                      Q_ARG(int, m_batch->generation));
+        }
+    }
+private:
+    QSharedPointer<SmaliReindexBatch> m_batch;
+    QStringList m_paths;
+};
+
+void SmaliAnalysis::onReindexTimeout() {
+    if(m_dirtyFiles.isEmpty()) {
+        return;
+    }
+    auto paths = m_dirtyFiles.toList();
+    m_dirtyFiles.clear();
+    m_reindexRunning = true;
+
+    auto tasks = qBound(1, m_reindexPool.maxThreadCount(), paths.size());
+    auto batch = QSharedPointer<SmaliReindexBatch>::create();
+    batch->paths = paths;
+    batch->generation = m_generation;
+    batch->remaining.store(tasks);
+    for(auto i = 0; i < tasks; i++) {
+        auto begin = paths.size() * i / tasks;
+        auto end = paths.size() * (i + 1) / tasks;
+        m_reindexPool.start(new SmaliReindexTask(batch, paths.mid(begin, end - begin)));
+    }
+}
+
+void SmaliAnalysis::onFilesReindexed(QList<SmaliFile*> files, QStringList paths,
+                                     int generation) {
+    if(generation != m_generation) {
+        qDeleteAll(files);
+        return;
+    }
+    m_reindexRunning = false;
+    m_indexCacheDirty = true;
+
+    // drop the old data first, a path without new data was removed
+    // or can not be parsed any more.
+    QSet<QString> updated;
+    QStringList removed;
+    for(auto &path: paths) {
+        if(auto old = getSmaliFile(path)) {
+            removed << old->sourceFile();
+            removeSmaliFileFromMap(path);
+            removeSmaliFromTree(path);
+            updated.insert(path);
+        }
+    }
+    QStringList parsed;
+    for(auto file: files) {
+        addSmaliFileinToMap(file);
+        addSmaliFileinToTree(file->sourceFile());
+        parsed << file->sourceFile();
+        updated.insert(file->sourceFile());
+    }
+    if(!m_symbolIndexDirty) {
+        m_symbolIndex.update(removed, files);
+    }
+    // editors saving by rename make the watcher lose the path
+    m_fileWatcher.addPaths(parsed);
+
+    for(auto &path: updated) {
+        fileAnalysisFinished(path);
+    }
+
+    // changes arrived while this batch was parsed
+    if(!m_dirtyFiles.isEmpty()) {
+        m_reindexTimer.start();
+    }
+}
+
+QList<SmaliSymbol> SmaliAnalysis::findSymbols(QString query, int limit) {
+    if(m_symbolIndexDirty) {
+        QList<QSharedPointer<SmaliFile>> files;
+        for(auto it = m_filenamesMap.constBegin(), itEnd = m_filenamesMap.constEnd();
+            it != itEnd; ++it) {
+            files << it.value()->values();
+        }
+        m_symbolIndex.build(files);
+        m_symbolIndexDirty = false;
+    }
+    return m_symbolIndex.find(query, limit);
+}
+
+QList<SmaliXref> SmaliAnalysis::findReferences(QString descriptor) {
+    return m_xrefIndex.references(descriptor);
+}
+
+void SmaliAnalysis::saveIndexCache() {
+    if(m_indexCachePath.isEmpty() || !m_indexCacheDirty) {
+        return;
+    }
+    QList<QSharedPointer<SmaliFile>> files;
+    for(auto it = m_filenamesMap.constBegin(), itEnd = m_filenamesMap.constEnd();
+        it != itEnd; ++it) {
+        files << it.value()->values();
+    }
+    if(SmaliIndexCache::save(m_indexCachePath, files)) {
+        m_indexCacheDirty = false;
+    }
 }
 
 void SmaliAnalysis::addSmaliFileinToMap(SmaliFile *smaliFile) {
@@ -81,17 +383,23 @@ void SmaliAnalysis::addSmaliFileinToMap(SmaliFile *smaliFile) {
     const QString &path = fi.path();
     if (!m_filenamesMap.contains(path))
         m_filenamesMap.insert(path, new FileNameDatasMap());
+    // the replaced data is deleted with its last reference
+    if (auto old = m_filenamesMap.value(path)->value(fi.fileName())) {
+        m_xrefIndex.removeFile(old.data());
+    }
     QSharedPointer<SmaliFile> filedata(smaliFile);
     m_filenamesMap.value(path)->insert(fi.fileName(), filedata);
     m_classnamesMap.insert(filedata->name(), filedata);
-
-    m_fileWatcher.addPath(smaliFile->sourceFile());
+    m_xrefIndex.addFile(smaliFile);
 }
 
 bool SmaliAnalysis::removeSmaliFileFromMap(QString fileName) {
     m_fileWatcher.removePath(fileName);
 
     auto filedata = getSmaliFile(fileName);
+    if (!filedata.isNull()) {
+        m_xrefIndex.removeFile(filedata.data());
+    }
 
     bool found = false;
     const QFileInfo fi(fileName);
@@ -117,6 +425,9 @@ void SmaliAnalysis::removeAllSmaliFile() {
     }
     m_filenamesMap.clear();
     m_classnamesMap.clear();
+    m_symbolIndex.clear();
+    m_symbolIndexDirty = true;
+    m_xrefIndex.clear();
 }
 
 void SmaliAnalysis::addSmaliFileinToTree(QString filepath) {
@@ -226,42 +537,254 @@ QSharedPointer<SmaliFile> SmaliAnalysis::getSmaliFileBySig(QString sig) {
     return m_classnamesMap.value(sig);
 }
 
+void SmaliAnalysis::getSourceLocations(QVector<SmaliLocation> &locations) {
+    QHash<QString, QSharedPointer<SmaliFile>> files;
+    QHash<QString, SmaliMethod*> methods;
+    for(auto &location: locations) {
+        if(location.m_classSig.isEmpty()) {
+            continue;
+        }
+        auto fileIt = files.constFind(location.m_classSig);
+        if(fileIt == files.constEnd()) {
+            auto filedata = getSmaliFileBySig(location.m_classSig);
+            // a class read from dex has no smali file until apktool writes it
+            if(!filedata.isNull() && filedata->isFromDex()
+               && !QFileInfo::exists(filedata->sourceFile())) {
+                filedata.clear();
+            }
+            fileIt = files.insert(location.m_classSig, filedata);
+        }
+        auto filedata = fileIt.value();
+        if(filedata.isNull()) {
+            continue;
+        }
+        location.m_hasSource = true;
+        location.m_sourceFile = filedata->sourceFile();
+
+        auto key = location.m_classSig + "->" + location.m_methodName + location.m_methodSig;
+        auto methodIt = methods.constFind(key);
+        if(methodIt == methods.constEnd()) {
+            methodIt = methods.insert(key, filedata->method(location.m_methodName,
+                                                            location.m_methodSig));
+        }
+        auto method = methodIt.value();
+        if(method == nullptr) {
+            location.m_line = 1;
+            continue;
+        }
+        location.m_line = method->getSourceLocationForCodeIdx(location.m_codeIdx);
+        if(location.m_line == -1) {
+            // methods read from dex have no instruction, nor a start line
+            location.m_line = method->m_startline > 0 ? method->m_startline : 1;
+        }
+    }
+}
+
+
+// Each indexer worker owns a contiguous slice of the file list. The owner
+// consumes it from the front, idle workers steal the back half of the
+// largest remaining slice.
+struct SmaliAnalysisThread::WorkRange {
+    QMutex lock;
+    int begin = 0;
+    int end = 0;
+};
+
+class SmaliAnalysisTask: public QRunnable {
+public:
+    SmaliAnalysisTask(SmaliAnalysisThread* thread, int self)
+            : m_thread(thread), m_self(self) {}
+
+    void run() override {
+        m_thread->runWorker(m_self);
+    }
+private:
+    SmaliAnalysisThread* m_thread;
+    int m_self;
+};
+
+// parsed files handed to SmaliAnalysis in one queued signal
+static const int kAnalysisBatchSize = 64;
 
-SmaliAnalysisThread::SmaliAnalysisThread (QString path, QObject *parent)
+SmaliAnalysisThread::SmaliAnalysisThread (QString path, int generation, QObject *parent)
         : QThread (parent)
 {
     m_src = path;
+    m_generation = generation;
     connect(this, SIGNAL(finished()), this, SLOT(deleteLater()));
 }
 
 void SmaliAnalysisThread::run ()
 {
     QFileInfo fi(m_src);
-    if(fi.isDir()) {
+    if(!m_dexSourceDir.isEmpty()) {
+        parseDex();
+    } else if(fi.isDir()) {
         parseDirectory(m_src);
     } else {
-        parseFile(m_src);
+        auto* filedata = parseFile(m_src);
+        if(filedata != nullptr) {
+            filesAnalysisFinished(QList<SmaliFile*>() << filedata, m_generation);
+        }
     }
 }
 
-void SmaliAnalysisThread::parseFile(QString path) {
-    auto* filedata = new SmaliFile(path);
+SmaliFile* SmaliAnalysisThread::parseFile(QString path) {
+    SmaliFile* filedata = nullptr;
+    if(!m_cache.isNull()) {
+        filedata = m_cache->load(path);
+    }
+    if(filedata == nullptr) {
+        filedata = new SmaliFile(path);
+    }
     if(!filedata->isValid()) {
         delete filedata;
-        return;
+        return nullptr;
     }
-    fileAnalysisFinished(filedata);
+    return filedata;
 }
 
 void SmaliAnalysisThread::parseDirectory(QString path) {
-    QDirIterator it(path, QDirIterator::Subdirectories);
+    QDirIterator it(path, QStringList() << "*.smali", QDir::Files,
+                    QDirIterator::Subdirectories);
     while (it.hasNext()) {
-        auto filePath = it.next();
-        auto info = QFileInfo(filePath);
-        if(info.isFile () && info.fileName ().endsWith (".smali")) {
-            parseFile(info.absoluteFilePath());
+        if(isCanceled()) {
+            return;
+        }
+        it.next();
+        m_files << it.fileInfo().absoluteFilePath();
+    }
+    auto count = m_files.size();
+    if(count == 0) {
+        return;
+    }
+
+    auto workers = qBound(1, QThread::idealThreadCount(), count);
+    for(auto i = 0; i < workers; i++) {
+        auto range = new WorkRange;
+        range->begin = (qint64)count * i / workers;
+        range->end = (qint64)count * (i + 1) / workers;
+        m_ranges << range;
+    }
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(workers);
+    for(auto i = 0; i < workers; i++) {
+        pool.start(new SmaliAnalysisTask(this, i));
+    }
+    pool.waitForDone();
+
+    qDeleteAll(m_ranges);
+    m_ranges.clear();
+    m_files.clear();
+
+    if(!isCanceled()) {
+        analysisProgress(count, count, m_generation);
+    }
+}
+
+void SmaliAnalysisThread::parseDex() {
+    QList<SmaliFile*> batch;
+    for(auto &dex: DexFile::load(m_src)) {
+        for(auto i = 0, count = dex->classCount(); i < count; i++) {
+            if(isCanceled()) {
+                qDeleteAll(batch);
+                return;
+            }
+            if(auto* filedata = dex->loadClass(i, m_dexSourceDir)) {
+                batch << filedata;
+            }
+            if(batch.size() >= kAnalysisBatchSize) {
+                filesAnalysisFinished(batch, m_generation);
+                batch.clear();
+            }
         }
     }
+    if(!batch.isEmpty()) {
+        filesAnalysisFinished(batch, m_generation);
+    }
 }
 
+void SmaliAnalysisThread::runWorker(int self) {
+    auto range = m_ranges[self];
+    QList<SmaliFile*> batch;
+    int pending = 0;
+    while(!isCanceled()) {
+        int idx = -1;
+        {
+            QMutexLocker locker(&range->lock);
+            if(range->begin < range->end) {
+                idx = range->begin++;
+            }
+        }
+        if(idx == -1) {
+            if(!stealWork(self)) {
+                break;
+            }
+            continue;
+        }
 
+        if(auto* filedata = parseFile(m_files.at(idx))) {
+            batch << filedata;
+        }
+        m_finished.fetchAndAddRelaxed(1);
+        if(++pending >= kAnalysisBatchSize) {
+            flushBatch(batch);
+            pending = 0;
+        }
+    }
+
+    if(isCanceled()) {
+        qDeleteAll(batch);
+        return;
+    }
+    flushBatch(batch);
+}
+
+bool SmaliAnalysisThread::stealWork(int self) {
+    int victim = -1;
+    int most = 0;
+    for(auto i = 0; i < m_ranges.size(); i++) {
+        if(i == self) {
+            continue;
+        }
+        auto range = m_ranges[i];
+        QMutexLocker locker(&range->lock);
+        if(range->end - range->begin > most) {
+            most = range->end - range->begin;
+            victim = i;
+        }
+    }
+    // every slice is drained, nothing left to steal
+    if(victim == -1) {
+        return false;
+    }
+
+    int begin, end;
+    {
+        auto range = m_ranges[victim];
+        QMutexLocker locker(&range->lock);
+        auto left = range->end - range->begin;
+        if(left <= 0) {
+            // the owner finished it meanwhile, look for another victim
+            return true;
+        }
+        end = range->end;
+        begin = range->end - (left + 1) / 2;
+        range->end = begin;
+    }
+
+    auto own = m_ranges[self];
+    QMutexLocker locker(&own->lock);
+    own->begin = begin;
+    own->end = end;
+    return true;
+}
+
+void SmaliAnalysisThread::flushBatch(QList<SmaliFile*> &batch) {
+    if(!batch.isEmpty()) {
+        filesAnalysisFinished(batch, m_generation);
+        batch.clear();
+    }
+    analysisProgress(m_finished.load(), m_files.size(), m_generation);
+}
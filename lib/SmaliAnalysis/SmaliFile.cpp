@@ -10,6 +10,15 @@
 #include "SmaliAnalysis/SmaliFile.h"
 
 #include "SmaliFileListener.h"
+#include "SmaliScanner.h"
+
+#include <utils/StringPool.h>
+
+#include <algorithm>
+
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
 
 #define NUM_FLAGS   18
 
@@ -17,24 +26,56 @@ SmaliFile::SmaliFile(const QString& file)
 {
     m_filepath = file;
 
+    QFile source(file);
+    if(!source.open(QFile::ReadOnly)) {
+        return;
+    }
+    m_fileSize = source.size();
+    m_fileModified = QFileInfo(source).lastModified().toMSecsSinceEpoch();
+
+    auto* data = m_fileSize > 0 ? source.map(0, m_fileSize) : nullptr;
+    if(data != nullptr) {
+        bool scanned = SmaliScanner(this).scan((const char*)data, m_fileSize);
+        source.unmap(data);
+        if(scanned) {
+            return;
+        }
+    }
+
     antlr4::ANTLRFileStream input(file.toStdString());
-    SmaliLexer lexer(&input);
-    antlr4::CommonTokenStream tokens(&lexer);
-    tokens.fill();
+    parse(input);
+}
 
-    SmaliParser parser(&tokens);
-    SmaliFileListener listener(this);
+SmaliFile::SmaliFile(const QString& file, const QString &inputs) {
+    m_filepath = file;
 
-    auto* tree = parser.smali_file();
-    antlr4::tree::ParseTreeWalker::DEFAULT.walk(&listener, tree);
+    auto bytes = inputs.toUtf8();
+    if(SmaliScanner(this).scan(bytes.constData(), bytes.size())) {
+        return;
+    }
+
+    antlr4::ANTLRInputStream input(bytes.toStdString());
+    parse(input);
 }
 
-SmaliFile::SmaliFile(const QString& file, const QString &inputs) {
+SmaliFile::SmaliFile(const QString& file, antlr4::TokenSource &tokens) {
     m_filepath = file;
 
-    antlr4::ANTLRInputStream input(inputs.toStdString());
+    QFileInfo fi(file);
+    if(fi.exists()) {
+        m_fileSize = fi.size();
+        m_fileModified = fi.lastModified().toMSecsSinceEpoch();
+    }
+    parse(tokens);
+}
+
+void SmaliFile::parse(antlr4::ANTLRInputStream &input) {
     SmaliLexer lexer(&input);
-    antlr4::CommonTokenStream tokens(&lexer);
+    parse(lexer);
+}
+
+void SmaliFile::parse(antlr4::TokenSource &source) {
+    antlr4::CommonTokenStream tokens(&source);
     tokens.fill();
 
     SmaliParser parser(&tokens);
@@ -45,9 +86,16 @@ SmaliFile::SmaliFile(const QString& file, const QString &inputs) {
 }
 
 
+bool SmaliFile::isUpToDate() {
+    if(m_fileSize < 0) {
+        return false;
+    }
+    QFileInfo fi(m_filepath);
+    return fi.exists() && fi.size() == m_fileSize
+           && fi.lastModified().toMSecsSinceEpoch() == m_fileModified;
+}
+
 SmaliFile::~SmaliFile() {
-    qDeleteAll(m_fields);
-    qDeleteAll(m_methods);
 }
 
 QString SmaliFile::buildAccessFlag() {
@@ -125,13 +173,41 @@ SmaliField *SmaliFile::field(QString name) {
 
 SmaliMethod *SmaliFile::method(QString name, QString sig) {
     for(auto &method: m_methods) {
-        if(method->m_name == name && method->buildProto() == sig) {
+        if(StringPool::equal(method->m_name, name)
+           && StringPool::equal(method->buildProto(), sig)) {
             return method;
         }
     }
     return nullptr;
 }
 
+SmaliMethod *SmaliFile::methodAtLine(int line) {
+    if(!m_methodsByLineBuilt) {
+        for(auto method: m_methods) {
+            // methods read from dex have no line
+            if(method->m_startline > 0) {
+                m_methodsByLine.push_back(method);
+            }
+        }
+        std::sort(m_methodsByLine.begin(), m_methodsByLine.end(),
+                  [](const SmaliMethod* a, const SmaliMethod* b) {
+                      return a->m_startline < b->m_startline;
+                  });
+        m_methodsByLineBuilt = true;
+    }
+
+    // last method starting at or before line
+    auto it = std::upper_bound(m_methodsByLine.constBegin(), m_methodsByLine.constEnd(), line,
+                               [](int line, const SmaliMethod* method) {
+                                   return line < method->m_startline;
+                               });
+    if(it == m_methodsByLine.constBegin()) {
+        return nullptr;
+    }
+    auto method = *(it - 1);
+    return line <= method->m_endline ? method : nullptr;
+}
+
 //void SmaliFile::print() {
 //    if(!m_smali->isValid)
 //        cout << "smali file is not valid!!!" << endl;
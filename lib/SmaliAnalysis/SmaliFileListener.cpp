@@ -8,38 +8,51 @@
 //===----------------------------------------------------------------------===//
 
 #include "SmaliFileListener.h"
+#include "SmaliScanner.h"
 
 #include "SmaliAnalysis/SmaliFile.h"
+#include <utils/StringPool.h>
 #include "LiteralTools.h"
 
+// getText() joins the access words without space
+static QString accessListText(SmaliParser::Access_listContext *ctx) {
+    QStringList flags;
+    for(auto access: ctx->ACCESS_SPEC()) {
+        flags << QString::fromStdString(access->getText());
+    }
+    return flags.join(' ');
+}
+
 SmaliFileListener::SmaliFileListener(SmaliFile *filedata) {
     m_smali = filedata;
 }
 
 void SmaliFileListener::enterMethod(SmaliParser::MethodContext *ctx) {
-    auto method = new SmaliMethod;
+    auto method = m_smali->m_arena.newMethod();
     m_smali->m_methods.push_back(method);
 
     method->m_startline = ctx->METHOD_DIRECTIVE()->getSymbol()->getLine();
     method->m_endline = ctx->END_METHOD_DIRECTIVE()->getSymbol()->getLine();
 
     method->m_accessflag = method->getAccessFlag(
-            QString::fromStdString(ctx->access_list()->getText()));
-    method->m_name = QString::fromStdString(ctx->member_name()->getText());
+            accessListText(ctx->access_list()));
+    method->m_name = StringPool::instance()->intern(QString::fromStdString(ctx->member_name()->getText()));
     {
         auto proto = ctx->method_prototype();
         auto param = proto->param_list();
         for(auto &paramctx: param->nonvoid_type_descriptor()) {
-            method->m_params.push_back(QString::fromStdString(paramctx->getText()));
+            method->m_params.push_back(StringPool::instance()->intern(
+                    QString::fromStdString(paramctx->getText())));
         }
-        method->m_ret = QString::fromStdString(proto->type_descriptor()->getText());
+        method->m_ret = StringPool::instance()->intern(
+                QString::fromStdString(proto->type_descriptor()->getText()));
     }
-    if(method->m_accessflag && ACC_NATIVE) {
+    if(method->m_accessflag & ACC_NATIVE) {
         return;
     }
 
     // get method instruction information
-    if(method->m_accessflag && ACC_STATIC) {
+    if(method->m_accessflag & ACC_STATIC) {
         method->m_paramRegisterCount = method->m_params.size();
     } else {
         // P0 is used for this pointer
@@ -51,7 +64,7 @@ void SmaliFileListener::enterMethod(SmaliParser::MethodContext *ctx) {
         auto registerctx = statectx->registers_directive(0);
         if(registerctx->isRegister) {
             method->m_localRegisterCount =
-                    LiteralTools::parseInt(registerctx->regCount2->getText())
+                    LiteralTools::parseInt(registerctx->regCount->getText())
                     - method->m_paramRegisterCount;
         } else {
             method->m_localRegisterCount =
@@ -71,6 +84,15 @@ void SmaliFileListener::enterMethod(SmaliParser::MethodContext *ctx) {
         instruction.m_line = order->start->getLine();
         instruction.m_codeidx = order->codeIdx;
         method->m_instructions.push_back(instruction);
+
+        // operands are read from source text, getText() drops the spaces
+        auto text = insctx->start->getInputStream()->getText(antlr4::misc::Interval(
+                insctx->start->getStartIndex(), insctx->stop->getStopIndex()));
+        SmaliReference reference;
+        if(SmaliScanner::scanReference(text.data(), text.data() + text.size(),
+                                       instruction.m_line, reference)) {
+            method->m_references.push_back(reference);
+        }
     }
 }
 
@@ -79,13 +101,14 @@ void SmaliFileListener::exitMethod(SmaliParser::MethodContext *ctx) {
 }
 
 void SmaliFileListener::enterField(SmaliParser::FieldContext *ctx) {
-    auto field = new SmaliField;
+    auto field = m_smali->m_arena.newField();
     field->m_line = ctx->FIELD_DIRECTIVE()->getSymbol()->getLine();
 
-    field->m_name = QString::fromStdString(ctx->member_name()->getText());
+    field->m_name = StringPool::instance()->intern(QString::fromStdString(ctx->member_name()->getText()));
     field->m_accessflag = field->getAccessFlag(
-            QString::fromStdString(ctx->access_list()->getText()));
-    field->m_class = QString::fromStdString(ctx->nonvoid_type_descriptor()->getText());
+            accessListText(ctx->access_list()));
+    field->m_class = StringPool::instance()->intern(
+            QString::fromStdString(ctx->nonvoid_type_descriptor()->getText()));
 
     // TODO parse annotation data if existed?
 
@@ -101,7 +124,7 @@ void SmaliFileListener::enterSmali_file(SmaliParser::Smali_fileContext *ctx) {
     if(!m_smali->m_isValid) {
         return;
     }
-    m_smali->m_name = QString::fromStdString(ctx->class_spec(0)->className);
+    m_smali->m_name = StringPool::instance()->intern(QString::fromStdString(ctx->class_spec(0)->className));
 }
 
 void SmaliFileListener::exitSmali_file(SmaliParser::Smali_fileContext *ctx) {
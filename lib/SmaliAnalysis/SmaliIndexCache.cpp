@@ -0,0 +1,239 @@
+//===- SmaliIndexCache.cpp - ART-GUI Analysis engine ------------*- cpp -*-===//
+//
+//                     ANDROID REVERSE TOOLKIT
+//
+// This file is distributed under the GNU GENERAL PUBLIC LICENSE
+// V3 License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "SmaliIndexCache.h"
+
+#include "SmaliAnalysis/SmaliFile.h"
+#include <utils/StringPool.h>
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QSaveFile>
+
+#define CACHE_MAGIC     0x41525449      // "ARTI"
+// increase it when the record layout changed
+#define CACHE_VERSION   2
+
+SmaliIndexCache::SmaliIndexCache(const QString &cachePath)
+        : m_file(cachePath)
+{
+}
+
+SmaliIndexCache::~SmaliIndexCache() {
+    if(m_data != nullptr) {
+        m_file.unmap(m_data);
+    }
+}
+
+bool SmaliIndexCache::open() {
+    if(!m_file.open(QFile::ReadOnly)) {
+        return false;
+    }
+    m_size = m_file.size();
+    m_data = m_file.map(0, m_size);
+    if(m_data == nullptr) {
+        return false;
+    }
+
+    auto bytes = QByteArray::fromRawData((const char*)m_data, m_size);
+    QDataStream in(bytes);
+    in.setVersion(QDataStream::Qt_5_6);
+
+    quint32 magic = 0, version = 0, count = 0;
+    in >> magic >> version >> count;
+    if(in.status() != QDataStream::Ok
+       || magic != CACHE_MAGIC || version != CACHE_VERSION) {
+        return false;
+    }
+
+    m_entries.reserve(count);
+    for(quint32 i = 0; i < count; i++) {
+        QString path;
+        Entry entry;
+        in >> path >> entry.size >> entry.modified
+           >> entry.offset >> entry.length;
+        if(in.status() != QDataStream::Ok) {
+            m_entries.clear();
+            return false;
+        }
+        m_entries.insert(path, entry);
+    }
+    m_recordBase = in.device()->pos();
+    return true;
+}
+
+SmaliFile *SmaliIndexCache::load(const QString &filepath) {
+    auto it = m_entries.constFind(filepath);
+    if(it == m_entries.constEnd()) {
+        return nullptr;
+    }
+    const Entry &entry = it.value();
+    if(m_recordBase + entry.offset + entry.length > m_size) {
+        return nullptr;
+    }
+
+    QFileInfo fi(filepath);
+    if(fi.size() != entry.size
+       || fi.lastModified().toMSecsSinceEpoch() != entry.modified) {
+        return nullptr;
+    }
+
+    auto record = QByteArray::fromRawData(
+            (const char*)m_data + m_recordBase + entry.offset, entry.length);
+    QDataStream in(record);
+    in.setVersion(QDataStream::Qt_5_6);
+
+    auto* filedata = new SmaliFile;
+    filedata->m_filepath = filepath;
+    filedata->m_fileSize = entry.size;
+    filedata->m_fileModified = entry.modified;
+    filedata->m_cached = true;
+    if(!readRecord(in, filedata)) {
+        delete filedata;
+        return nullptr;
+    }
+    return filedata;
+}
+
+bool SmaliIndexCache::save(const QString &cachePath,
+                           const QList<QSharedPointer<SmaliFile>> &files) {
+    QList<QSharedPointer<SmaliFile>> cached;
+    QList<Entry> entries;
+
+    // serialize records first, the entry table needs their location.
+    QByteArray records;
+    QDataStream recordOut(&records, QIODevice::WriteOnly);
+    recordOut.setVersion(QDataStream::Qt_5_6);
+    for(auto &filedata: files) {
+        // data parsed from editor buffer has no file state to validate.
+        if(!filedata->isValid() || filedata->m_fileSize < 0) {
+            continue;
+        }
+        Entry entry;
+        entry.size = filedata->m_fileSize;
+        entry.modified = filedata->m_fileModified;
+        entry.offset = (quint32)recordOut.device()->pos();
+        writeRecord(recordOut, filedata.data());
+        entry.length = (quint32)recordOut.device()->pos() - entry.offset;
+
+        cached << filedata;
+        entries << entry;
+    }
+
+    QSaveFile file(cachePath);
+    if(!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_6);
+    out << (quint32)CACHE_MAGIC << (quint32)CACHE_VERSION
+        << (quint32)entries.size();
+    for(auto i = 0; i < entries.size(); i++) {
+        const Entry &entry = entries[i];
+        out << cached[i]->sourceFile() << entry.size << entry.modified
+            << entry.offset << entry.length;
+    }
+    file.write(records);
+    return file.commit();
+}
+
+void SmaliIndexCache::writeRecord(QDataStream &out, SmaliFile *filedata) {
+    out << filedata->m_name << filedata->m_accessflag;
+
+    out << (quint32)filedata->m_fields.size();
+    for(auto field: filedata->m_fields) {
+        out << field->m_name << field->m_accessflag << field->m_class
+            << (qint32)field->m_line;
+    }
+
+    out << (quint32)filedata->m_methods.size();
+    for(auto method: filedata->m_methods) {
+        out << method->m_name << method->m_accessflag
+            << method->m_params << method->m_ret
+            << (qint32)method->m_localRegisterCount
+            << (qint32)method->m_paramRegisterCount
+            << (qint32)method->m_startline << (qint32)method->m_endline;
+        out << (quint32)method->m_instructions.size();
+        for(auto &instruction: method->m_instructions) {
+            out << (qint32)instruction.m_codeidx << (qint32)instruction.m_line;
+        }
+        out << (quint32)method->m_references.size();
+        for(auto &reference: method->m_references) {
+            out << (quint8)reference.m_kind << reference.m_target
+                << (qint32)reference.m_line;
+        }
+    }
+}
+
+bool SmaliIndexCache::readRecord(QDataStream &in, SmaliFile *filedata) {
+    in >> filedata->m_name >> filedata->m_accessflag;
+    auto pool = StringPool::instance();
+    filedata->m_name = pool->intern(filedata->m_name);
+
+    quint32 fieldCount = 0;
+    in >> fieldCount;
+    for(quint32 i = 0; i < fieldCount && in.status() == QDataStream::Ok; i++) {
+        auto field = filedata->m_arena.newField();
+        qint32 line;
+        in >> field->m_name >> field->m_accessflag >> field->m_class >> line;
+        field->m_line = line;
+        field->m_name = pool->intern(field->m_name);
+        field->m_class = pool->intern(field->m_class);
+        filedata->m_fields.push_back(field);
+    }
+
+    quint32 methodCount = 0;
+    in >> methodCount;
+    for(quint32 i = 0; i < methodCount && in.status() == QDataStream::Ok; i++) {
+        auto method = filedata->m_arena.newMethod();
+        filedata->m_methods.push_back(method);
+
+        qint32 localCount, paramCount, startline, endline;
+        in >> method->m_name >> method->m_accessflag
+           >> method->m_params >> method->m_ret
+           >> localCount >> paramCount >> startline >> endline;
+        method->m_localRegisterCount = localCount;
+        method->m_paramRegisterCount = paramCount;
+        method->m_startline = startline;
+        method->m_endline = endline;
+        method->m_name = pool->intern(method->m_name);
+        for(auto &param: method->m_params) {
+            param = pool->intern(param);
+        }
+        method->m_ret = pool->intern(method->m_ret);
+
+        quint32 insCount = 0;
+        in >> insCount;
+        for(quint32 j = 0; j < insCount && in.status() == QDataStream::Ok; j++) {
+            qint32 codeidx, line;
+            in >> codeidx >> line;
+            SmaliInstruction instruction;
+            instruction.m_codeidx = codeidx;
+            instruction.m_line = line;
+            method->m_instructions.push_back(instruction);
+        }
+
+        quint32 refCount = 0;
+        in >> refCount;
+        for(quint32 j = 0; j < refCount && in.status() == QDataStream::Ok; j++) {
+            quint8 kind;
+            qint32 line;
+            SmaliReference reference;
+            in >> kind >> reference.m_target >> line;
+            reference.m_target = pool->intern(reference.m_target);
+            reference.m_kind = (SmaliReference::Kind)kind;
+            reference.m_line = line;
+            method->m_references.push_back(reference);
+        }
+    }
+
+    filedata->m_isValid = in.status() == QDataStream::Ok;
+    return filedata->m_isValid;
+}
@@ -0,0 +1,67 @@
+//===- SmaliIndexCache.h - ART-GUI Analysis engine --------------*- cpp -*-===//
+//
+//                     ANDROID REVERSE TOOLKIT
+//
+// This file is distributed under the GNU GENERAL PUBLIC LICENSE
+// V3 License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// SmaliIndexCache saves the analysis result of every smali file in project
+// directory, so unchanged files do not need to be parsed again when the
+// project is reopened.
+//
+// The cache file is mapped into memory. It starts with a header and an entry
+// table (source path, size, modify time, record location), followed by one
+// serialized SmaliFile record per entry. Records are only decoded when the
+// source file still has the recorded size and modify time.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef ANDROIDREVERSETOOLKIT_SMALIINDEXCACHE_H
+#define ANDROIDREVERSETOOLKIT_SMALIINDEXCACHE_H
+
+#include <QDataStream>
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QSharedPointer>
+#include <QString>
+
+class SmaliFile;
+
+class SmaliIndexCache {
+public:
+    SmaliIndexCache(const QString &cachePath);
+    ~SmaliIndexCache();
+
+    // map cache file and read the entry table. False is returned if the
+    // cache does not exist or is written by another version.
+    bool open();
+    // get SmaliFile data from cache, nullptr is returned if the file is not
+    // cached or has been changed. Thread safe after open().
+    SmaliFile* load(const QString &filepath);
+
+    static bool save(const QString &cachePath,
+                     const QList<QSharedPointer<SmaliFile>> &files);
+
+private:
+    static void writeRecord(QDataStream &out, SmaliFile* filedata);
+    static bool readRecord(QDataStream &in, SmaliFile* filedata);
+
+    struct Entry {
+        qint64 size;
+        qint64 modified;
+        quint32 offset;
+        quint32 length;
+    };
+
+    QFile m_file;
+    uchar* m_data = nullptr;
+    qint64 m_size = 0;
+    qint64 m_recordBase = 0;
+    QHash<QString, Entry> m_entries;
+};
+
+
+#endif //ANDROIDREVERSETOOLKIT_SMALIINDEXCACHE_H
@@ -7,6 +7,11 @@
 //
 //===----------------------------------------------------------------------===//
 #include "SmaliAnalysis/SmaliMethod.h"
+
+#include <utils/StringPool.h>
+
+#include <algorithm>
+
 #define NUM_FLAGS   18
 
 QString SmaliMethod::buildAccessFlag() {
@@ -76,6 +81,9 @@ u4 SmaliMethod::getAccessFlag(QString flags) {
 }
 
 QString SmaliMethod::buildProto() {
+    if(!m_proto.isNull()) {
+        return m_proto;
+    }
     QString rel;
     rel.append('(');
     for(auto &param: m_params) {
@@ -83,7 +91,8 @@ QString SmaliMethod::buildProto() {
     }
     rel.append(')');
     rel.append(m_ret);
-    return rel;
+    m_proto = StringPool::instance()->intern(rel);
+    return m_proto;
 }
 
 bool SmaliMethod::equal(QString name, QVector<QString> params) {
@@ -94,24 +103,30 @@ int SmaliMethod::getCodeIdxForSourceLocation(int line) {
     if(line < m_startline) {
         return -1;
     }
-    for(auto &instruction: m_instructions) {
-        if(line <= instruction.m_line) {
-            return instruction.m_codeidx;
-        }
+    // first instruction at or after line
+    auto it = std::lower_bound(m_instructions.constBegin(), m_instructions.constEnd(), line,
+                               [](const SmaliInstruction &instruction, int line) {
+                                   return instruction.m_line < line;
+                               });
+    if(it == m_instructions.constEnd()) {
+        return -1;
     }
-    return -1;
+    return it->m_codeidx;
 }
 
 int SmaliMethod::getSourceLocationForCodeIdx(int codeIdx) {
     if(codeIdx < 0) {
         return -1;
     }
-    for(auto &instruction: m_instructions) {
-        if(codeIdx < instruction.m_codeidx) {
-            return instruction.m_line;
-        }
+    // last instruction starting at or before codeIdx
+    auto it = std::upper_bound(m_instructions.constBegin(), m_instructions.constEnd(), codeIdx,
+                               [](int codeIdx, const SmaliInstruction &instruction) {
+                                   return codeIdx < instruction.m_codeidx;
+                               });
+    if(it == m_instructions.constBegin()) {
+        return -1;
     }
-    return -1;
+    return (it - 1)->m_line;
 }
 
 
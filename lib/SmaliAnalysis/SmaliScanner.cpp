@@ -0,0 +1,528 @@
+//===- SmaliScanner.cpp - ART-GUI Analysis engine ---------------*- cpp -*-===//
+//
+//                     ANDROID REVERSE TOOLKIT
+//
+// This file is distributed under the GNU GENERAL PUBLIC LICENSE
+// V3 License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "SmaliScanner.h"
+
+#include "SmaliAnalysis/SmaliFile.h"
+#include <utils/StringPool.h>
+#include "LiteralTools.h"
+
+#include <QHash>
+#include <QSet>
+
+#include <cstring>
+
+namespace {
+
+struct OpcodeWidth {
+    const char* name;
+    int width;
+};
+
+// code unit width of every opcode, same as the instruction rule of SmaliParser
+const OpcodeWidth kOpcodeWidths[] = {
+    // 10t 10x 10x_odex 11n 11x 12x
+    {"goto", 1}, {"return-void", 1}, {"nop", 1},
+    {"return-void-barrier", 1}, {"return-void-no-barrier", 1}, {"const/4", 1},
+    {"move-result", 1}, {"move-result-wide", 1}, {"move-result-object", 1},
+    {"move-exception", 1}, {"return", 1}, {"return-wide", 1},
+    {"return-object", 1}, {"monitor-enter", 1}, {"monitor-exit", 1},
+    {"throw", 1},
+    {"move", 1}, {"move-wide", 1}, {"move-object", 1}, {"array-length", 1},
+    {"neg-int", 1}, {"not-int", 1}, {"neg-long", 1}, {"not-long", 1},
+    {"neg-float", 1}, {"neg-double", 1}, {"int-to-long", 1},
+    {"int-to-float", 1}, {"int-to-double", 1}, {"long-to-int", 1},
+    {"long-to-float", 1}, {"long-to-double", 1}, {"float-to-int", 1},
+    {"float-to-long", 1}, {"float-to-double", 1}, {"double-to-int", 1},
+    {"double-to-long", 1}, {"double-to-float", 1}, {"int-to-byte", 1},
+    {"int-to-char", 1}, {"int-to-short", 1},
+    {"add-int/2addr", 1}, {"sub-int/2addr", 1}, {"mul-int/2addr", 1},
+    {"div-int/2addr", 1}, {"rem-int/2addr", 1}, {"and-int/2addr", 1},
+    {"or-int/2addr", 1}, {"xor-int/2addr", 1}, {"shl-int/2addr", 1},
+    {"shr-int/2addr", 1}, {"ushr-int/2addr", 1}, {"add-long/2addr", 1},
+    {"sub-long/2addr", 1}, {"mul-long/2addr", 1}, {"div-long/2addr", 1},
+    {"rem-long/2addr", 1}, {"and-long/2addr", 1}, {"or-long/2addr", 1},
+    {"xor-long/2addr", 1}, {"shl-long/2addr", 1}, {"shr-long/2addr", 1},
+    {"ushr-long/2addr", 1}, {"add-float/2addr", 1}, {"sub-float/2addr", 1},
+    {"mul-float/2addr", 1}, {"div-float/2addr", 1}, {"rem-float/2addr", 1},
+    {"add-double/2addr", 1}, {"sub-double/2addr", 1},
+    {"mul-double/2addr", 1}, {"div-double/2addr", 1},
+    {"rem-double/2addr", 1},
+
+    // 20bc 20t 21c 21ih 21lh 21s 21t 22b 22c 22cs 22s 22t 22x 23x
+    {"throw-verification-error", 2}, {"goto/16", 2},
+    {"sget", 2}, {"sget-wide", 2}, {"sget-object", 2}, {"sget-boolean", 2},
+    {"sget-byte", 2}, {"sget-char", 2}, {"sget-short", 2}, {"sput", 2},
+    {"sput-wide", 2}, {"sput-object", 2}, {"sput-boolean", 2},
+    {"sput-byte", 2}, {"sput-char", 2}, {"sput-short", 2},
+    {"sget-volatile", 2}, {"sget-wide-volatile", 2},
+    {"sget-object-volatile", 2}, {"sput-volatile", 2},
+    {"sput-wide-volatile", 2}, {"sput-object-volatile", 2},
+    {"const-string", 2}, {"check-cast", 2}, {"new-instance", 2},
+    {"const-class", 2}, {"const/high16", 2}, {"const-wide/high16", 2},
+    {"const/16", 2}, {"const-wide/16", 2},
+    {"if-eqz", 2}, {"if-nez", 2}, {"if-ltz", 2}, {"if-gez", 2},
+    {"if-gtz", 2}, {"if-lez", 2},
+    {"add-int/lit8", 2}, {"rsub-int/lit8", 2}, {"mul-int/lit8", 2},
+    {"div-int/lit8", 2}, {"rem-int/lit8", 2}, {"and-int/lit8", 2},
+    {"or-int/lit8", 2}, {"xor-int/lit8", 2}, {"shl-int/lit8", 2},
+    {"shr-int/lit8", 2}, {"ushr-int/lit8", 2},
+    {"iget", 2}, {"iget-wide", 2}, {"iget-object", 2}, {"iget-boolean", 2},
+    {"iget-byte", 2}, {"iget-char", 2}, {"iget-short", 2}, {"iput", 2},
+    {"iput-wide", 2}, {"iput-object", 2}, {"iput-boolean", 2},
+    {"iput-byte", 2}, {"iput-char", 2}, {"iput-short", 2},
+    {"iget-volatile", 2}, {"iget-wide-volatile", 2},
+    {"iget-object-volatile", 2}, {"iput-volatile", 2},
+    {"iput-wide-volatile", 2}, {"iput-object-volatile", 2},
+    {"instance-of", 2}, {"new-array", 2},
+    {"iget-quick", 2}, {"iget-wide-quick", 2}, {"iget-object-quick", 2},
+    {"iput-quick", 2}, {"iput-wide-quick", 2}, {"iput-object-quick", 2},
+    {"iput-boolean-quick", 2}, {"iput-byte-quick", 2},
+    {"iput-char-quick", 2}, {"iput-short-quick", 2},
+    {"rsub-int", 2}, {"add-int/lit16", 2}, {"mul-int/lit16", 2},
+    {"div-int/lit16", 2}, {"rem-int/lit16", 2}, {"and-int/lit16", 2},
+    {"or-int/lit16", 2}, {"xor-int/lit16", 2},
+    {"if-eq", 2}, {"if-ne", 2}, {"if-lt", 2}, {"if-ge", 2}, {"if-gt", 2},
+    {"if-le", 2},
+    {"move/from16", 2}, {"move-wide/from16", 2}, {"move-object/from16", 2},
+    {"cmpl-float", 2}, {"cmpg-float", 2}, {"cmpl-double", 2},
+    {"cmpg-double", 2}, {"cmp-long", 2}, {"aget", 2}, {"aget-wide", 2},
+    {"aget-object", 2}, {"aget-boolean", 2}, {"aget-byte", 2},
+    {"aget-char", 2}, {"aget-short", 2}, {"aput", 2}, {"aput-wide", 2},
+    {"aput-object", 2}, {"aput-boolean", 2}, {"aput-byte", 2},
+    {"aput-char", 2}, {"aput-short", 2}, {"add-int", 2}, {"sub-int", 2},
+    {"mul-int", 2}, {"div-int", 2}, {"rem-int", 2}, {"and-int", 2},
+    {"or-int", 2}, {"xor-int", 2}, {"shl-int", 2}, {"shr-int", 2},
+    {"ushr-int", 2}, {"add-long", 2}, {"sub-long", 2}, {"mul-long", 2},
+    {"div-long", 2}, {"rem-long", 2}, {"and-long", 2}, {"or-long", 2},
+    {"xor-long", 2}, {"shl-long", 2}, {"shr-long", 2}, {"ushr-long", 2},
+    {"add-float", 2}, {"sub-float", 2}, {"mul-float", 2}, {"div-float", 2},
+    {"rem-float", 2}, {"add-double", 2}, {"sub-double", 2},
+    {"mul-double", 2}, {"div-double", 2}, {"rem-double", 2},
+
+    // 30t 31c 31i 31t 32x 35c 35mi 35ms 3rc 3rmi 3rms
+    {"goto/32", 3}, {"const-string/jumbo", 3}, {"const", 3},
+    {"const-wide/32", 3}, {"fill-array-data", 3}, {"packed-switch", 3},
+    {"sparse-switch", 3}, {"move/16", 3}, {"move-wide/16", 3},
+    {"move-object/16", 3},
+    {"invoke-virtual", 3}, {"invoke-super", 3}, {"invoke-direct", 3},
+    {"invoke-static", 3}, {"invoke-interface", 3},
+    {"invoke-direct-empty", 3}, {"filled-new-array", 3},
+    {"execute-inline", 3}, {"invoke-virtual-quick", 3},
+    {"invoke-super-quick", 3},
+    {"invoke-virtual/range", 3}, {"invoke-super/range", 3},
+    {"invoke-direct/range", 3}, {"invoke-static/range", 3},
+    {"invoke-interface/range", 3}, {"invoke-object-init/range", 3},
+    {"filled-new-array/range", 3}, {"execute-inline/range", 3},
+    {"invoke-virtual-quick/range", 3}, {"invoke-super-quick/range", 3},
+
+    // 45cc 4rcc 51l
+    {"invoke-polymorphic", 4}, {"invoke-polymorphic/range", 4},
+    {"const-wide", 5},
+};
+
+const char* kAccessSpecs[] = {
+    "public", "private", "protected", "static", "final", "synchronized",
+    "bridge", "varargs", "native", "abstract", "strictfp", "synthetic",
+    "constructor", "declared-synchronized", "interface", "enum",
+    "annotation", "volatile", "transient",
+};
+
+// -1 is returned for unknown opcode
+int opcodeWidth(const QByteArray &opcode) {
+    static const QHash<QByteArray, int> kWidthMap = [] {
+        QHash<QByteArray, int> map;
+        for(auto &op: kOpcodeWidths) {
+            map.insert(QByteArray(op.name), op.width);
+        }
+        return map;
+    }();
+    return kWidthMap.value(opcode, -1);
+}
+
+bool isAccessSpec(const QByteArray &word) {
+    static const QSet<QByteArray> kAccessSet = [] {
+        QSet<QByteArray> set;
+        for(auto spec: kAccessSpecs) {
+            set.insert(QByteArray(spec));
+        }
+        return set;
+    }();
+    return kAccessSet.contains(word);
+}
+
+inline bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+// get the next whitespace separated word, the data is not copied.
+QByteArray nextWord(const char* &pos, const char* end) {
+    while(pos < end && isSpace(*pos)) {
+        pos++;
+    }
+    auto begin = pos;
+    while(pos < end && !isSpace(*pos)) {
+        pos++;
+    }
+    return QByteArray::fromRawData(begin, (int)(pos - begin));
+}
+
+// read access words, pos is left at the first non access word.
+QString readAccessList(const char* &pos, const char* end) {
+    QString flags;
+    while(true) {
+        auto prev = pos;
+        auto word = nextWord(pos, end);
+        if(!isAccessSpec(word)) {
+            pos = prev;
+            break;
+        }
+        if(!flags.isEmpty()) {
+            flags.push_back(' ');
+        }
+        flags += QString::fromLatin1(word);
+    }
+    return flags;
+}
+
+// length of the type descriptor at pos, 0 if it is not valid.
+int typeLength(const char* pos, const char* end, bool allowVoid) {
+    auto p = pos;
+    while(p < end && *p == '[') {
+        p++;
+    }
+    if(p >= end) {
+        return 0;
+    }
+    switch(*p) {
+        case 'Z': case 'B': case 'S': case 'C':
+        case 'I': case 'J': case 'F': case 'D':
+            return (int)(p - pos) + 1;
+        case 'V':
+            return allowVoid && p == pos ? 1 : 0;
+        case 'L': {
+            auto semicolon = (const char*)memchr(p, ';', end - p);
+            return semicolon == nullptr ? 0 : (int)(semicolon - pos) + 1;
+        }
+        default:
+            return 0;
+    }
+}
+
+}
+
+SmaliScanner::SmaliScanner(SmaliFile *filedata) {
+    m_smali = filedata;
+}
+
+SmaliScanner::~SmaliScanner() {
+}
+
+bool SmaliScanner::nextLine(Line &line) {
+    while(m_pos < m_end) {
+        m_lineNumber++;
+        auto lineEnd = (const char*)memchr(m_pos, '\n', m_end - m_pos);
+        if(lineEnd == nullptr) {
+            lineEnd = m_end;
+        }
+        line.begin = m_pos;
+        line.end = lineEnd;
+        line.number = m_lineNumber;
+        m_pos = lineEnd < m_end ? lineEnd + 1 : m_end;
+
+        while(line.begin < line.end && isSpace(*line.begin)) {
+            line.begin++;
+        }
+        while(line.end > line.begin && isSpace(*(line.end - 1))) {
+            line.end--;
+        }
+        if(line.begin == line.end || *line.begin == '#') {
+            continue;
+        }
+        return true;
+    }
+    return false;
+}
+
+bool SmaliScanner::skipBlock(const char *endDirective) {
+    Line line;
+    while(nextLine(line)) {
+        auto pos = line.begin;
+        if(nextWord(pos, line.end) == ".end"
+           && nextWord(pos, line.end) == endDirective) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SmaliScanner::scan(const char *data, qint64 size) {
+    m_pos = data;
+    m_end = data + size;
+    m_lineNumber = 0;
+
+    QString className;
+    bool hasClass = false, hasSuper = false, hasSource = false;
+
+    Line line;
+    while(nextLine(line)) {
+        auto pos = line.begin;
+        auto directive = nextWord(pos, line.end);
+        if(directive == ".method") {
+            if(!scanMethod(line)) {
+                return false;
+            }
+        } else if(directive == ".field") {
+            if(!scanField(line)) {
+                return false;
+            }
+        } else if(directive == ".end") {
+            // optional end of field annotations
+            if(nextWord(pos, line.end) != "field") {
+                return false;
+            }
+        } else if(directive == ".annotation") {
+            if(!skipBlock("annotation")) {
+                return false;
+            }
+        } else if(directive == ".class") {
+            if(hasClass) {
+                return false;
+            }
+            readAccessList(pos, line.end);
+            auto descriptor = nextWord(pos, line.end);
+            if(descriptor.isEmpty() || descriptor[0] != 'L'
+               || typeLength(descriptor.constData(), pos, false) != descriptor.size()) {
+                return false;
+            }
+            className = QString::fromUtf8(descriptor);
+            hasClass = true;
+        } else if(directive == ".super") {
+            if(hasSuper) {
+                return false;
+            }
+            hasSuper = true;
+        } else if(directive == ".source") {
+            if(hasSource) {
+                return false;
+            }
+            hasSource = true;
+        } else if(directive != ".implements") {
+            return false;
+        }
+    }
+
+    // let the parser report incomplete files
+    if(!hasClass || !hasSuper) {
+        return false;
+    }
+
+    m_smali->m_isValid = className != "Ljava/lang/Object;";
+    if(m_smali->m_isValid) {
+        m_smali->m_name = StringPool::instance()->intern(className);
+    }
+    m_smali->m_arena.swap(m_arena);
+    m_smali->m_fields.swap(m_fields);
+    m_smali->m_methods.swap(m_methods);
+    return true;
+}
+
+bool SmaliScanner::scanReference(const char *begin, const char *end, int line,
+                                 SmaliReference &reference) {
+    auto pos = begin;
+    auto opcode = nextWord(pos, end);
+    if(opcode.contains("quick")) {
+        // odex instructions only have vtable index or field offset
+        return false;
+    }
+    if(opcode.startsWith("invoke-")) {
+        reference.m_kind = SmaliReference::Invoke;
+    } else if(opcode.startsWith("iget") || opcode.startsWith("sget")) {
+        reference.m_kind = SmaliReference::FieldRead;
+    } else if(opcode.startsWith("iput") || opcode.startsWith("sput")) {
+        reference.m_kind = SmaliReference::FieldWrite;
+    } else if(opcode == "const-class" || opcode == "new-instance"
+              || opcode == "check-cast") {
+        reference.m_kind = SmaliReference::TypeUse;
+    } else {
+        return false;
+    }
+
+    // the first operand which is not a register or register list
+    while(pos < end) {
+        auto comma = (const char*)memchr(pos, ',', end - pos);
+        auto operandEnd = comma != nullptr ? comma : end;
+        while(pos < operandEnd && isSpace(*pos)) {
+            pos++;
+        }
+        // a descriptor has no space, this also drops a trailing comment
+        auto operand = pos;
+        while(pos < operandEnd && !isSpace(*pos)) {
+            pos++;
+        }
+        if(operand < pos && (*operand == 'L' || *operand == '[')) {
+            reference.m_target = StringPool::instance()->intern(operand, (int)(pos - operand));
+            reference.m_line = line;
+            return true;
+        }
+        pos = comma != nullptr ? comma + 1 : end;
+    }
+    return false;
+}
+
+bool SmaliScanner::scanField(const Line &line) {
+    auto pos = line.begin;
+    nextWord(pos, line.end);
+
+    auto flags = readAccessList(pos, line.end);
+    auto member = nextWord(pos, line.end);
+    auto colon = member.indexOf(':');
+    if(colon <= 0) {
+        return false;
+    }
+    auto type = member.constData() + colon + 1;
+    if(typeLength(type, member.constData() + member.size(), false)
+       != member.size() - colon - 1) {
+        return false;
+    }
+
+    auto field = m_arena.newField();
+    m_fields.push_back(field);
+    field->m_line = line.number;
+    field->m_name = StringPool::instance()->intern(member.constData(), colon);
+    field->m_accessflag = field->getAccessFlag(flags);
+    field->m_class = StringPool::instance()->intern(type, member.size() - colon - 1);
+    return true;
+}
+
+bool SmaliScanner::scanMethod(const Line &line) {
+    auto pos = line.begin;
+    nextWord(pos, line.end);
+
+    auto method = m_arena.newMethod();
+    m_methods.push_back(method);
+    method->m_startline = line.number;
+    method->m_accessflag = method->getAccessFlag(readAccessList(pos, line.end));
+
+    // name(params)ret
+    auto member = nextWord(pos, line.end);
+    if(!nextWord(pos, line.end).isEmpty()) {
+        return false;
+    }
+    auto memberEnd = member.constData() + member.size();
+    auto open = member.indexOf('(');
+    auto close = member.indexOf(')');
+    if(open <= 0 || close < open) {
+        return false;
+    }
+    method->m_name = StringPool::instance()->intern(member.constData(), open);
+    for(auto p = member.constData() + open + 1;
+        p < member.constData() + close; ) {
+        auto length = typeLength(p, member.constData() + close, false);
+        if(length == 0) {
+            return false;
+        }
+        method->m_params.push_back(StringPool::instance()->intern(p, length));
+        p += length;
+    }
+    auto ret = member.constData() + close + 1;
+    if(ret == memberEnd || typeLength(ret, memberEnd, true) != memberEnd - ret) {
+        return false;
+    }
+    method->m_ret = StringPool::instance()->intern(ret, (int)(memberEnd - ret));
+
+    // native method has no instruction information
+    bool collect = !(method->m_accessflag & ACC_NATIVE);
+    if(collect) {
+        if(method->m_accessflag & ACC_STATIC) {
+            method->m_paramRegisterCount = method->m_params.size();
+        } else {
+            // P0 is used for this pointer
+            method->m_paramRegisterCount = method->m_params.size() + 1;
+        }
+    }
+
+    bool hasRegisters = false;
+    int codeIdx = 0;
+    Line body;
+    while(nextLine(body)) {
+        if(*body.begin == ':') {
+            continue;
+        }
+        auto bodyPos = body.begin;
+        auto word = nextWord(bodyPos, body.end);
+        if(word[0] != '.') {
+            auto width = opcodeWidth(word);
+            if(width < 0) {
+                return false;
+            }
+            if(collect) {
+                SmaliInstruction instruction;
+                instruction.m_line = body.number;
+                instruction.m_codeidx = codeIdx;
+                method->m_instructions.push_back(instruction);
+            }
+            SmaliReference reference;
+            if(scanReference(body.begin, body.end, body.number, reference)) {
+                method->m_references.push_back(reference);
+            }
+            codeIdx += width;
+            continue;
+        }
+
+        if(word == ".end") {
+            auto what = nextWord(bodyPos, body.end);
+            if(what == "method") {
+                method->m_endline = body.number;
+                return true;
+            }
+            if(what != "local" && what != "param") {
+                return false;
+            }
+        } else if(word == ".registers" || word == ".locals") {
+            if(hasRegisters || !collect) {
+                continue;
+            }
+            hasRegisters = true;
+            auto count = LiteralTools::parseInt(
+                    nextWord(bodyPos, body.end).toStdString());
+            if(word == ".registers") {
+                method->m_localRegisterCount =
+                        count - method->m_paramRegisterCount;
+            } else {
+                method->m_localRegisterCount = count;
+            }
+        } else if(word == ".annotation") {
+            if(!skipBlock("annotation")) {
+                return false;
+            }
+        } else if(word == ".array-data" || word == ".packed-switch"
+                  || word == ".sparse-switch") {
+            // data payload is recorded as a zero width instruction
+            if(collect) {
+                SmaliInstruction instruction;
+                instruction.m_line = body.number;
+                instruction.m_codeidx = codeIdx;
+                method->m_instructions.push_back(instruction);
+            }
+            auto endDirective = word == ".array-data" ? "array-data"
+                    : word == ".packed-switch" ? "packed-switch" : "sparse-switch";
+            if(!skipBlock(endDirective)) {
+                return false;
+            }
+        } else if(word != ".line" && word != ".local" && word != ".restart"
+                  && word != ".prologue" && word != ".epilogue"
+                  && word != ".source" && word != ".catch"
+                  && word != ".catchall" && word != ".param") {
+            return false;
+        }
+    }
+    // missing .end method
+    return false;
+}
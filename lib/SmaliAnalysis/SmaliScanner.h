@@ -0,0 +1,68 @@
+//===- SmaliScanner.h - ART-GUI Analysis engine -----------------*- cpp -*-===//
+//
+//                     ANDROID REVERSE TOOLKIT
+//
+// This file is distributed under the GNU GENERAL PUBLIC LICENSE
+// V3 License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// SmaliScanner collects the same declaration data as SmaliFileListener
+// (class name, fields, methods, registers and instruction locations) in one
+// pass over the raw file content, without building a parse tree.
+//
+// It only understands the line oriented layout written by baksmali/apktool.
+// scan() returns false for anything else, and the caller falls back to the
+// ANTLR parser.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef ANDROIDREVERSETOOLKIT_SMALISCANNER_H
+#define ANDROIDREVERSETOOLKIT_SMALISCANNER_H
+
+#include "SmaliAnalysis/SmaliArena.h"
+
+#include <QByteArray>
+#include <QVector>
+
+class SmaliFile;
+struct SmaliReference;
+
+class SmaliScanner {
+public:
+    SmaliScanner(SmaliFile* filedata);
+    ~SmaliScanner();
+
+    // scan smali content, filedata is only changed when true is returned.
+    bool scan(const char* data, qint64 size);
+
+    // get the class, method or field used by one instruction. False is
+    // returned if the instruction has no such reference.
+    static bool scanReference(const char* begin, const char* end, int line,
+                              SmaliReference &reference);
+
+private:
+    struct Line {
+        const char* begin;
+        const char* end;
+        int number;
+    };
+
+    bool nextLine(Line &line);
+    bool scanField(const Line &line);
+    bool scanMethod(const Line &line);
+    bool skipBlock(const char* endDirective);
+
+    const char* m_pos = nullptr;
+    const char* m_end = nullptr;
+    int m_lineNumber = 0;
+
+    SmaliFile* m_smali;
+    // moved to the file with the members when the scan succeeds
+    SmaliArena m_arena;
+    QVector<SmaliField*> m_fields;
+    QVector<SmaliMethod*> m_methods;
+};
+
+
+#endif //ANDROIDREVERSETOOLKIT_SMALISCANNER_H
@@ -0,0 +1,285 @@
+//===- SmaliSymbolIndex.cpp - ART-GUI Analysis engine -----------*- cpp -*-===//
+//
+//                     ANDROID REVERSE TOOLKIT
+//
+// This file is distributed under the GNU GENERAL PUBLIC LICENSE
+// V3 License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+#include "SmaliAnalysis/SmaliSymbolIndex.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+// match kinds, a lower rank is a better match
+enum MatchRank {
+    kExactMatch = 0,
+    kNamePrefix,
+    kDescriptorPrefix,
+    kCamelCase,
+    kFuzzy,
+};
+
+static inline qint64 makeScore(int rank, int detail) {
+    return ((qint64)rank << 32) | (quint32)detail;
+}
+
+static bool keyLess(const QPair<QString, int> &a, const QPair<QString, int> &b) {
+    return a.first < b.first;
+}
+
+// start of a word in identifier, like B and D of isBase64Decoded
+static bool isHumpStart(const QString &name, int i) {
+    if(i == 0) {
+        return true;
+    }
+    auto c = name[i];
+    auto prev = name[i - 1];
+    return c.isUpper()
+           || (c.isLetterOrNumber() && !prev.isLetterOrNumber())
+           || (c.isDigit() && !prev.isDigit());
+}
+
+// every query character continues the matched hump or starts a new one
+static bool matchCamelCase(const QString &query, const QString &name) {
+    int j = 0;
+    for(auto i = 0; i < query.size(); i++) {
+        auto c = query[i].toLower();
+        if(i > 0 && j < name.size() && name[j].toLower() == c) {
+            j++;
+            continue;
+        }
+        while(j < name.size() && !(isHumpStart(name, j) && name[j].toLower() == c)) {
+            j++;
+        }
+        if(j == name.size()) {
+            return false;
+        }
+        j++;
+    }
+    return true;
+}
+
+// characters skipped between the first and last matched one, -1 if query
+// is not a subsequence of name.
+static int fuzzyGaps(const QString &query, const QString &name) {
+    int first = -1;
+    int j = 0;
+    for(auto c: query) {
+        j = name.indexOf(c, j);
+        if(j < 0) {
+            return -1;
+        }
+        if(first < 0) {
+            first = j;
+        }
+        j++;
+    }
+    return j - first - query.size();
+}
+
+void SmaliSymbolIndex::build(const QList<QSharedPointer<SmaliFile>> &files) {
+    clear();
+    for(auto &file: files) {
+        addFile(file.data());
+    }
+    std::sort(m_descriptors.begin(), m_descriptors.end(), keyLess);
+    std::sort(m_names.begin(), m_names.end(), keyLess);
+}
+
+void SmaliSymbolIndex::update(const QStringList &removed, const QList<SmaliFile*> &files) {
+    auto freed = 0;
+    for(auto &path: removed) {
+        auto it = m_fileSymbols.find(path);
+        if(it == m_fileSymbols.end()) {
+            continue;
+        }
+        for(auto idx: it.value()) {
+            SmaliSymbol &symbol = m_symbols[idx];
+            symbol.m_descriptor.clear();
+            symbol.m_name.clear();
+            symbol.m_filepath.clear();
+            m_foldedNames[idx].clear();
+            m_freeSymbols.push_back(idx);
+        }
+        freed += it.value().size();
+        m_fileSymbols.erase(it);
+    }
+    if(freed > 0) {
+        // before the slots are reused, only the freed ones have no descriptor
+        auto isFreed = [this](const QPair<QString, int> &key) {
+            return m_symbols.at(key.second).m_descriptor.isNull();
+        };
+        m_descriptors.erase(std::remove_if(m_descriptors.begin(), m_descriptors.end(), isFreed),
+                            m_descriptors.end());
+        m_names.erase(std::remove_if(m_names.begin(), m_names.end(), isFreed),
+                      m_names.end());
+    }
+
+    auto sorted = m_descriptors.size();
+    for(auto file: files) {
+        addFile(file);
+    }
+    mergeKeys(m_descriptors, sorted);
+    mergeKeys(m_names, sorted);
+}
+
+void SmaliSymbolIndex::mergeKeys(SortedKeys &keys, int first) {
+    if(first == keys.size()) {
+        return;
+    }
+    std::sort(keys.begin() + first, keys.end(), keyLess);
+    // only the new keys are compared, old keys are moved over in runs
+    SortedKeys merged;
+    merged.reserve(keys.size());
+    auto from = keys.begin();
+    auto mid = keys.begin() + first;
+    for(auto it = mid; it != keys.end(); ++it) {
+        auto to = std::upper_bound(from, mid, *it, keyLess);
+        std::move(from, to, std::back_inserter(merged));
+        merged.push_back(std::move(*it));
+        from = to;
+    }
+    std::move(from, mid, std::back_inserter(merged));
+    keys.swap(merged);
+}
+
+void SmaliSymbolIndex::addFile(SmaliFile *file) {
+    auto cls = file->name();
+    auto path = file->sourceFile();
+
+    auto simple = cls.mid(cls.lastIndexOf('/') + 1);
+    if(simple.startsWith('L')) {
+        // class in default package
+        simple.remove(0, 1);
+    }
+    if(simple.endsWith(';')) {
+        simple.chop(1);
+    }
+    // baksmali always puts .class at the first line
+    addSymbol(SmaliSymbol::Class, cls, simple, path, 1);
+
+    for(auto i = 0, count = file->fieldCount(); i < count; i++) {
+        auto field = file->field(i);
+        addSymbol(SmaliSymbol::Field, cls + "->" + field->m_name + ':' + field->m_class,
+                  field->m_name, path, field->m_line);
+    }
+    for(auto i = 0, count = file->methodCount(); i < count; i++) {
+        auto method = file->method(i);
+        addSymbol(SmaliSymbol::Method, cls + "->" + method->m_name + method->buildProto(),
+                  method->m_name, path, method->m_startline);
+    }
+}
+
+void SmaliSymbolIndex::clear() {
+    m_symbols.clear();
+    m_freeSymbols.clear();
+    m_fileSymbols.clear();
+    m_foldedNames.clear();
+    m_descriptors.clear();
+    m_names.clear();
+}
+
+void SmaliSymbolIndex::addSymbol(SmaliSymbol::Kind kind, const QString &descriptor,
+                                 const QString &name, const QString &filepath, int line) {
+    SmaliSymbol symbol;
+    symbol.m_kind = kind;
+    symbol.m_descriptor = descriptor;
+    symbol.m_name = name;
+    symbol.m_filepath = filepath;
+    symbol.m_line = line;
+
+    auto foldedName = name.toLower();
+    int idx;
+    if(m_freeSymbols.isEmpty()) {
+        idx = m_symbols.size();
+        m_symbols.push_back(symbol);
+        m_foldedNames.push_back(foldedName);
+    } else {
+        idx = m_freeSymbols.takeLast();
+        m_symbols[idx] = symbol;
+        m_foldedNames[idx] = foldedName;
+    }
+    m_fileSymbols[filepath].push_back(idx);
+    m_descriptors.push_back(qMakePair(descriptor.toLower(), idx));
+    m_names.push_back(qMakePair(foldedName, idx));
+}
+
+void SmaliSymbolIndex::findPrefix(const SortedKeys &keys, const QString &prefix,
+                                  int rank, QHash<int, qint64> &scores) {
+    auto it = std::lower_bound(keys.begin(), keys.end(), qMakePair(prefix, 0), keyLess);
+    for(; it != keys.end() && it->first.startsWith(prefix); ++it) {
+        auto score = it->first.size() == prefix.size()
+                     ? makeScore(kExactMatch, 0)
+                     : makeScore(rank, it->first.size());
+        auto old = scores.find(it->second);
+        if(old == scores.end()) {
+            scores.insert(it->second, score);
+        } else if(score < old.value()) {
+            old.value() = score;
+        }
+    }
+}
+
+QList<SmaliSymbol> SmaliSymbolIndex::find(const QString &query, int limit) const {
+    QList<SmaliSymbol> result;
+    auto text = query.trimmed();
+    if(text.isEmpty() || limit <= 0) {
+        return result;
+    }
+
+    bool isDescriptor = text.contains("->")
+                        || (text.startsWith('L') && (text.contains('/') || text.contains(';')));
+    if(!isDescriptor && text.contains('.')) {
+        // java class name
+        text.replace('.', '/');
+        text.push_front('L');
+        isDescriptor = true;
+    }
+    auto folded = text.toLower();
+
+    QHash<int, qint64> scores;
+    findPrefix(m_descriptors, folded, kDescriptorPrefix, scores);
+    if(!isDescriptor) {
+        findPrefix(m_names, folded, kNamePrefix, scores);
+    }
+
+    // weaker matches are only needed when prefix matches are not enough
+    if(!isDescriptor && scores.size() < limit) {
+        for(auto i = 0; i < m_symbols.size(); i++) {
+            if(scores.contains(i) || m_symbols.at(i).m_descriptor.isNull()) {
+                continue;
+            }
+            const QString &name = m_symbols.at(i).m_name;
+            if(matchCamelCase(text, name)) {
+                scores.insert(i, makeScore(kCamelCase, name.size()));
+                continue;
+            }
+            auto gaps = fuzzyGaps(folded, m_foldedNames.at(i));
+            if(gaps >= 0) {
+                scores.insert(i, makeScore(kFuzzy, (qMin(gaps, 0x7FFF) << 16)
+                                                  | qMin(name.size(), 0xFFFF)));
+            }
+        }
+    }
+
+    std::vector<std::pair<qint64, int>> hits;
+    hits.reserve(scores.size());
+    for(auto it = scores.constBegin(); it != scores.constEnd(); ++it) {
+        hits.push_back(std::make_pair(it.value(), it.key()));
+    }
+    auto count = qMin(limit, (int)hits.size());
+    std::partial_sort(hits.begin(), hits.begin() + count, hits.end(),
+                      [this](const std::pair<qint64, int> &a, const std::pair<qint64, int> &b) {
+                          if(a.first != b.first) {
+                              return a.first < b.first;
+                          }
+                          return m_symbols.at(a.second).m_descriptor
+                                 < m_symbols.at(b.second).m_descriptor;
+                      });
+    for(auto i = 0; i < count; i++) {
+        result << m_symbols.at(hits[i].second);
+    }
+    return result;
+}
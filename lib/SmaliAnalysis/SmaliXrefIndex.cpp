@@ -0,0 +1,86 @@
+//===- SmaliXrefIndex.cpp - ART-GUI Analysis engine -------------*- cpp -*-===//
+//
+//                     ANDROID REVERSE TOOLKIT
+//
+// This file is distributed under the GNU GENERAL PUBLIC LICENSE
+// V3 License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+#include "SmaliAnalysis/SmaliXrefIndex.h"
+
+#include <algorithm>
+
+void SmaliXrefIndex::addFile(SmaliFile *file) {
+    if(m_fileTargets.contains(file)) {
+        removeFile(file);
+    }
+
+    QVector<int> targets;
+    for(auto i = 0, count = file->methodCount(); i < count; i++) {
+        auto method = file->method(i);
+        for(auto j = 0; j < method->m_references.size(); j++) {
+            auto id = intern(method->m_references.at(j).m_target);
+            Site site;
+            site.m_file = file;
+            site.m_method = i;
+            site.m_reference = j;
+            m_sites[id].push_back(site);
+            targets.push_back(id);
+        }
+    }
+    std::sort(targets.begin(), targets.end());
+    targets.erase(std::unique(targets.begin(), targets.end()), targets.end());
+    m_fileTargets.insert(file, targets);
+}
+
+void SmaliXrefIndex::removeFile(SmaliFile *file) {
+    auto it = m_fileTargets.find(file);
+    if(it == m_fileTargets.end()) {
+        return;
+    }
+    for(auto id: it.value()) {
+        auto &sites = m_sites[id];
+        sites.erase(std::remove_if(sites.begin(), sites.end(),
+                                   [file](const Site &site) {
+                                       return site.m_file == file;
+                                   }),
+                    sites.end());
+    }
+    m_fileTargets.erase(it);
+}
+
+void SmaliXrefIndex::clear() {
+    m_ids.clear();
+    m_sites.clear();
+    m_fileTargets.clear();
+}
+
+int SmaliXrefIndex::intern(const QString &descriptor) {
+    auto it = m_ids.constFind(descriptor);
+    if(it != m_ids.constEnd()) {
+        return it.value();
+    }
+    auto id = m_sites.size();
+    m_ids.insert(descriptor, id);
+    m_sites.push_back(QVector<Site>());
+    return id;
+}
+
+QList<SmaliXref> SmaliXrefIndex::references(const QString &descriptor) const {
+    QList<SmaliXref> result;
+    auto it = m_ids.constFind(descriptor);
+    if(it == m_ids.constEnd()) {
+        return result;
+    }
+    for(auto &site: m_sites.at(it.value())) {
+        auto method = site.m_file->method(site.m_method);
+        const SmaliReference &reference = method->m_references.at(site.m_reference);
+        SmaliXref xref;
+        xref.m_kind = reference.m_kind;
+        xref.m_filepath = site.m_file->sourceFile();
+        xref.m_method = site.m_file->name() + "->" + method->m_name + method->buildProto();
+        xref.m_line = reference.m_line;
+        result << xref;
+    }
+    return result;
+}
@@ -0,0 +1,204 @@
+//===- main.cpp - ART-GUI Analysis engine -----------------------*- cpp -*-===//
+//
+//                     ANDROID REVERSE TOOLKIT
+//
+// This file is distributed under the GNU GENERAL PUBLIC LICENSE
+// V3 License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// The file defines a benchmark of SmaliAnalysis over a smali corpus.
+//
+//===----------------------------------------------------------------------===//
+
+#include "SmaliAnalysis/SmaliFile.h"
+
+#include "SmaliScanner.h"
+
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QStringList>
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+#ifdef Q_OS_LINUX
+#include <unistd.h>
+#endif
+
+// count every allocation made with new. Qt containers allocate with malloc
+// and only show in resident memory.
+static std::atomic<qint64> gAllocations(0);
+static std::atomic<qint64> gAllocatedBytes(0);
+
+void* operator new(std::size_t size) {
+    gAllocations++;
+    gAllocatedBytes += size;
+    if(auto* ptr = std::malloc(size > 0 ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    std::free(ptr);
+}
+
+// resident memory of the process in KB, -1 if unknown
+static qint64 residentKB() {
+#ifdef Q_OS_LINUX
+    QFile statm("/proc/self/statm");
+    if(statm.open(QFile::ReadOnly)) {
+        auto fields = statm.readAll().split(' ');
+        if(fields.size() > 1) {
+            return fields[1].toLongLong() * sysconf(_SC_PAGESIZE) / 1024;
+        }
+    }
+#endif
+    return -1;
+}
+
+// reach the parse steps SmaliFile hides
+class SmaliBench {
+public:
+    // the SmaliFile(file) path: scan the mapped file, ANTLR on failure.
+    // @return false if the file fell back to ANTLR
+    static bool scan(const QString &path) {
+        SmaliFile file;
+        QFile source(path);
+        if(!source.open(QFile::ReadOnly)) {
+            return false;
+        }
+        auto size = source.size();
+        auto* data = size > 0 ? source.map(0, size) : nullptr;
+        if(data != nullptr) {
+            bool scanned = SmaliScanner(&file).scan((const char*)data, size);
+            source.unmap(data);
+            if(scanned) {
+                return true;
+            }
+        }
+        antlr4::ANTLRFileStream input(path.toStdString());
+        file.parse(input);
+        return false;
+    }
+
+    // SmaliLexer + SmaliParser + SmaliFileListener, as before SmaliScanner
+    static void parse(const QString &path) {
+        SmaliFile file;
+        antlr4::ANTLRFileStream input(path.toStdString());
+        file.parse(input);
+    }
+};
+
+static QStringList listFiles(const QString &dir) {
+    QStringList files;
+    QDirIterator it(dir, QStringList() << "*.smali", QDir::Files,
+                    QDirIterator::Subdirectories);
+    while(it.hasNext()) {
+        files << it.next();
+    }
+    return files;
+}
+
+// Time SmaliScanner and the ANTLR parser over the same files.
+static void benchParse(const QStringList &files) {
+    // read everything once, so neither pass pays for the disk
+    qint64 bytes = 0;
+    for(auto &path: files) {
+        QFile file(path);
+        if(file.open(QFile::ReadOnly)) {
+            bytes += file.readAll().size();
+        }
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    int fallbacks = 0;
+    for(auto &path: files) {
+        if(!SmaliBench::scan(path)) {
+            fallbacks++;
+            std::cout << "fallback: " << path.toStdString() << std::endl;
+        }
+    }
+    auto scanTime = timer.elapsed();
+
+    timer.start();
+    for(auto &path: files) {
+        SmaliBench::parse(path);
+    }
+    auto parseTime = timer.elapsed();
+
+    std::cout << files.size() << " files, " << bytes / 1024 << " KB" << std::endl;
+    std::cout << "SmaliScanner: " << scanTime << " ms, "
+              << fallbacks << " files fell back to ANTLR" << std::endl;
+    std::cout << "ANTLR parser: " << parseTime << " ms" << std::endl;
+}
+
+// Load all files into SmaliFiles and report what the load allocated. The
+// files are kept in loaded, so a later pass can not reuse their memory.
+static void benchLoad(const QStringList &files, const char* title,
+                      QList<SmaliFile*> &loaded) {
+    auto allocations = gAllocations.load();
+    auto bytes = gAllocatedBytes.load();
+    auto resident = residentKB();
+
+    qint64 members = 0;
+    for(auto &path: files) {
+        auto* file = new SmaliFile(path);
+        members += file->fieldCount() + file->methodCount();
+        loaded << file;
+    }
+
+    std::cout << title << ": " << members << " members, "
+              << gAllocations.load() - allocations << " allocations, "
+              << (gAllocatedBytes.load() - bytes) / 1024 << " KB allocated";
+    if(resident >= 0) {
+        std::cout << ", resident +" << residentKB() - resident << " KB";
+    }
+    std::cout << std::endl;
+}
+
+// Compare the arena with one allocation per member, as before the arena.
+static void benchMemory(const QStringList &files) {
+    QList<SmaliFile*> loaded;
+    // the arena goes first. Heap freed by its temporaries and the strings
+    // it interned are reused by the second pass, which only makes the
+    // reduction look smaller.
+    benchLoad(files, "arena", loaded);
+    SmaliArena::setChunkLimit(1);
+    benchLoad(files, "one allocation per member", loaded);
+    qDeleteAll(loaded);
+}
+
+// SmaliAnalysis_Bench [--memory] <smali directory>
+int main(int argc, char* argv[]) {
+    bool memory = argc == 3 && QByteArray(argv[1]) == "--memory";
+    if(argc != 2 && !memory) {
+        std::cout << "usage: " << argv[0] << " [--memory] <smali directory>" << std::endl;
+        return 1;
+    }
+
+    auto files = listFiles(QString::fromLocal8Bit(argv[argc - 1]));
+    if(files.isEmpty()) {
+        std::cout << "no smali file found" << std::endl;
+        return 1;
+    }
+    if(memory) {
+        benchMemory(files);
+    } else {
+        benchParse(files);
+    }
+    return 0;
+}
@@ -441,7 +441,8 @@ VOID_TYPE: 'V';
 //    }
 
 TYPE_LIST: Type+ {
-        resumeInput(getText().length());
+        // getText() is UTF-8, go back by input symbols
+        resumeInput(getCharIndex() - tokenStartCharIndex);
     } -> more, pushMode(TYPE_LIST_MODE);
 
 SIMPLE_NAME: SimpleName;
@@ -0,0 +1,808 @@
+//===- SmaliTokenizer.cpp - ART-LEX --------------------------*- ANTLR4 -*-===//
+//
+//                     ANDROID REVERSE TOOLKIT
+//
+// This file is distributed under the GNU GENERAL PUBLIC LICENSE
+// V3 License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+#include "SmaliLexer.h"
+#include "SmaliTokenizer.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// ASCII character classes
+enum CharClass {
+    kSimpleName = 1,        // SimpleNameCharacter
+    kDigit = 2,
+    kHexDigit = 4,
+    kOctalDigit = 8,
+    kPrimitiveType = 16,    // ZBSCIJFD
+    kDirectiveName = 32,    // [a-zA-Z0-9_-] of INVALID_TOKEN
+};
+
+struct CharClassTable {
+    CharClassTable() {
+        memset(m_classes, 0, sizeof(m_classes));
+        for(int c = '0'; c <= '9'; c++) {
+            m_classes[c] |= kSimpleName | kDigit | kHexDigit | kDirectiveName;
+        }
+        for(int c = '0'; c <= '7'; c++) {
+            m_classes[c] |= kOctalDigit;
+        }
+        for(int c = 'a'; c <= 'z'; c++) {
+            m_classes[c] |= kSimpleName | kDirectiveName;
+            m_classes[c - 'a' + 'A'] |= kSimpleName | kDirectiveName;
+        }
+        for(int c = 'a'; c <= 'f'; c++) {
+            m_classes[c] |= kHexDigit;
+            m_classes[c - 'a' + 'A'] |= kHexDigit;
+        }
+        for(auto c = "ZBSCIJFD"; *c != '\0'; c++) {
+            m_classes[(uchar)*c] |= kPrimitiveType;
+        }
+        m_classes[(uchar)'$'] |= kSimpleName;
+        m_classes[(uchar)'_'] |= kSimpleName | kDirectiveName;
+        m_classes[(uchar)'-'] |= kSimpleName | kDirectiveName;
+    }
+
+    uchar m_classes[128];
+};
+
+struct Keyword {
+    const char* m_text;
+    int m_length;
+    size_t m_type;
+};
+
+// Rules of SmaliLexer.g4 that only match literal text, keep them in sync
+// with the grammar.
+struct KeywordRule {
+    size_t m_type;
+    const char* m_texts;
+};
+
+const KeywordRule kKeywordRules[] = {
+        {SmaliLexer::CLASS_DIRECTIVE, ".class"},
+        {SmaliLexer::SUPER_DIRECTIVE, ".super"},
+        {SmaliLexer::IMPLEMENTS_DIRECTIVE, ".implements"},
+        {SmaliLexer::SOURCE_DIRECTIVE, ".source"},
+        {SmaliLexer::FIELD_DIRECTIVE, ".field"},
+        {SmaliLexer::END_FIELD_DIRECTIVE, ".end field"},
+        {SmaliLexer::SUBANNOTATION_DIRECTIVE, ".subannotation"},
+        {SmaliLexer::END_SUBANNOTATION_DIRECTIVE, ".end subannotation"},
+        {SmaliLexer::ANNOTATION_DIRECTIVE, ".annotation"},
+        {SmaliLexer::END_ANNOTATION_DIRECTIVE, ".end annotation"},
+        {SmaliLexer::ENUM_DIRECTIVE, ".enum"},
+        {SmaliLexer::METHOD_DIRECTIVE, ".method"},
+        {SmaliLexer::END_METHOD_DIRECTIVE, ".end method"},
+        {SmaliLexer::REGISTERS_DIRECTIVE, ".registers"},
+        {SmaliLexer::LOCALS_DIRECTIVE, ".locals"},
+        {SmaliLexer::ARRAY_DATA_DIRECTIVE, ".array-data"},
+        {SmaliLexer::END_ARRAY_DATA_DIRECTIVE, ".end array-data"},
+        {SmaliLexer::PACKED_SWITCH_DIRECTIVE, ".packed-switch"},
+        {SmaliLexer::END_PACKED_SWITCH_DIRECTIVE, ".end packed-switch"},
+        {SmaliLexer::SPARSE_SWITCH_DIRECTIVE, ".sparse-switch"},
+        {SmaliLexer::END_SPARSE_SWITCH_DIRECTIVE, ".end sparse-switch"},
+        {SmaliLexer::CATCH_DIRECTIVE, ".catch"},
+        {SmaliLexer::CATCHALL_DIRECTIVE, ".catchall"},
+        {SmaliLexer::LINE_DIRECTIVE, ".line"},
+        {SmaliLexer::PARAMETER_DIRECTIVE, ".param"},
+        {SmaliLexer::END_PARAMETER_DIRECTIVE, ".end param"},
+        {SmaliLexer::LOCAL_DIRECTIVE, ".local"},
+        {SmaliLexer::END_LOCAL_DIRECTIVE, ".end local"},
+        {SmaliLexer::RESTART_LOCAL_DIRECTIVE, ".restart local"},
+        {SmaliLexer::PROLOGUE_DIRECTIVE, ".prologue"},
+        {SmaliLexer::EPILOGUE_DIRECTIVE, ".epilogue"},
+        {SmaliLexer::BOOL_LITERAL, "true|false"},
+        {SmaliLexer::NULL_LITERAL, "null"},
+        {SmaliLexer::ANNOTATION_VISIBILITY, "build|runtime|system"},
+        {SmaliLexer::ACCESS_SPEC,
+            "public|private|protected|static|final|synchronized|bridge|varargs|native|abstract|strictfp|"
+            "synthetic|constructor|declared-synchronized|interface|enum|annotation|volatile|transient"},
+        {SmaliLexer::VERIFICATION_ERROR_TYPE,
+            "no-error|generic-error|no-such-class|no-such-field|no-such-method|illegal-class-access|"
+            "illegal-field-access|illegal-method-access|class-change-error|instantiation-error"},
+        {SmaliLexer::INSTRUCTION_FORMAT10t, "goto"},
+        {SmaliLexer::INSTRUCTION_FORMAT10x, "return-void|nop"},
+        {SmaliLexer::INSTRUCTION_FORMAT10x_ODEX, "return-void-barrier|return-void-no-barrier"},
+        {SmaliLexer::INSTRUCTION_FORMAT11n, "const/4"},
+        {SmaliLexer::INSTRUCTION_FORMAT11x,
+            "move-result|move-result-wide|move-result-object|move-exception|return|return-wide|"
+            "return-object|monitor-enter|monitor-exit|throw"},
+        {SmaliLexer::INSTRUCTION_FORMAT12x_OR_ID,
+            "move|move-wide|move-object|array-length|neg-int|not-int|neg-long|not-long|neg-float|neg-double|"
+            "int-to-long|int-to-float|int-to-double|long-to-int|long-to-float|long-to-double|float-to-int|"
+            "float-to-long|float-to-double|double-to-int|double-to-long|double-to-float|int-to-byte|"
+            "int-to-char|int-to-short"},
+        {SmaliLexer::INSTRUCTION_FORMAT12x,
+            "add-int/2addr|sub-int/2addr|mul-int/2addr|div-int/2addr|rem-int/2addr|and-int/2addr|"
+            "or-int/2addr|xor-int/2addr|shl-int/2addr|shr-int/2addr|ushr-int/2addr|add-long/2addr|"
+            "sub-long/2addr|mul-long/2addr|div-long/2addr|rem-long/2addr|and-long/2addr|or-long/2addr|"
+            "xor-long/2addr|shl-long/2addr|shr-long/2addr|ushr-long/2addr|add-float/2addr|sub-float/2addr|"
+            "mul-float/2addr|div-float/2addr|rem-float/2addr|add-double/2addr|sub-double/2addr|"
+            "mul-double/2addr|div-double/2addr|rem-double/2addr"},
+        {SmaliLexer::INSTRUCTION_FORMAT20bc, "throw-verification-error"},
+        {SmaliLexer::INSTRUCTION_FORMAT20t, "goto/16"},
+        {SmaliLexer::INSTRUCTION_FORMAT21c_FIELD,
+            "sget|sget-wide|sget-object|sget-boolean|sget-byte|sget-char|sget-short|sput|sput-wide|"
+            "sput-object|sput-boolean|sput-byte|sput-char|sput-short"},
+        {SmaliLexer::INSTRUCTION_FORMAT21c_FIELD_ODEX,
+            "sget-volatile|sget-wide-volatile|sget-object-volatile|sput-volatile|sput-wide-volatile|"
+            "sput-object-volatile"},
+        {SmaliLexer::INSTRUCTION_FORMAT21c_STRING, "const-string"},
+        {SmaliLexer::INSTRUCTION_FORMAT21c_TYPE, "check-cast|new-instance|const-class"},
+        {SmaliLexer::INSTRUCTION_FORMAT21ih, "const/high16"},
+        {SmaliLexer::INSTRUCTION_FORMAT21lh, "const-wide/high16"},
+        {SmaliLexer::INSTRUCTION_FORMAT21s, "const/16|const-wide/16"},
+        {SmaliLexer::INSTRUCTION_FORMAT21t, "if-eqz|if-nez|if-ltz|if-gez|if-gtz|if-lez"},
+        {SmaliLexer::INSTRUCTION_FORMAT22b,
+            "add-int/lit8|rsub-int/lit8|mul-int/lit8|div-int/lit8|rem-int/lit8|and-int/lit8|or-int/lit8|"
+            "xor-int/lit8|shl-int/lit8|shr-int/lit8|ushr-int/lit8"},
+        {SmaliLexer::INSTRUCTION_FORMAT22c_FIELD,
+            "iget|iget-wide|iget-object|iget-boolean|iget-byte|iget-char|iget-short|iput|iput-wide|"
+            "iput-object|iput-boolean|iput-byte|iput-char|iput-short"},
+        {SmaliLexer::INSTRUCTION_FORMAT22c_FIELD_ODEX,
+            "iget-volatile|iget-wide-volatile|iget-object-volatile|iput-volatile|iput-wide-volatile|"
+            "iput-object-volatile"},
+        {SmaliLexer::INSTRUCTION_FORMAT22c_TYPE, "instance-of|new-array"},
+        {SmaliLexer::INSTRUCTION_FORMAT22cs_FIELD,
+            "iget-quick|iget-wide-quick|iget-object-quick|iput-quick|iput-wide-quick|iput-object-quick|"
+            "iput-boolean-quick|iput-byte-quick|iput-char-quick|iput-short-quick"},
+        {SmaliLexer::INSTRUCTION_FORMAT22s_OR_ID, "rsub-int"},
+        {SmaliLexer::INSTRUCTION_FORMAT22s,
+            "add-int/lit16|mul-int/lit16|div-int/lit16|rem-int/lit16|and-int/lit16|or-int/lit16|"
+            "xor-int/lit16"},
+        {SmaliLexer::INSTRUCTION_FORMAT22t, "if-eq|if-ne|if-lt|if-ge|if-gt|if-le"},
+        {SmaliLexer::INSTRUCTION_FORMAT22x, "move/from16|move-wide/from16|move-object/from16"},
+        {SmaliLexer::INSTRUCTION_FORMAT23x,
+            "cmpl-float|cmpg-float|cmpl-double|cmpg-double|cmp-long|aget|aget-wide|aget-object|aget-boolean|"
+            "aget-byte|aget-char|aget-short|aput|aput-wide|aput-object|aput-boolean|aput-byte|aput-char|"
+            "aput-short|add-int|sub-int|mul-int|div-int|rem-int|and-int|or-int|xor-int|shl-int|shr-int|"
+            "ushr-int|add-long|sub-long|mul-long|div-long|rem-long|and-long|or-long|xor-long|shl-long|"
+            "shr-long|ushr-long|add-float|sub-float|mul-float|div-float|rem-float|add-double|sub-double|"
+            "mul-double|div-double|rem-double"},
+        {SmaliLexer::INSTRUCTION_FORMAT30t, "goto/32"},
+        {SmaliLexer::INSTRUCTION_FORMAT31c, "const-string/jumbo"},
+        {SmaliLexer::INSTRUCTION_FORMAT31i_OR_ID, "const"},
+        {SmaliLexer::INSTRUCTION_FORMAT31i, "const-wide/32"},
+        {SmaliLexer::INSTRUCTION_FORMAT31t, "fill-array-data|packed-switch|sparse-switch"},
+        {SmaliLexer::INSTRUCTION_FORMAT32x, "move/16|move-wide/16|move-object/16"},
+        {SmaliLexer::INSTRUCTION_FORMAT35c_METHOD,
+            "invoke-virtual|invoke-super|invoke-direct|invoke-static|invoke-interface"},
+        {SmaliLexer::INSTRUCTION_FORMAT35c_METHOD_ODEX, "invoke-direct-empty"},
+        {SmaliLexer::INSTRUCTION_FORMAT35c_TYPE, "filled-new-array"},
+        {SmaliLexer::INSTRUCTION_FORMAT35mi_METHOD, "execute-inline"},
+        {SmaliLexer::INSTRUCTION_FORMAT35ms_METHOD, "invoke-virtual-quick|invoke-super-quick"},
+        {SmaliLexer::INSTRUCTION_FORMAT3rc_METHOD,
+            "invoke-virtual/range|invoke-super/range|invoke-direct/range|invoke-static/range|"
+            "invoke-interface/range"},
+        {SmaliLexer::INSTRUCTION_FORMAT3rc_METHOD_ODEX, "invoke-object-init/range"},
+        {SmaliLexer::INSTRUCTION_FORMAT3rc_TYPE, "filled-new-array/range"},
+        {SmaliLexer::INSTRUCTION_FORMAT3rmi_METHOD, "execute-inline/range"},
+        {SmaliLexer::INSTRUCTION_FORMAT3rms_METHOD, "invoke-virtual-quick/range|invoke-super-quick/range"},
+        {SmaliLexer::INSTRUCTION_FORMAT45cc_METHOD, "invoke-polymorphic"},
+        {SmaliLexer::INSTRUCTION_FORMAT4rcc_METHOD, "invoke-polymorphic/range"},
+        {SmaliLexer::INSTRUCTION_FORMAT51l, "const-wide"},
+};
+
+struct KeywordTable {
+    KeywordTable() {
+        for(auto &rule: kKeywordRules) {
+            auto text = rule.m_texts;
+            while(*text != '\0') {
+                auto end = strchr(text, '|');
+                auto length = end != nullptr ? (int)(end - text) : (int)strlen(text);
+                Q_ASSERT(m_count < kMaxKeywords);
+                m_keywords[m_count++] = {text, length, rule.m_type};
+                text += end != nullptr ? length + 1 : length;
+            }
+        }
+        std::sort(m_keywords, m_keywords + m_count, [](const Keyword &a, const Keyword &b) {
+            auto common = std::min(a.m_length, b.m_length);
+            auto order = strncmp(a.m_text, b.m_text, (size_t)common);
+            return order != 0 ? order < 0 : a.m_length < b.m_length;
+        });
+    }
+
+    static const int kMaxKeywords = 384;
+    Keyword m_keywords[kMaxKeywords];
+    int m_count = 0;
+};
+
+const CharClassTable& charClasses() {
+    static const CharClassTable table;
+    return table;
+}
+
+const KeywordTable& keywords() {
+    static const KeywordTable table;
+    return table;
+}
+
+// the best rule matched at a position
+struct Match {
+    // like the ANTLR lexer, a rule considered earlier wins a tie
+    void consider(size_t type, int length) {
+        if(length > m_length) {
+            m_type = type;
+            m_length = length;
+        }
+    }
+
+    size_t m_type = SmaliLexer::INVALID_TOKEN;
+    int m_length = 0;
+};
+
+class LineScanner {
+public:
+    LineScanner(const ushort* text, int size)
+            : m_text(text), m_size(size), m_classes(charClasses().m_classes) {
+    }
+
+    // character at i, 0 after the end of line
+    ushort at(int i) const {
+        return i < m_size ? m_text[i] : 0;
+    }
+
+    bool is(int i, int charClass) const {
+        auto c = at(i);
+        return c < 128 && (m_classes[c] & charClass) != 0;
+    }
+
+    int run(int i, int charClass) const {
+        auto start = i;
+        while(is(i, charClass)) {
+            i++;
+        }
+        return i - start;
+    }
+
+    bool startsWith(int i, const char* text) const {
+        for(; *text != '\0'; text++, i++) {
+            if(at(i) != (uchar)*text) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool startsWithIgnoreCase(int i, const char* text) const {
+        for(; *text != '\0'; text++, i++) {
+            auto c = at(i);
+            if(c >= 'A' && c <= 'Z') {
+                c += 'a' - 'A';
+            }
+            if(c != (uchar)*text) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // SimpleName, a surrogate pair is one SimpleNameCharacter
+    int simpleName(int i) const {
+        auto start = i;
+        while(i < m_size) {
+            auto c = m_text[i];
+            if(c < 128) {
+                if((m_classes[c] & kSimpleName) == 0) {
+                    break;
+                }
+                i++;
+            } else if((c >= 0x00a1 && c <= 0x1fff) || (c >= 0x2010 && c <= 0x2027)
+                      || (c >= 0x2030 && c <= 0xd7ff) || (c >= 0xe000 && c <= 0xffef)) {
+                i++;
+            } else if(QChar::isHighSurrogate(c) && QChar::isLowSurrogate(at(i + 1))) {
+                i += 2;
+            } else {
+                break;
+            }
+        }
+        return i - start;
+    }
+
+    // ClassDescriptor: 'L' (SimpleName '/')* SimpleName ';'
+    int classDescriptor(int i) const {
+        if(at(i) != 'L') {
+            return 0;
+        }
+        auto end = i + 1;
+        while(true) {
+            auto length = simpleName(end);
+            if(length == 0) {
+                return 0;
+            }
+            end += length;
+            if(at(end) == ';') {
+                return end + 1 - i;
+            }
+            if(at(end) != '/') {
+                return 0;
+            }
+            end++;
+        }
+    }
+
+    // Type: PrimitiveType | ClassDescriptor | ArrayPrefix (ClassDescriptor | PrimitiveType)
+    int type(int i) const {
+        auto prefix = 0;
+        while(at(i + prefix) == '[') {
+            prefix++;
+        }
+        if(is(i + prefix, kPrimitiveType)) {
+            return prefix + 1;
+        }
+        auto length = classDescriptor(i + prefix);
+        return length > 0 ? prefix + length : 0;
+    }
+
+    // Type+
+    int typeList(int i) const {
+        auto end = i;
+        for(auto length = type(end); length > 0; length = type(end)) {
+            end += length;
+        }
+        return end - i;
+    }
+
+    // Integer: '0' | [1-9] [0-9]* | '0' [0-7]+ | HexPrefix HexDigit+
+    int integer(int i) const {
+        auto c = at(i);
+        if(c == '0') {
+            if((at(i + 1) == 'x' || at(i + 1) == 'X') && is(i + 2, kHexDigit)) {
+                return 2 + run(i + 2, kHexDigit);
+            }
+            return 1 + run(i + 1, kOctalDigit);
+        }
+        return c >= '1' && c <= '9' ? run(i, kDigit) : 0;
+    }
+
+    // [eE] '-'? [0-9]+ or [pP] '-'? [0-9]+
+    int exponent(int i, char lower) const {
+        if(at(i) != lower && at(i) != lower - 'a' + 'A') {
+            return 0;
+        }
+        auto end = i + 1;
+        if(at(end) == '-') {
+            end++;
+        }
+        auto digits = run(end, kDigit);
+        return digits > 0 ? end + digits - i : 0;
+    }
+
+    // FloatOrID
+    int floatOrId(int i) const {
+        auto minus = at(i) == '-' ? 1 : 0;
+        auto j = i + minus;
+        auto digits = run(j, kDigit);
+        if(digits > 0) {
+            auto length = exponent(j + digits, 'e');
+            if(length > 0) {
+                return minus + digits + length;
+            }
+        }
+        if(at(j) == '0' && (at(j + 1) == 'x' || at(j + 1) == 'X')) {
+            auto hex = run(j + 2, kHexDigit);
+            auto length = hex > 0 ? exponent(j + 2 + hex, 'p') : 0;
+            if(length > 0) {
+                return minus + 2 + hex + length;
+            }
+        }
+        if(startsWithIgnoreCase(j, "infinity")) {
+            return minus + 8;
+        }
+        if(minus == 0 && startsWithIgnoreCase(i, "nan")) {
+            return 3;
+        }
+        return 0;
+    }
+
+    // Float
+    int floatNumber(int i) const {
+        auto j = i + (at(i) == '-' ? 1 : 0);
+        auto digits = run(j, kDigit);
+        if(digits > 0 && at(j + digits) == '.') {
+            auto end = j + digits + 1;
+            end += run(end, kDigit);
+            return end + exponent(end, 'e') - i;
+        }
+        if(at(j) == '.') {
+            auto fraction = run(j + 1, kDigit);
+            if(fraction > 0) {
+                auto end = j + 1 + fraction;
+                return end + exponent(end, 'e') - i;
+            }
+        }
+        if(at(j) == '0' && (at(j + 1) == 'x' || at(j + 1) == 'X')) {
+            auto end = j + 2;
+            auto hex = run(end, kHexDigit);
+            end += hex;
+            if(at(end) == '.') {
+                end++;
+                auto fraction = run(end, kHexDigit);
+                end += fraction;
+                auto length = hex + fraction > 0 ? exponent(end, 'p') : 0;
+                if(length > 0) {
+                    return end + length - i;
+                }
+            }
+        }
+        return 0;
+    }
+
+    void matchNumber(int i, Match &match) const {
+        auto minus = at(i) == '-' ? 1 : 0;
+        auto j = i + minus;
+        auto length = integer(j);
+        if(length > 0) {
+            match.consider(minus ? SmaliLexer::NEGATIVE_INTEGER_LITERAL
+                                 : SmaliLexer::POSITIVE_INTEGER_LITERAL, minus + length);
+            auto suffix = at(j + length);
+            if(suffix == 'l' || suffix == 'L') {
+                match.consider(SmaliLexer::LONG_LITERAL, minus + length + 1);
+            }
+            if(suffix == 's' || suffix == 'S') {
+                match.consider(SmaliLexer::SHORT_LITERAL, minus + length + 1);
+            }
+            if(suffix == 't' || suffix == 'T') {
+                match.consider(SmaliLexer::BYTE_LITERAL, minus + length + 1);
+            }
+        }
+
+        // '-'? [0-9]+ [fF] and '-'? [0-9]+ [dD]
+        auto digits = run(j, kDigit);
+        auto digitsSuffix = digits > 0 ? at(j + digits) : 0;
+        auto id = floatOrId(i);
+        auto idSuffix = id > 0 ? at(i + id) : 0;
+        if(idSuffix == 'f' || idSuffix == 'F') {
+            match.consider(SmaliLexer::FLOAT_LITERAL_OR_ID, id + 1);
+        }
+        if(digitsSuffix == 'f' || digitsSuffix == 'F') {
+            match.consider(SmaliLexer::FLOAT_LITERAL_OR_ID, minus + digits + 1);
+        }
+        match.consider(SmaliLexer::DOUBLE_LITERAL_OR_ID,
+                       id + (idSuffix == 'd' || idSuffix == 'D' ? 1 : 0));
+        if(digitsSuffix == 'd' || digitsSuffix == 'D') {
+            match.consider(SmaliLexer::DOUBLE_LITERAL_OR_ID, minus + digits + 1);
+        }
+
+        auto number = floatNumber(i);
+        if(number > 0) {
+            auto suffix = at(i + number);
+            if(suffix == 'f' || suffix == 'F') {
+                match.consider(SmaliLexer::FLOAT_LITERAL, number + 1);
+            }
+            match.consider(SmaliLexer::DOUBLE_LITERAL,
+                           number + (suffix == 'd' || suffix == 'D' ? 1 : 0));
+        }
+    }
+
+    // longest keyword at i
+    void matchKeyword(int i, Match &match) const {
+        auto &table = keywords();
+        auto lo = table.m_keywords;
+        auto hi = table.m_keywords + table.m_count;
+        for(auto depth = 0; lo < hi; depth++) {
+            auto c = at(i + depth);
+            if(c == 0 || c >= 128) {
+                break;
+            }
+            // keywords in [lo, hi) share depth characters, a shorter one
+            // sorts first
+            lo = std::lower_bound(lo, hi, c, [depth](const Keyword &k, ushort c) {
+                return depth >= k.m_length || (uchar)k.m_text[depth] < c;
+            });
+            hi = std::upper_bound(lo, hi, c, [depth](ushort c, const Keyword &k) {
+                return c < (uchar)k.m_text[depth];
+            });
+            if(lo < hi && lo->m_length == depth + 1) {
+                match.consider(lo->m_type, depth + 1);
+            }
+        }
+    }
+
+    // INVALID_TOKEN
+    int invalid(int i) const {
+        if(at(i) != '.') {
+            return 1;
+        }
+        auto length = 1;
+        if(is(i + 1, kDirectiveName) && !is(i + 1, kDigit)) {
+            length = 2 + run(i + 2, kDirectiveName);
+        }
+        if(startsWith(i, ".end ")) {
+            auto name = run(i + 5, kDirectiveName);
+            if(name > 0) {
+                length = std::max(length, 5 + name);
+            }
+        }
+        if(startsWith(i, ".restart ")) {
+            auto name = run(i + 9, kDirectiveName);
+            if(name > 0) {
+                length = std::max(length, 9 + name);
+            }
+        }
+        return length;
+    }
+
+    const ushort* m_text;
+    int m_size;
+    const uchar* m_classes;
+};
+
+}
+
+SmaliTokenizer::SmaliTokenizer(const QChar *text, int size)
+        : m_text(reinterpret_cast<const ushort*>(text)),
+          m_size(size)
+{
+}
+
+SmaliTokenizer::SmaliTokenizer(const QString &text)
+        : SmaliTokenizer(text.constData(), text.size())
+{
+}
+
+int SmaliTokenizer::next(SmaliToken *tokens, int capacity) {
+    auto count = 0;
+    while(count < capacity && m_pos < m_size) {
+        if(m_typeList ? scanTypeList(tokens[count]) : scanDefault(tokens[count])) {
+            count++;
+        }
+    }
+    return count;
+}
+
+bool SmaliTokenizer::scanDefault(SmaliToken &token) {
+    LineScanner line(m_text, m_size);
+    auto i = m_pos;
+    auto c = m_text[i];
+    switch(c) {
+        case ' ':
+        case '\t':
+        case '\r':
+        case '\n':
+            // WHITE_SPACE
+            m_pos++;
+            return false;
+        case '#': {
+            auto end = i;
+            while(end < m_size && m_text[end] != '\r' && m_text[end] != '\n') {
+                end++;
+            }
+            token = {SmaliLexer::LINE_COMMENT, i, end - i};
+            m_pos = end;
+            return true;
+        }
+        case '"':
+        case '\'':
+            scanString(token);
+            return true;
+        default:
+            break;
+    }
+
+    // rules in the order of the grammar, keywords never tie with a number
+    // or register so they are looked up first
+    Match match;
+    if(c == '.' || (c >= 'a' && c <= 'z')) {
+        line.matchKeyword(i, match);
+    }
+    if(line.is(i, kDigit) || c == '-' || c == '.'
+       || c == 'i' || c == 'I' || c == 'n' || c == 'N') {
+        line.matchNumber(i, match);
+    }
+    if(c == 'v' || c == 'p') {
+        auto digits = line.run(i + 1, kDigit);
+        if(digits > 0) {
+            match.consider(SmaliLexer::REGISTER, 1 + digits);
+        }
+    }
+    static const struct {
+        const char* m_prefix;
+        size_t m_type;
+    } kIndexRules[] = {
+            {"inline@0x", SmaliLexer::INLINE_INDEX},
+            {"vtable@0x", SmaliLexer::VTABLE_INDEX},
+            {"field@0x", SmaliLexer::FIELD_INDEX},
+    };
+    for(auto &rule: kIndexRules) {
+        if(line.startsWith(i, rule.m_prefix)) {
+            auto prefix = (int)strlen(rule.m_prefix);
+            auto hex = line.run(i + prefix, kHexDigit);
+            if(hex > 0) {
+                match.consider(rule.m_type, prefix + hex);
+            }
+        }
+    }
+    if(c == 'V') {
+        match.consider(SmaliLexer::VOID_TYPE, 1);
+    }
+    match.consider(SmaliLexer::TYPE_LIST, line.typeList(i));
+    match.consider(SmaliLexer::SIMPLE_NAME, line.simpleName(i));
+    if(c == '<') {
+        auto name = line.simpleName(i + 1);
+        if(name > 0 && line.at(i + 1 + name) == '>') {
+            match.consider(SmaliLexer::MEMBER_NAME, name + 2);
+        }
+    }
+    switch(c) {
+        case '.':
+            match.consider(SmaliLexer::DOTDOT, line.at(i + 1) == '.' ? 2 : 0);
+            break;
+        case '-':
+            match.consider(SmaliLexer::ARROW, line.at(i + 1) == '>' ? 2 : 0);
+            break;
+        case '=':
+            match.consider(SmaliLexer::EQUAL, 1);
+            break;
+        case ':':
+            match.consider(SmaliLexer::COLON, 1);
+            break;
+        case ',':
+            match.consider(SmaliLexer::COMMA, 1);
+            break;
+        case '{':
+            match.consider(SmaliLexer::OPEN_BRACE, 1);
+            break;
+        case '}':
+            match.consider(SmaliLexer::CLOSE_BRACE, 1);
+            break;
+        case '(':
+            match.consider(SmaliLexer::OPEN_PAREN, 1);
+            break;
+        case ')':
+            match.consider(SmaliLexer::CLOSE_PAREN, 1);
+            break;
+        default:
+            break;
+    }
+    match.consider(SmaliLexer::INVALID_TOKEN, line.invalid(i));
+
+    if(match.m_type == SmaliLexer::TYPE_LIST) {
+        // the lexer goes back and matches each type in TYPE_LIST_MODE
+        m_typeList = true;
+        return false;
+    }
+    token = {match.m_type, i, match.m_length};
+    m_pos = i + match.m_length;
+    return true;
+}
+
+bool SmaliTokenizer::scanTypeList(SmaliToken &token) {
+    LineScanner line(m_text, m_size);
+    auto i = m_pos;
+    if(m_text[i] == '\n') {
+        // TYPE_LIST_NEXT_LINE
+        m_typeList = false;
+        m_pos++;
+        return false;
+    }
+
+    Match match;
+    if(line.is(i, kPrimitiveType)) {
+        match.consider(SmaliLexer::PRIMITIVE_TYPE, 1);
+    }
+    match.consider(SmaliLexer::CLASS_DESCRIPTOR, line.classDescriptor(i));
+    auto prefix = 0;
+    while(line.at(i + prefix) == '[') {
+        prefix++;
+    }
+    match.consider(SmaliLexer::ARRAY_TYPE_PREFIX, prefix);
+    match.consider(SmaliLexer::TYPE_LIST_END, 1);
+    if(match.m_type == SmaliLexer::TYPE_LIST_END) {
+        // back to default mode for the same character
+        m_typeList = false;
+        return false;
+    }
+    token = {match.m_type, i, match.m_length};
+    m_pos = i + match.m_length;
+    return true;
+}
+
+// Follow the STRING and CHAR modes of the lexer and the string handling in
+// SmaliLexer::nextToken. An escape like \n returns a STRING_ESCAPE token in
+// the middle of the string, then nextToken lexes to the end of the string
+// and replaces the token by STRING_LITERAL, or INVALID_TOKEN if an error was
+// set after the escape.
+void SmaliTokenizer::scanString(SmaliToken &token) {
+    LineScanner line(m_text, m_size);
+    auto start = m_pos;
+    auto quote = m_text[start];
+    auto isString = quote == '"';
+    auto literalType = isString ? SmaliLexer::STRING_LITERAL : SmaliLexer::CHAR_LITERAL;
+
+    // returned an escape token, the string is finished by nextToken
+    auto escaped = false;
+    auto error = false;
+    // start of the current lexer token and length of the lexer's string
+    // builder, only the CHAR_LITERAL checks use it
+    auto tokenStart = start;
+    auto builderLength = 1;
+
+    auto i = start + 1;
+    auto type = literalType;
+    while(true) {
+        if(i >= m_size) {
+            // STRING_FILEEND, or hitEOF after an escape
+            type = escaped ? SmaliLexer::INVALID_TOKEN
+                           : (isString ? SmaliLexer::STRING_FILEEND : SmaliLexer::CHAR_FILEEND);
+            break;
+        }
+        auto c = m_text[i];
+        if(c == quote) {
+            i++;
+            if(!isString) {
+                builderLength++;
+                if(builderLength == 2 || builderLength > 3) {
+                    // empty character literal or multiple chars
+                    error = true;
+                }
+            }
+            type = escaped && error ? SmaliLexer::INVALID_TOKEN : literalType;
+            break;
+        }
+        if(c == '\r' || c == '\n') {
+            i++;
+            type = escaped ? SmaliLexer::INVALID_TOKEN
+                           : (isString ? SmaliLexer::STRING_END : SmaliLexer::CHAR_END);
+            break;
+        }
+        if(c != '\\') {
+            // STRING_DATA appends the whole token text so far
+            while(i < m_size && m_text[i] != quote && m_text[i] != '\\'
+                  && m_text[i] != '\r' && m_text[i] != '\n') {
+                i++;
+            }
+            builderLength += i - tokenStart;
+            continue;
+        }
+
+        if(i + 1 >= m_size) {
+            // a backslash at the end matches no rule, the lexer drops it
+            // and nextToken ends the string with an error
+            i++;
+            type = SmaliLexer::INVALID_TOKEN;
+            break;
+        }
+        auto escape = m_text[i + 1];
+        if(escape == 'u') {
+            auto hex = 0;
+            while(hex < 4 && line.is(i + 2 + hex, kHexDigit)) {
+                hex++;
+            }
+            if(hex < 4) {
+                // STRING_UTFERROR
+                i += 2 + hex;
+                type = escaped ? SmaliLexer::INVALID_TOKEN
+                               : (isString ? SmaliLexer::STRING_UTFERROR : SmaliLexer::CHAR_UTFERROR);
+                break;
+            }
+            // STRING_UTFENCODE, decodeUtf16 only decodes a token of 6 chars
+            i += 6;
+            if(i - tokenStart == 6) {
+                builderLength++;
+            }
+            continue;
+        }
+        if(escape != 0 && escape < 128 && strchr("btnfr'\"\\", escape) != nullptr) {
+            // STRING_ESCAPE returns a token, the lexer starts a new one
+            i += 2;
+            builderLength++;
+            tokenStart = i;
+            escaped = true;
+            continue;
+        }
+        // STRING_ESCAPEERROR
+        i += 2;
+        type = escaped ? SmaliLexer::INVALID_TOKEN
+                       : (isString ? SmaliLexer::STRING_ESCAPEERROR : SmaliLexer::CHAR_ESCAPEERROR);
+        break;
+    }
+    token = {type, start, i - start};
+    m_pos = i;
+}
@@ -0,0 +1,68 @@
+//===- SmaliTokenizer.h - ART-LEX -------------------------------*- cpp -*-===//
+//
+//                     ANDROID REVERSE TOOLKIT
+//
+// This file is distributed under the GNU GENERAL PUBLIC LICENSE
+// V3 License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file define SmaliTokenizer, a hand written scanner for one line of
+// smali used by the editor. It gives the same token types as SmaliLexer,
+// from the same rules of SmaliLexer.g4, without ATN simulation, Token
+// objects or token stream. Tokens are written to a buffer of the caller and
+// nothing is allocated.
+//
+// Rules are matched in the same way as the ANTLR lexer, the longest match
+// wins and the earlier rule of the grammar wins a tie. Keywords are looked
+// up in a sorted table, other rules are scanned with a character class
+// table.
+//
+//===----------------------------------------------------------------------===//
+
+
+#ifndef ANDROIDREVERSETOOLKIT_SMALITOKENIZER_H
+#define ANDROIDREVERSETOOLKIT_SMALITOKENIZER_H
+
+#include <QChar>
+#include <QString>
+
+#include <cstddef>
+
+struct SmaliToken {
+    // SmaliLexer token type
+    size_t m_type;
+    // position and length in UTF-16 units
+    int m_start;
+    int m_length;
+};
+
+class SmaliTokenizer {
+
+public:
+    // text must stay alive while tokenizing
+    SmaliTokenizer(const QChar* text, int size);
+    explicit SmaliTokenizer(const QString &text);
+
+    /**
+     * tokenize the rest of the line, tokens after capacity are left for
+     * the next call.
+     * @param tokens buffer for at least capacity tokens
+     * @param capacity
+     * @return count of tokens written, 0 when line is finished
+     */
+    int next(SmaliToken* tokens, int capacity);
+
+private:
+    bool scanDefault(SmaliToken &token);
+    bool scanTypeList(SmaliToken &token);
+    void scanString(SmaliToken &token);
+
+    const ushort* m_text;
+    int m_size;
+    int m_pos = 0;
+    // in TYPE_LIST_MODE of the lexer
+    bool m_typeList = false;
+};
+
+#endif //ANDROIDREVERSETOOLKIT_SMALITOKENIZER_H
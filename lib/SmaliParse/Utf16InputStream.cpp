@@ -0,0 +1,39 @@
+//===- Utf16InputStream.cpp - ART-LEX ------------------------*- ANTLR4 -*-===//
+//
+//                     ANDROID REVERSE TOOLKIT
+//
+// This file is distributed under the GNU GENERAL PUBLIC LICENSE
+// V3 License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+#include "Utf16InputStream.h"
+
+Utf16InputStream::Utf16InputStream()
+        : ANTLRInputStream() {
+}
+
+void Utf16InputStream::load(const QChar* data, int size) {
+    _data.resize((size_t)size);
+    for(auto i = 0; i < size; i++) {
+        _data[i] = data[i].unicode();
+    }
+    p = 0;
+}
+
+std::string Utf16InputStream::getText(const antlr4::misc::Interval &interval) {
+    if(interval.a < 0 || interval.b < 0 || (size_t)interval.a >= _data.size()) {
+        return "";
+    }
+    auto start = (size_t)interval.a;
+    auto stop = qMin((size_t)interval.b, _data.size() - 1);
+    if(stop < start) {
+        return "";
+    }
+    // a lone surrogate can not be converted to UTF-8 by the base class
+    QString text;
+    text.reserve((int)(stop - start + 1));
+    for(auto i = start; i <= stop; i++) {
+        text.append(QChar((ushort)_data[i]));
+    }
+    return text.toStdString();
+}
@@ -0,0 +1,38 @@
+//===- Utf16InputStream.h - ART-LEX -----------------------------*- cpp -*-===//
+//
+//                     ANDROID REVERSE TOOLKIT
+//
+// This file is distributed under the GNU GENERAL PUBLIC LICENSE
+// V3 License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file define Utf16InputStream, a char stream fed straight from QString
+// without UTF-8 conversion. Each UTF-16 unit is one input symbol, so token
+// indexes are QString positions and a surrogate pair is matched by the
+// HighSurrogate LowSurrogate rule of the lexer.
+//
+//===----------------------------------------------------------------------===//
+
+
+#ifndef ANDROIDREVERSETOOLKIT_UTF16INPUTSTREAM_H
+#define ANDROIDREVERSETOOLKIT_UTF16INPUTSTREAM_H
+
+#include "antlr4-runtime.h"
+
+#include <QString>
+
+
+class Utf16InputStream: public antlr4::ANTLRInputStream {
+
+public:
+    Utf16InputStream();
+
+    // replace the content and rewind, the buffer is reused
+    void load(const QChar* data, int size);
+    void load(const QString &text) { load(text.constData(), text.size()); }
+
+    virtual std::string getText(const antlr4::misc::Interval &interval) override;
+};
+
+#endif //ANDROIDREVERSETOOLKIT_UTF16INPUTSTREAM_H
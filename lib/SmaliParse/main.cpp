@@ -18,7 +18,13 @@
 #include "SmaliLexer.h"
 #include "SmaliParser.h"
 #include "SmaliParserBaseListener.h"
+#include "SmaliTokenizer.h"
+#include "Utf16InputStream.h"
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
 #include <QString>
+#include <QTextStream>
 
 
 using namespace std;
@@ -56,7 +62,71 @@ void testANRLR() {
     std::cout << tree->toStringTree(&parser) << std::endl << std::endl;
 }
 
-int main() {
-    testANRLR();
-    return 0;
+// Compare token types of SmaliTokenizer with SmaliLexer line by line, like
+// the editor lexes a block.
+// @return count of different lines
+int testTokenizer(const QString &path) {
+    QFile file(path);
+    if(!file.open(QFile::ReadOnly | QFile::Text)) {
+        std::cout << "can not open " << path.toStdString() << std::endl;
+        return 1;
+    }
+    QTextStream stream(&file);
+    stream.setCodec("UTF-8");
+
+    Utf16InputStream input;
+    SmaliLexer lexer(&input);
+    lexer.removeErrorListeners();
+    int failed = 0;
+    for(int lineNumber = 1; !stream.atEnd(); lineNumber++) {
+        auto line = stream.readLine();
+
+        std::vector<size_t> expected;
+        input.load(line);
+        lexer.setInputStream(&input);
+        for(auto token = lexer.nextToken(); token->getType() != antlr4::Token::EOF;
+            token = lexer.nextToken()) {
+            expected.push_back(token->getType());
+        }
+
+        std::vector<size_t> actual;
+        SmaliTokenizer tokenizer(line);
+        SmaliToken tokens[64];
+        for(auto count = tokenizer.next(tokens, 64); count > 0; count = tokenizer.next(tokens, 64)) {
+            for(auto i = 0; i < count; i++) {
+                actual.push_back(tokens[i].m_type);
+            }
+        }
+
+        if(actual != expected) {
+            failed++;
+            std::cout << path.toStdString() << ":" << lineNumber << ": "
+                      << line.toStdString() << std::endl;
+        }
+    }
+    return failed;
+}
+
+// SmaliParse_Test [smali file or directory]...
+int main(int argc, char* argv[]) {
+    if(argc < 2) {
+        testANRLR();
+        return 0;
+    }
+
+    int failed = 0;
+    for(int i = 1; i < argc; i++) {
+        auto path = QString::fromLocal8Bit(argv[i]);
+        if(!QFileInfo(path).isDir()) {
+            failed += testTokenizer(path);
+            continue;
+        }
+        QDirIterator it(path, QStringList() << "*.smali", QDir::Files,
+                        QDirIterator::Subdirectories);
+        while(it.hasNext()) {
+            failed += testTokenizer(it.next());
+        }
+    }
+    std::cout << failed << " lines differ" << std::endl;
+    return failed == 0 ? 0 : 1;
 }
\ No newline at end of file
@@ -62,6 +62,10 @@ QString ProjectInfo::getConfigPath() {
     return getRootPath() + "/Config.xml";
 }
 
+QString ProjectInfo::getIndexCachePath() {
+    return getRootPath() + "/SmaliIndex.cache";
+}
+
 void ProjectInfo::saveAllConfig() {
     for(auto &info: m_infoMap) {
         Configuration cfg(info->getConfigPath());
@@ -40,6 +40,8 @@ ScriptEngine::ScriptEngine(MainWindow *parent) : QObject((QObject*)parent)
     scripts.insert("Find", &ScriptEngine::find);
     scripts.insert("GotoLine", &ScriptEngine::gotoLine);
     scripts.insert("FindAdvance", &ScriptEngine::findAdvance);
+    scripts.insert("FindSymbol", &ScriptEngine::findSymbol);
+    scripts.insert("LoadDex", &ScriptEngine::loadDex);
 
 
     scripts.insert("Build", &ScriptEngine::build);
@@ -1,4 +1,61 @@
+//===- StringPool.cpp - ART-GUI utilpart ------------------------*- C++ -*-===//
 //
-// Created by f8left on 16-10-12.
+//                     ANDROID REVERSE TOOLKIT
 //
+// This file is distributed under the GNU GENERAL PUBLIC LICENSE
+// V3 License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+#include "utils/StringPool.h"
+
+#include <QMutexLocker>
+
+StringPool* StringPool::instance()
+{
+    static StringPool pool;
+    return &pool;
+}
+
+QString StringPool::intern(const QString &str)
+{
+    if(str.isEmpty()) {
+        return str;
+    }
+    auto &shard = m_shards[qHash(str) % kShardCount];
+    QMutexLocker locker(&shard.m_lock);
+    auto it = shard.m_strings.constFind(str);
+    if(it != shard.m_strings.constEnd()) {
+        return *it;
+    }
+    shard.m_strings.insert(str);
+    return str;
+}
+
+QString StringPool::intern(const char *utf8, int size)
+{
+    return intern(QString::fromUtf8(utf8, size));
+}
+
+void StringPool::squeeze()
+{
+    for(auto &shard: m_shards) {
+        QMutexLocker locker(&shard.m_lock);
+        for(auto it = shard.m_strings.begin(); it != shard.m_strings.end();) {
+            if(it->isDetached()) {
+                it = shard.m_strings.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+}
 
+int StringPool::size()
+{
+    auto count = 0;
+    for(auto &shard: m_shards) {
+        QMutexLocker locker(&shard.m_lock);
+        count += shard.m_strings.size();
+    }
+    return count;
+}